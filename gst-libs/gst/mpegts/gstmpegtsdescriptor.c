@@ -651,13 +651,27 @@ _packetize_descriptor_array (GPtrArray * array, guint8 ** out_data)
   }
 }
 
+/* Descriptors parsed from one descriptor loop share a single allocation,
+ * holding the descriptors followed by a copy of the loop data, which is
+ * freed with the last one. */
+typedef struct
+{
+  gint refcount;
+  GstMpegtsDescriptor descriptors[1];
+} GstMpegtsDescriptorBlock;
+
+/* The block a descriptor was parsed into, or NULL if the descriptor and its
+ * data were allocated on their own */
+#define DESCRIPTOR_BLOCK(desc) \
+    ((GstMpegtsDescriptorBlock *) (desc)->_gst_reserved[0])
+
 GstMpegtsDescriptor *
 _new_descriptor (guint8 tag, guint8 length)
 {
   GstMpegtsDescriptor *descriptor;
   guint8 *data;
 
-  descriptor = g_slice_new (GstMpegtsDescriptor);
+  descriptor = g_slice_new0 (GstMpegtsDescriptor);
 
   descriptor->tag = tag;
   descriptor->tag_extension = 0;
@@ -679,7 +693,7 @@ _new_descriptor_with_extension (guint8 tag, guint8 tag_extension, guint8 length)
   GstMpegtsDescriptor *descriptor;
   guint8 *data;
 
-  descriptor = g_slice_new (GstMpegtsDescriptor);
+  descriptor = g_slice_new0 (GstMpegtsDescriptor);
 
   descriptor->tag = tag;
   descriptor->tag_extension = tag_extension;
@@ -703,6 +717,8 @@ _copy_descriptor (GstMpegtsDescriptor * desc)
 
   copy = g_slice_dup (GstMpegtsDescriptor, desc);
   copy->data = g_memdup (desc->data, desc->length + 2);
+  /* the copy owns its data */
+  copy->_gst_reserved[0] = NULL;
 
   return copy;
 }
@@ -716,6 +732,14 @@ _copy_descriptor (GstMpegtsDescriptor * desc)
 void
 gst_mpegts_descriptor_free (GstMpegtsDescriptor * desc)
 {
+  GstMpegtsDescriptorBlock *block = DESCRIPTOR_BLOCK (desc);
+
+  if (block) {
+    if (g_atomic_int_dec_and_test (&block->refcount))
+      g_free (block);
+    return;
+  }
+
   g_free ((gpointer) desc->data);
   g_slice_free (GstMpegtsDescriptor, desc);
 }
@@ -732,7 +756,8 @@ G_DEFINE_BOXED_TYPE (GstMpegtsDescriptor, gst_mpegts_descriptor,
  * Parses the descriptors present in @buffer and returns them as an
  * array.
  *
- * Note: The data provided in @buffer will not be copied.
+ * Note: The descriptors point to a copy of the data provided in @buffer,
+ * which can be freed afterwards.
  *
  * Returns: (transfer full) (element-type GstMpegtsDescriptor): an
  * array of the parsed descriptors or %NULL if there was an error.
@@ -741,6 +766,7 @@ G_DEFINE_BOXED_TYPE (GstMpegtsDescriptor, gst_mpegts_descriptor,
 GPtrArray *
 gst_mpegts_parse_descriptors (guint8 * buffer, gsize buf_len)
 {
+  GstMpegtsDescriptorBlock *block;
   GPtrArray *res;
   guint8 length;
   guint8 *data;
@@ -781,16 +807,20 @@ gst_mpegts_parse_descriptors (guint8 * buffer, gsize buf_len)
       g_ptr_array_new_full (nb_desc + 1,
       (GDestroyNotify) gst_mpegts_descriptor_free);
 
-  data = buffer;
+  /* Allocate all descriptors and a copy of their data at once */
+  block = g_malloc0 (G_STRUCT_OFFSET (GstMpegtsDescriptorBlock, descriptors) +
+      nb_desc * sizeof (GstMpegtsDescriptor) + buf_len);
+  block->refcount = nb_desc;
+  data = (guint8 *) & block->descriptors[nb_desc];
+  memcpy (data, buffer, buf_len);
 
   for (i = 0; i < nb_desc; i++) {
-    GstMpegtsDescriptor *desc = g_slice_new0 (GstMpegtsDescriptor);
+    GstMpegtsDescriptor *desc = &block->descriptors[i];
 
+    desc->_gst_reserved[0] = block;
     desc->data = data;
     desc->tag = *data++;
     desc->length = *data++;
-    /* Copy the data now that we known the size */
-    desc->data = g_memdup (desc->data, desc->length + 2);
     GST_LOG ("descriptor 0x%02x length:%d", desc->tag, desc->length);
     GST_MEMDUMP ("descriptor", desc->data + 2, desc->length);
     /* extended descriptors */
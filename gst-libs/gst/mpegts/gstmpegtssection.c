@@ -127,16 +127,50 @@ static const guint32 crc_tab[256] = {
   0xbcb4666d, 0xb8757bda, 0xb5365d03, 0xb1f740b4
 };
 
+/* crc_tab_8[k][b] is the CRC of byte b followed by k zero bytes, used
+ * to process 8 bytes per iteration */
+static guint32 crc_tab_8[8][256];
+
+static void
+_init_crc_tab_8 (void)
+{
+  static gsize initialized = 0;
+
+  if (g_once_init_enter (&initialized)) {
+    guint i, k;
+
+    for (i = 0; i < 256; i++) {
+      crc_tab_8[0][i] = crc_tab[i];
+      for (k = 1; k < 8; k++)
+        crc_tab_8[k][i] = (crc_tab_8[k - 1][i] << 8) ^
+            crc_tab[crc_tab_8[k - 1][i] >> 24];
+    }
+
+    g_once_init_leave (&initialized, 1);
+  }
+}
+
 /* _calc_crc32 relicensed to LGPL from fluendo ts demuxer */
 guint32
 _calc_crc32 (const guint8 * data, guint datalen)
 {
-  gint i;
   guint32 crc = 0xffffffff;
 
-  for (i = 0; i < datalen; i++) {
-    crc = (crc << 8) ^ crc_tab[((crc >> 24) ^ *data++) & 0xff];
+  _init_crc_tab_8 ();
+
+  for (; datalen >= 8; datalen -= 8, data += 8) {
+    guint32 one = crc ^ GST_READ_UINT32_BE (data);
+    guint32 two = GST_READ_UINT32_BE (data + 4);
+
+    crc = crc_tab_8[7][one >> 24] ^ crc_tab_8[6][(one >> 16) & 0xff] ^
+        crc_tab_8[5][(one >> 8) & 0xff] ^ crc_tab_8[4][one & 0xff] ^
+        crc_tab_8[3][two >> 24] ^ crc_tab_8[2][(two >> 16) & 0xff] ^
+        crc_tab_8[1][(two >> 8) & 0xff] ^ crc_tab_8[0][two & 0xff];
   }
+
+  while (datalen--)
+    crc = (crc << 8) ^ crc_tab[((crc >> 24) ^ *data++) & 0xff];
+
   return crc;
 }
 
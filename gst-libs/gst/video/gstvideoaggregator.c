@@ -77,6 +77,11 @@ struct _GstVideoAggregatorPadPrivate
   GstClockTime end_time;
 
   GstVideoInfo pending_vinfo;
+
+  /* frame preparation statistics */
+  guint64 n_prepared;
+  GstClockTime prepare_time;
+  GstClockTime max_prepare_time;
 };
 
 
@@ -246,6 +251,14 @@ gst_video_aggregator_pad_finalize (GObject * o)
 {
   GstVideoAggregatorPad *vaggpad = GST_VIDEO_AGGREGATOR_PAD (o);
 
+  if (vaggpad->priv->n_prepared)
+    GST_DEBUG_OBJECT (vaggpad, "Prepared %" G_GUINT64_FORMAT " frames, "
+        "average %" GST_TIME_FORMAT ", max %" GST_TIME_FORMAT,
+        vaggpad->priv->n_prepared,
+        GST_TIME_ARGS (vaggpad->priv->prepare_time /
+            vaggpad->priv->n_prepared),
+        GST_TIME_ARGS (vaggpad->priv->max_prepare_time));
+
   if (vaggpad->priv->convert)
     gst_video_converter_free (vaggpad->priv->convert);
   vaggpad->priv->convert = NULL;
@@ -455,6 +468,12 @@ struct _GstVideoAggregatorPrivate
   GstCaps *current_caps;
 
   gboolean live;
+
+  /* frame preparation in worker threads */
+  GThreadPool *prepare_pool;
+  GMutex prepare_lock;
+  GCond prepare_cond;
+  guint prepare_pending;
 };
 
 /* Can't use the G_DEFINE_TYPE macros because we need the
@@ -1315,11 +1334,116 @@ prepare_frames (GstElement * agg, GstPad * pad, gpointer user_data)
   GstVideoAggregatorPad *vpad = GST_VIDEO_AGGREGATOR_PAD_CAST (pad);
   GstVideoAggregatorPadClass *vaggpad_class =
       GST_VIDEO_AGGREGATOR_PAD_GET_CLASS (pad);
+  GstVideoAggregatorPadPrivate *ppriv = vpad->priv;
+  GstClockTime start, elapsed;
+  gboolean res;
 
   if (vpad->buffer == NULL || !vaggpad_class->prepare_frame)
     return TRUE;
 
-  return vaggpad_class->prepare_frame (vpad, GST_VIDEO_AGGREGATOR_CAST (agg));
+  start = gst_util_get_timestamp ();
+  res = vaggpad_class->prepare_frame (vpad, GST_VIDEO_AGGREGATOR_CAST (agg));
+  elapsed = gst_util_get_timestamp () - start;
+
+  ppriv->n_prepared++;
+  ppriv->prepare_time += elapsed;
+  if (elapsed > ppriv->max_prepare_time)
+    ppriv->max_prepare_time = elapsed;
+
+  GST_TRACE_OBJECT (pad, "Prepared frame in %" GST_TIME_FORMAT,
+      GST_TIME_ARGS (elapsed));
+
+  /* The frame of this pad is left out, but the other pads are prepared in
+   * any case, like the worker threads do */
+  if (!res)
+    GST_WARNING_OBJECT (pad, "Could not prepare frame");
+
+  return TRUE;
+}
+
+static void
+prepare_frames_func (GstPad * pad, GstVideoAggregator * vagg)
+{
+  GstVideoAggregatorPrivate *priv = vagg->priv;
+
+  prepare_frames (GST_ELEMENT_CAST (vagg), pad, NULL);
+  gst_object_unref (pad);
+
+  g_mutex_lock (&priv->prepare_lock);
+  if (--priv->prepare_pending == 0)
+    g_cond_signal (&priv->prepare_cond);
+  g_mutex_unlock (&priv->prepare_lock);
+}
+
+/* Prepares the frames of all pads, spreading them over the worker
+ * threads if the subclass allows more than one thread */
+static void
+gst_video_aggregator_prepare_frames (GstVideoAggregator * vagg)
+{
+  GstVideoAggregatorClass *klass = GST_VIDEO_AGGREGATOR_GET_CLASS (vagg);
+  GstVideoAggregatorPrivate *priv = vagg->priv;
+  GList *pads = NULL, *l;
+  guint n_threads = 1;
+
+  if (klass->get_n_threads)
+    n_threads = klass->get_n_threads (vagg);
+
+  GST_OBJECT_LOCK (vagg);
+  if (n_threads != 1) {
+    for (l = GST_ELEMENT_CAST (vagg)->sinkpads; l; l = l->next) {
+      GstVideoAggregatorPad *vpad = l->data;
+
+      if (vpad->buffer)
+        pads = g_list_prepend (pads, gst_object_ref (vpad));
+    }
+  }
+  GST_OBJECT_UNLOCK (vagg);
+
+  if (n_threads == 0)
+    n_threads = g_get_num_processors ();
+
+  /* Nothing to gain from the workers for a single frame */
+  if (n_threads == 1 || pads == NULL || pads->next == NULL) {
+    g_list_free_full (pads, gst_object_unref);
+    gst_element_foreach_sink_pad (GST_ELEMENT_CAST (vagg), prepare_frames,
+        NULL);
+    return;
+  }
+
+  if (priv->prepare_pool == NULL) {
+    GError *err = NULL;
+
+    priv->prepare_pool = g_thread_pool_new ((GFunc) prepare_frames_func,
+        vagg, n_threads, FALSE, &err);
+    if (priv->prepare_pool == NULL) {
+      GST_WARNING_OBJECT (vagg, "Could not create worker threads: %s",
+          err->message);
+      g_clear_error (&err);
+      g_list_free_full (pads, gst_object_unref);
+      gst_element_foreach_sink_pad (GST_ELEMENT_CAST (vagg), prepare_frames,
+          NULL);
+      return;
+    }
+  } else if (g_thread_pool_get_max_threads (priv->prepare_pool) != n_threads) {
+    g_thread_pool_set_max_threads (priv->prepare_pool, n_threads, NULL);
+  }
+
+  GST_LOG_OBJECT (vagg, "Preparing %u frames with up to %u threads",
+      g_list_length (pads), n_threads);
+
+  g_mutex_lock (&priv->prepare_lock);
+  priv->prepare_pending = g_list_length (pads);
+  g_mutex_unlock (&priv->prepare_lock);
+
+  /* the workers take over the pad references */
+  for (l = pads; l; l = l->next)
+    g_thread_pool_push (priv->prepare_pool, l->data, NULL);
+  g_list_free (pads);
+
+  g_mutex_lock (&priv->prepare_lock);
+  while (priv->prepare_pending > 0)
+    g_cond_wait (&priv->prepare_cond, &priv->prepare_lock);
+  g_mutex_unlock (&priv->prepare_lock);
 }
 
 static gboolean
@@ -1348,6 +1472,10 @@ gst_video_aggregator_do_aggregate (GstVideoAggregator * vagg,
   g_assert (vagg_klass->aggregate_frames != NULL);
   g_assert (vagg_klass->get_output_buffer != NULL);
 
+  /* Sync pad properties to the stream time, before the subclass looks at
+   * them to provide an output buffer */
+  gst_element_foreach_sink_pad (GST_ELEMENT_CAST (vagg), sync_pad_values, NULL);
+
   if ((ret = vagg_klass->get_output_buffer (vagg, outbuf)) != GST_FLOW_OK) {
     GST_WARNING_OBJECT (vagg, "Could not get an output buffer, reason: %s",
         gst_flow_get_name (ret));
@@ -1361,11 +1489,8 @@ gst_video_aggregator_do_aggregate (GstVideoAggregator * vagg,
   GST_BUFFER_TIMESTAMP (*outbuf) = output_start_time;
   GST_BUFFER_DURATION (*outbuf) = output_end_time - output_start_time;
 
-  /* Sync pad properties to the stream time */
-  gst_element_foreach_sink_pad (GST_ELEMENT_CAST (vagg), sync_pad_values, NULL);
-
   /* Convert all the frames the subclass has before aggregating */
-  gst_element_foreach_sink_pad (GST_ELEMENT_CAST (vagg), prepare_frames, NULL);
+  gst_video_aggregator_prepare_frames (vagg);
 
   ret = vagg_klass->aggregate_frames (vagg, *outbuf);
 
@@ -2148,6 +2273,10 @@ gst_video_aggregator_finalize (GObject * o)
 {
   GstVideoAggregator *vagg = GST_VIDEO_AGGREGATOR (o);
 
+  if (vagg->priv->prepare_pool)
+    g_thread_pool_free (vagg->priv->prepare_pool, FALSE, TRUE);
+  g_mutex_clear (&vagg->priv->prepare_lock);
+  g_cond_clear (&vagg->priv->prepare_cond);
   g_mutex_clear (&vagg->priv->lock);
 
   G_OBJECT_CLASS (gst_video_aggregator_parent_class)->finalize (o);
@@ -2319,6 +2448,8 @@ gst_video_aggregator_init (GstVideoAggregator * vagg,
   vagg->priv->current_caps = NULL;
 
   g_mutex_init (&vagg->priv->lock);
+  g_mutex_init (&vagg->priv->prepare_lock);
+  g_cond_init (&vagg->priv->prepare_cond);
 
   /* initialize variables */
   g_mutex_lock (&sink_caps_mutex);
@@ -87,6 +87,14 @@ struct _GstVideoAggregator
  *                            Notifies subclasses what caps format has been negotiated
  * @find_best_format:         Optional.
  *                            Lets subclasses decide of the best common format to use.
+ * @get_n_threads:            Optional.
+ *                            Returns the maximum number of threads the frames of the
+ *                            sink pads may be prepared on, 0 meaning one thread per
+ *                            processor. Subclasses only implement this if the
+ *                            #GstVideoAggregatorPadClass.prepare_frame of their pads can
+ *                            run for several pads at the same time and does not look at
+ *                            the other pads. Without it, the frames are prepared one
+ *                            after another in the aggregating thread. Since: 1.14
  **/
 struct _GstVideoAggregatorClass
 {
@@ -107,8 +115,10 @@ struct _GstVideoAggregatorClass
 
   GstCaps           *sink_non_alpha_caps;
 
+  guint              (*get_n_threads)             (GstVideoAggregator *  vagg);
+
   /* < private > */
-  gpointer            _gst_reserved[GST_PADDING_LARGE];
+  gpointer            _gst_reserved[GST_PADDING_LARGE - 1];
 };
 
 GST_EXPORT
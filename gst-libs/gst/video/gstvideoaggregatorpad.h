@@ -85,7 +85,10 @@ struct _GstVideoAggregatorPad
  * @set_info: Lets subclass set a converter on the pad,
  *                 right after a new format has been negotiated.
  * @prepare_frame: Prepare the frame from the pad buffer (if any)
- *                 and sets it to @aggregated_frame
+ *                 and sets it to @aggregated_frame. If the
+ *                 #GstVideoAggregatorClass.get_n_threads of the aggregator
+ *                 returns anything but 1, this can be called from worker
+ *                 threads, for several pads at once.
  * @clean_frame:   clean the frame previously prepared in prepare_frame
  */
 struct _GstVideoAggregatorPadClass
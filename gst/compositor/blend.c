@@ -148,12 +148,13 @@ fill_checker_##name##_c (GstVideoFrame * frame) \
   gint i, j; \
   gint val; \
   static const gint tab[] = { 80, 160, 80, 160 }; \
-  gint width, height; \
+  gint width, height, dest_add; \
   guint8 *dest; \
   \
   dest = GST_VIDEO_FRAME_PLANE_DATA (frame, 0); \
   width = GST_VIDEO_FRAME_COMP_WIDTH (frame, 0); \
   height = GST_VIDEO_FRAME_COMP_HEIGHT (frame, 0); \
+  dest_add = GST_VIDEO_FRAME_COMP_STRIDE (frame, 0) - width * 4; \
   \
   if (!RGB) { \
     for (i = 0; i < height; i++) { \
@@ -164,6 +165,7 @@ fill_checker_##name##_c (GstVideoFrame * frame) \
         dest[C3] = 128; \
         dest += 4; \
       } \
+      dest += dest_add; \
     } \
   } else { \
     for (i = 0; i < height; i++) { \
@@ -175,6 +177,7 @@ fill_checker_##name##_c (GstVideoFrame * frame) \
         dest[C3] = val; \
         dest += 4; \
       } \
+      dest += dest_add; \
     } \
   } \
 }
@@ -193,12 +196,13 @@ fill_color_##name (GstVideoFrame * frame, gint Y, gint U, gint V) \
 { \
   gint c1, c2, c3; \
   guint32 val; \
-  gint width, height; \
+  gint i, width, height, stride; \
   guint8 *dest; \
   \
   dest = GST_VIDEO_FRAME_PLANE_DATA (frame, 0); \
   width = GST_VIDEO_FRAME_COMP_WIDTH (frame, 0); \
   height = GST_VIDEO_FRAME_COMP_HEIGHT (frame, 0); \
+  stride = GST_VIDEO_FRAME_COMP_STRIDE (frame, 0); \
   \
   if (RGB) { \
     c1 = YUV_TO_R (Y, U, V); \
@@ -211,7 +215,14 @@ fill_color_##name (GstVideoFrame * frame, gint Y, gint U, gint V) \
   } \
   val = GUINT32_FROM_BE ((0xff << A) | (c1 << C1) | (c2 << C2) | (c3 << C3)); \
   \
-  compositor_orc_splat_u32 ((guint32 *) dest, val, height * width); \
+  if (stride == width * 4) { \
+    compositor_orc_splat_u32 ((guint32 *) dest, val, height * width); \
+  } else { \
+    for (i = 0; i < height; i++) { \
+      compositor_orc_splat_u32 ((guint32 *) dest, val, width); \
+      dest += stride; \
+    } \
+  } \
 }
 
 A32_COLOR (argb, TRUE, 24, 16, 8, 0);
@@ -541,18 +552,18 @@ blend_##format_name (GstVideoFrame * srcframe, gint xpos, gint ypos, \
     ypos = 0; \
   } \
   /* If x or y offset are larger then the source it's outside of the picture */ \
-  if (xoffset > src_width || yoffset > src_height) { \
+  if (xoffset >= src_width || yoffset >= src_height) { \
     return; \
   } \
   \
   /* adjust width/height if the src is bigger than dest */ \
-  if (xpos + src_width > dest_width) { \
+  if (xpos + b_src_width > dest_width) { \
     b_src_width = dest_width - xpos; \
   } \
-  if (ypos + src_height > dest_height) { \
+  if (ypos + b_src_height > dest_height) { \
     b_src_height = dest_height - ypos; \
   } \
-  if (b_src_width < 0 || b_src_height < 0) { \
+  if (b_src_width <= 0 || b_src_height <= 0) { \
     return; \
   } \
   \
@@ -711,6 +722,9 @@ blend_##name (GstVideoFrame * srcframe, gint xpos, gint ypos, \
   if (ypos + src_height > dest_height) { \
     src_height = dest_height - ypos; \
   } \
+  if (src_width <= 0 || src_height <= 0) { \
+    return; \
+  } \
   \
   dest = dest + bpp * xpos + (ypos * dest_stride); \
   /* If it's completely transparent... we just return */ \
@@ -880,6 +894,9 @@ blend_##name (GstVideoFrame * srcframe, gint xpos, gint ypos, \
   if (ypos + src_height > dest_height) { \
     src_height = dest_height - ypos; \
   } \
+  if (src_width <= 0 || src_height <= 0) { \
+    return; \
+  } \
   \
   dest = dest + 2 * xpos + (ypos * dest_stride); \
   /* If it's completely transparent... we just return */ \
@@ -964,6 +981,649 @@ PACKED_422_FILL_COLOR (yuy2, 24, 16, 8, 0);
 PACKED_422_FILL_COLOR (yvyu, 24, 0, 8, 16);
 PACKED_422_FILL_COLOR (uyvy, 16, 24, 0, 8);
 
+/* 16 bit containers, for formats with 10 to 16 bits per component. The
+ * loops are kept simple so that the compiler vectorises them */
+
+/* Alpha in 12 bit fixed point, the products with 16 bit samples then fit
+ * in 32 bits */
+#define ALPHA_U16_SHIFT 12
+
+static inline void
+_blend_loop_u16 (guint8 * dest, gint dest_stride, const guint8 * src,
+    gint src_stride, gint b_alpha, gint width, gint height)
+{
+  gint i, j;
+
+  for (i = 0; i < height; i++) {
+    guint16 *d = (guint16 *) dest;
+    const guint16 *s = (const guint16 *) src;
+
+    for (j = 0; j < width; j++)
+      d[j] = (d[j] * ((1 << ALPHA_U16_SHIFT) - b_alpha) + s[j] * b_alpha)
+          >> ALPHA_U16_SHIFT;
+
+    src += src_stride;
+    dest += dest_stride;
+  }
+}
+
+/* Additive mode: the formats have no alpha to sum up, so the weighted
+ * samples are. The pads crossfaded on a cleared frame then add up to their
+ * mix, as their weights sum up to 1.0 */
+static inline void
+_add_loop_u16 (guint8 * dest, gint dest_stride, const guint8 * src,
+    gint src_stride, gint b_alpha, gint width, gint height)
+{
+  gint i, j;
+
+  for (i = 0; i < height; i++) {
+    guint16 *d = (guint16 *) dest;
+    const guint16 *s = (const guint16 *) src;
+
+    for (j = 0; j < width; j++) {
+      guint32 val = d[j] + ((s[j] * b_alpha) >> ALPHA_U16_SHIFT);
+
+      d[j] = MIN (val, 0xffff);
+    }
+
+    src += src_stride;
+    dest += dest_stride;
+  }
+}
+
+/* Converts an 8 bit YUV value to the depth and position of @comp */
+static inline guint16
+_scale_yuv_u16 (const GstVideoFormatInfo * info, gint comp, gint val)
+{
+  return (val << (GST_VIDEO_FORMAT_INFO_DEPTH (info, comp) - 8)) <<
+      GST_VIDEO_FORMAT_INFO_SHIFT (info, comp);
+}
+
+/* I420_10, I422_10, Y444_10 and P010_10 in the native endianness */
+static void
+blend_planar_u16 (GstVideoFrame * srcframe, gint xpos, gint ypos,
+    gdouble src_alpha, GstVideoFrame * destframe, GstCompositorBlendMode mode)
+{
+  const GstVideoFormatInfo *info = srcframe->info.finfo;
+  gint b_src_width, b_src_height;
+  gint xoffset = 0, yoffset = 0;
+  gint dest_width, dest_height;
+  gint src_width, src_height;
+  gint b_alpha, x_sub, y_sub;
+  guint plane, comp;
+
+  /* If it's completely transparent... we just return */
+  if (G_UNLIKELY (src_alpha == 0.0))
+    return;
+
+  src_width = GST_VIDEO_FRAME_WIDTH (srcframe);
+  src_height = GST_VIDEO_FRAME_HEIGHT (srcframe);
+  dest_width = GST_VIDEO_FRAME_WIDTH (destframe);
+  dest_height = GST_VIDEO_FRAME_HEIGHT (destframe);
+
+  /* round up to the chroma subsampling */
+  x_sub = (1 << GST_VIDEO_FORMAT_INFO_W_SUB (info, 1)) - 1;
+  y_sub = (1 << GST_VIDEO_FORMAT_INFO_H_SUB (info, 1)) - 1;
+  xpos = (xpos + x_sub) & ~x_sub;
+  ypos = (ypos + y_sub) & ~y_sub;
+
+  b_src_width = src_width;
+  b_src_height = src_height;
+
+  /* adjust src pointers for negative sizes */
+  if (xpos < 0) {
+    xoffset = -xpos;
+    b_src_width -= -xpos;
+    xpos = 0;
+  }
+  if (ypos < 0) {
+    yoffset = -ypos;
+    b_src_height -= -ypos;
+    ypos = 0;
+  }
+  /* If x or y offset are larger then the source it's outside of the picture */
+  if (xoffset >= src_width || yoffset >= src_height)
+    return;
+
+  /* adjust width/height if the src is bigger than dest */
+  if (xpos + b_src_width > dest_width)
+    b_src_width = dest_width - xpos;
+  if (ypos + b_src_height > dest_height)
+    b_src_height = dest_height - ypos;
+  if (b_src_width <= 0 || b_src_height <= 0)
+    return;
+
+  b_alpha = CLAMP ((gint) (src_alpha * (1 << ALPHA_U16_SHIFT)), 0,
+      1 << ALPHA_U16_SHIFT);
+
+  for (plane = 0; plane < GST_VIDEO_FRAME_N_PLANES (srcframe); plane++) {
+    const guint8 *b_src;
+    guint8 *b_dest;
+    gint src_stride, dest_stride, pstride, width, height, i;
+
+    for (comp = 0; GST_VIDEO_FORMAT_INFO_PLANE (info, comp) != plane; comp++);
+
+    src_stride = GST_VIDEO_FRAME_PLANE_STRIDE (srcframe, plane);
+    dest_stride = GST_VIDEO_FRAME_PLANE_STRIDE (destframe, plane);
+    pstride = GST_VIDEO_FORMAT_INFO_PSTRIDE (info, comp);
+
+    b_src = GST_VIDEO_FRAME_PLANE_DATA (srcframe, plane);
+    b_src += GST_VIDEO_FORMAT_INFO_SCALE_HEIGHT (info, comp, yoffset) *
+        src_stride + GST_VIDEO_FORMAT_INFO_SCALE_WIDTH (info, comp,
+        xoffset) * pstride;
+    b_dest = GST_VIDEO_FRAME_PLANE_DATA (destframe, plane);
+    b_dest += GST_VIDEO_FORMAT_INFO_SCALE_HEIGHT (info, comp, ypos) *
+        dest_stride + GST_VIDEO_FORMAT_INFO_SCALE_WIDTH (info, comp,
+        xpos) * pstride;
+
+    /* in bytes, UV of P010 are two samples per pixel */
+    width = GST_VIDEO_FORMAT_INFO_SCALE_WIDTH (info, comp, b_src_width) *
+        pstride;
+    height = GST_VIDEO_FORMAT_INFO_SCALE_HEIGHT (info, comp, b_src_height);
+
+    if (mode == COMPOSITOR_BLEND_MODE_ADDITIVE) {
+      _add_loop_u16 (b_dest, dest_stride, b_src, src_stride, b_alpha,
+          width / 2, height);
+    } else if (G_UNLIKELY (src_alpha == 1.0)) {
+      /* If it's completely opaque, we do a fast copy */
+      for (i = 0; i < height; i++) {
+        memcpy (b_dest, b_src, width);
+        b_src += src_stride;
+        b_dest += dest_stride;
+      }
+    } else {
+      _blend_loop_u16 (b_dest, dest_stride, b_src, src_stride, b_alpha,
+          width / 2, height);
+    }
+  }
+}
+
+static void
+fill_checker_planar_u16 (GstVideoFrame * frame)
+{
+  const GstVideoFormatInfo *info = frame->info.finfo;
+  static const gint tab[] = { 80, 160, 80, 160 };
+  guint16 val[4];
+  gint comp, i, j;
+
+  for (i = 0; i < 4; i++)
+    val[i] = _scale_yuv_u16 (info, 0, tab[i]);
+
+  for (comp = 0; comp < 3; comp++) {
+    guint8 *p = GST_VIDEO_FRAME_COMP_DATA (frame, comp);
+    gint width = GST_VIDEO_FRAME_COMP_WIDTH (frame, comp);
+    gint height = GST_VIDEO_FRAME_COMP_HEIGHT (frame, comp);
+    gint stride = GST_VIDEO_FRAME_COMP_STRIDE (frame, comp);
+    gint step = GST_VIDEO_FRAME_COMP_PSTRIDE (frame, comp) / 2;
+    guint16 chroma = _scale_yuv_u16 (info, comp, 128);
+
+    for (i = 0; i < height; i++) {
+      guint16 *d = (guint16 *) p;
+
+      if (comp == 0) {
+        for (j = 0; j < width; j++)
+          d[j] = val[((i & 0x8) >> 3) + ((j & 0x8) >> 3)];
+      } else {
+        for (j = 0; j < width; j++)
+          d[j * step] = chroma;
+      }
+      p += stride;
+    }
+  }
+}
+
+static void
+fill_color_planar_u16 (GstVideoFrame * frame, gint colY, gint colU, gint colV)
+{
+  const GstVideoFormatInfo *info = frame->info.finfo;
+  const gint col[] = { colY, colU, colV };
+  gint comp, i, j;
+
+  for (comp = 0; comp < 3; comp++) {
+    guint8 *p = GST_VIDEO_FRAME_COMP_DATA (frame, comp);
+    gint width = GST_VIDEO_FRAME_COMP_WIDTH (frame, comp);
+    gint height = GST_VIDEO_FRAME_COMP_HEIGHT (frame, comp);
+    gint stride = GST_VIDEO_FRAME_COMP_STRIDE (frame, comp);
+    gint step = GST_VIDEO_FRAME_COMP_PSTRIDE (frame, comp) / 2;
+    guint16 val = _scale_yuv_u16 (info, comp, col[comp]);
+
+    for (i = 0; i < height; i++) {
+      guint16 *d = (guint16 *) p;
+
+      for (j = 0; j < width; j++)
+        d[j * step] = val;
+      p += stride;
+    }
+  }
+}
+
+/* A64 is for AYUV64 and ARGB64, 16 bit alpha first and three 16 bit
+ * components in the native endianness. Alpha is in 16 bit fixed point,
+ * 0x10000 is opaque.
+ *
+ * The modes follow the 8 bit ORC programs: the additive mode mixes the
+ * components like the normal one, and sums up the alphas instead of
+ * compositing them. When blending the result is opaque in both modes */
+#define A64_BLEND(name, OVERLAY) \
+static void \
+name (GstVideoFrame * srcframe, gint xpos, gint ypos, \
+    gdouble src_alpha, GstVideoFrame * destframe, GstCompositorBlendMode mode) \
+{ \
+  guint s_alpha; \
+  gint src_stride, dest_stride; \
+  gint dest_width, dest_height; \
+  guint8 *src, *dest; \
+  gint src_width, src_height; \
+  gint i, j; \
+  \
+  src_width = GST_VIDEO_FRAME_WIDTH (srcframe); \
+  src_height = GST_VIDEO_FRAME_HEIGHT (srcframe); \
+  src = GST_VIDEO_FRAME_PLANE_DATA (srcframe, 0); \
+  src_stride = GST_VIDEO_FRAME_COMP_STRIDE (srcframe, 0); \
+  dest = GST_VIDEO_FRAME_PLANE_DATA (destframe, 0); \
+  dest_stride = GST_VIDEO_FRAME_COMP_STRIDE (destframe, 0); \
+  dest_width = GST_VIDEO_FRAME_COMP_WIDTH (destframe, 0); \
+  dest_height = GST_VIDEO_FRAME_COMP_HEIGHT (destframe, 0); \
+  \
+  s_alpha = CLAMP ((gint) (src_alpha * 65536), 0, 65536); \
+  \
+  /* If it's completely transparent... we just return */ \
+  if (G_UNLIKELY (s_alpha == 0)) \
+    return; \
+  \
+  /* adjust src pointers for negative sizes */ \
+  if (xpos < 0) { \
+    src += -xpos * 8; \
+    src_width -= -xpos; \
+    xpos = 0; \
+  } \
+  if (ypos < 0) { \
+    src += -ypos * src_stride; \
+    src_height -= -ypos; \
+    ypos = 0; \
+  } \
+  /* adjust width/height if the src is bigger than dest */ \
+  if (xpos + src_width > dest_width) { \
+    src_width = dest_width - xpos; \
+  } \
+  if (ypos + src_height > dest_height) { \
+    src_height = dest_height - ypos; \
+  } \
+  if (src_width <= 0 || src_height <= 0) \
+    return; \
+  \
+  dest = dest + 8 * xpos + (ypos * dest_stride); \
+  \
+  for (i = 0; i < src_height; i++) { \
+    const guint16 *s = (const guint16 *) src; \
+    guint16 *d = (guint16 *) dest; \
+    \
+    for (j = 0; j < src_width * 4; j += 4) { \
+      guint32 a = (s[j] * s_alpha) >> 16; \
+      \
+      a += a >> 15; \
+      if (!OVERLAY) { \
+        d[j] = 0xffff; \
+        d[j + 1] = (d[j + 1] * (65536 - a) + s[j + 1] * a) >> 16; \
+        d[j + 2] = (d[j + 2] * (65536 - a) + s[j + 2] * a) >> 16; \
+        d[j + 3] = (d[j + 3] * (65536 - a) + s[j + 3] * a) >> 16; \
+      } else { \
+        guint32 da = d[j] + (d[j] >> 15); \
+        guint32 out_a; \
+        \
+        /* dest alpha left after blending the source on top */ \
+        da = (da * (65536 - a)) >> 16; \
+        out_a = a + da; \
+        if (out_a > 0) { \
+          d[j + 1] = (s[j + 1] * a + d[j + 1] * da) / out_a; \
+          d[j + 2] = (s[j + 2] * a + d[j + 2] * da) / out_a; \
+          d[j + 3] = (s[j + 3] * a + d[j + 3] * da) / out_a; \
+        } \
+        if (mode == COMPOSITOR_BLEND_MODE_ADDITIVE) \
+          out_a = d[j] + a; \
+        d[j] = MIN (out_a, 0xffff); \
+      } \
+    } \
+    src += src_stride; \
+    dest += dest_stride; \
+  } \
+}
+
+A64_BLEND (blend_a64, FALSE);
+A64_BLEND (overlay_a64, TRUE);
+
+#define A64_CHECKER(name, RGB) \
+static void \
+fill_checker_##name (GstVideoFrame * frame) \
+{ \
+  static const gint tab[] = { 80, 160, 80, 160 }; \
+  gint width, height, stride; \
+  guint8 *dest; \
+  gint i, j; \
+  \
+  dest = GST_VIDEO_FRAME_PLANE_DATA (frame, 0); \
+  width = GST_VIDEO_FRAME_COMP_WIDTH (frame, 0); \
+  height = GST_VIDEO_FRAME_COMP_HEIGHT (frame, 0); \
+  stride = GST_VIDEO_FRAME_COMP_STRIDE (frame, 0); \
+  \
+  for (i = 0; i < height; i++) { \
+    guint16 *d = (guint16 *) dest; \
+    \
+    for (j = 0; j < width; j++) { \
+      gint val = tab[((i & 0x8) >> 3) + ((j & 0x8) >> 3)]; \
+      \
+      d[0] = 0xffff; \
+      if (RGB) { \
+        d[1] = d[2] = d[3] = val * 257; \
+      } else { \
+        d[1] = val << 8; \
+        d[2] = d[3] = 128 << 8; \
+      } \
+      d += 4; \
+    } \
+    dest += stride; \
+  } \
+}
+
+A64_CHECKER (argb64, TRUE);
+A64_CHECKER (ayuv64, FALSE);
+
+#define A64_COLOR(name, RGB) \
+static void \
+fill_color_##name (GstVideoFrame * frame, gint Y, gint U, gint V) \
+{ \
+  gint width, height, stride; \
+  guint16 c1, c2, c3; \
+  guint8 *dest; \
+  gint i, j; \
+  \
+  dest = GST_VIDEO_FRAME_PLANE_DATA (frame, 0); \
+  width = GST_VIDEO_FRAME_COMP_WIDTH (frame, 0); \
+  height = GST_VIDEO_FRAME_COMP_HEIGHT (frame, 0); \
+  stride = GST_VIDEO_FRAME_COMP_STRIDE (frame, 0); \
+  \
+  if (RGB) { \
+    c1 = (gint) YUV_TO_R (Y, U, V) * 257; \
+    c2 = (gint) YUV_TO_G (Y, U, V) * 257; \
+    c3 = (gint) YUV_TO_B (Y, U, V) * 257; \
+  } else { \
+    c1 = Y << 8; \
+    c2 = U << 8; \
+    c3 = V << 8; \
+  } \
+  \
+  for (i = 0; i < height; i++) { \
+    guint16 *d = (guint16 *) dest; \
+    \
+    for (j = 0; j < width * 4; j += 4) { \
+      d[j] = 0xffff; \
+      d[j + 1] = c1; \
+      d[j + 2] = c2; \
+      d[j + 3] = c3; \
+    } \
+    dest += stride; \
+  } \
+}
+
+A64_COLOR (argb64, TRUE);
+A64_COLOR (ayuv64, FALSE);
+
+/* Weighted mixing of several inputs, for crossfades of any number of pads.
+ * Every output row is written once, after the inputs covering it were
+ * summed up in per row accumulators. */
+
+/* Weights in 12 bit fixed point, the sums of products with 8 bit samples of
+ * a few thousand inputs then still fit in 32 bits */
+#define MIX_SHIFT 12
+#define MIX_ONE (1 << MIX_SHIFT)
+
+/* Where one component of an input lands on the output */
+typedef struct
+{
+  const guint8 *data;
+  gint stride, pstride;
+  gint x, y, width, height;
+  guint weight;
+} MixRect;
+
+/* Fills one #MixRect per input for component @comp of @destframe, with
+ * positions aligned to the subsampling of the format */
+static void
+_mix_rects (const GstCompositorMixInput * inputs, guint n_inputs,
+    GstVideoFrame * destframe, gint comp, MixRect * rects)
+{
+  const GstVideoFormatInfo *finfo = destframe->info.finfo;
+  gint x_align = 1, y_align = 1;
+  gint w_sub, h_sub;
+  guint i, c;
+
+  for (c = 0; c < GST_VIDEO_FRAME_N_COMPONENTS (destframe); c++) {
+    x_align = MAX (x_align, 1 << GST_VIDEO_FORMAT_INFO_W_SUB (finfo, c));
+    y_align = MAX (y_align, 1 << GST_VIDEO_FORMAT_INFO_H_SUB (finfo, c));
+  }
+  w_sub = 1 << GST_VIDEO_FORMAT_INFO_W_SUB (finfo, comp);
+  h_sub = 1 << GST_VIDEO_FORMAT_INFO_H_SUB (finfo, comp);
+
+  for (i = 0; i < n_inputs; i++) {
+    GstVideoFrame *frame = inputs[i].frame;
+
+    rects[i].data = GST_VIDEO_FRAME_COMP_DATA (frame, comp);
+    rects[i].stride = GST_VIDEO_FRAME_COMP_STRIDE (frame, comp);
+    rects[i].pstride = GST_VIDEO_FRAME_COMP_PSTRIDE (frame, comp);
+    /* rounding up like the blend functions, also for negative positions */
+    rects[i].x = ((inputs[i].xpos + x_align - 1) & ~(x_align - 1)) / w_sub;
+    rects[i].y = ((inputs[i].ypos + y_align - 1) & ~(y_align - 1)) / h_sub;
+    rects[i].width = GST_VIDEO_FRAME_COMP_WIDTH (frame, comp);
+    rects[i].height = GST_VIDEO_FRAME_COMP_HEIGHT (frame, comp);
+    rects[i].weight = CLAMP ((gint) (inputs[i].weight * MIX_ONE + 0.5), 0,
+        MIX_ONE);
+  }
+}
+
+/* Clips @rect to row @y of a component @width wide. Returns the first and
+ * last + 1 output columns, and the source data of the first one. */
+static inline gboolean
+_mix_rect_row (const MixRect * rect, gint y, gint width, gint * x0, gint * x1,
+    const guint8 ** src)
+{
+  if (rect->weight == 0 || y < rect->y || y >= rect->y + rect->height)
+    return FALSE;
+
+  *x0 = MAX (rect->x, 0);
+  *x1 = MIN (rect->x + rect->width, width);
+  if (*x0 >= *x1)
+    return FALSE;
+
+  *src = rect->data + (y - rect->y) * rect->stride +
+      (*x0 - rect->x) * rect->pstride;
+
+  return TRUE;
+}
+
+/* Grows the cleared span [@start, @end) of the accumulators to [@x0, @x1),
+ * clearing what was not part of it yet */
+static inline void
+_mix_span_grow (guint32 * acc, gint n_acc, gint * start, gint * end, gint x0,
+    gint x1)
+{
+  if (*start >= *end) {
+    memset (acc + x0 * n_acc, 0, (x1 - x0) * n_acc * sizeof (guint32));
+    *start = x0;
+    *end = x1;
+    return;
+  }
+
+  if (x0 < *start) {
+    memset (acc + x0 * n_acc, 0, (*start - x0) * n_acc * sizeof (guint32));
+    *start = x0;
+  }
+  if (x1 > *end) {
+    memset (acc + *end * n_acc, 0, (x1 - *end) * n_acc * sizeof (guint32));
+    *end = x1;
+  }
+}
+
+/* All formats with 8 bits per component and without alpha, one component
+ * at a time */
+static void
+mix_u8 (const GstCompositorMixInput * inputs, guint n_inputs,
+    GstVideoFrame * destframe, gboolean overlay)
+{
+  MixRect *rects;
+  guint32 *acc;
+  gint c, x, y;
+  guint i;
+
+  rects = g_new (MixRect, n_inputs);
+  /* sum of the weighted samples and sum of the weights for each column */
+  acc = g_new (guint32, 2 * GST_VIDEO_FRAME_COMP_WIDTH (destframe, 0));
+
+  for (c = 0; c < GST_VIDEO_FRAME_N_COMPONENTS (destframe); c++) {
+    guint8 *dest = GST_VIDEO_FRAME_COMP_DATA (destframe, c);
+    gint dest_stride = GST_VIDEO_FRAME_COMP_STRIDE (destframe, c);
+    gint dest_pstride = GST_VIDEO_FRAME_COMP_PSTRIDE (destframe, c);
+    gint width = GST_VIDEO_FRAME_COMP_WIDTH (destframe, c);
+    gint height = GST_VIDEO_FRAME_COMP_HEIGHT (destframe, c);
+
+    _mix_rects (inputs, n_inputs, destframe, c, rects);
+
+    for (y = 0; y < height; y++) {
+      gint start = 0, end = 0;
+      guint8 *d;
+
+      for (i = 0; i < n_inputs; i++) {
+        const guint8 *s;
+        gint x0, x1, pstride = rects[i].pstride;
+        guint w = rects[i].weight;
+
+        if (!_mix_rect_row (&rects[i], y, width, &x0, &x1, &s))
+          continue;
+
+        _mix_span_grow (acc, 2, &start, &end, x0, x1);
+        for (x = x0; x < x1; x++, s += pstride) {
+          acc[2 * x] += w * s[0];
+          acc[2 * x + 1] += w;
+        }
+      }
+
+      d = dest + y * dest_stride + start * dest_pstride;
+      for (x = start; x < end; x++, d += dest_pstride) {
+        guint sum = acc[2 * x], weight = acc[2 * x + 1];
+
+        /* the output shows through where the weights do not add up to 1 */
+        if (weight <= MIX_ONE)
+          *d = (sum + *d * (MIX_ONE - weight) + MIX_ONE / 2) >> MIX_SHIFT;
+        else
+          *d = (sum + weight / 2) / weight;
+      }
+    }
+  }
+
+  g_free (acc);
+  g_free (rects);
+}
+
+/* A32 is for AYUV, ARGB, ABGR, BGRA and RGBA, only the position of alpha
+ * matters. The colors are summed premultiplied with their alpha, the sum is
+ * then blended over the output, or overlaid to keep it transparent. */
+static inline void
+_mix_a32 (const GstCompositorMixInput * inputs, guint n_inputs,
+    GstVideoFrame * destframe, gboolean overlay, gint A, gint C1, gint C2,
+    gint C3)
+{
+  MixRect *rects;
+  guint32 *acc;
+  guint8 *dest;
+  gint dest_stride, width, height;
+  gint x, y;
+  guint i;
+
+  rects = g_new (MixRect, n_inputs);
+  /* sum of the alphas and of the three premultiplied colors per column */
+  acc = g_new (guint32, 4 * GST_VIDEO_FRAME_WIDTH (destframe));
+
+  dest = GST_VIDEO_FRAME_PLANE_DATA (destframe, 0);
+  dest_stride = GST_VIDEO_FRAME_PLANE_STRIDE (destframe, 0);
+  width = GST_VIDEO_FRAME_WIDTH (destframe);
+  height = GST_VIDEO_FRAME_HEIGHT (destframe);
+
+  _mix_rects (inputs, n_inputs, destframe, 0, rects);
+  /* whole pixels, not only the first component */
+  for (i = 0; i < n_inputs; i++)
+    rects[i].data = GST_VIDEO_FRAME_PLANE_DATA (inputs[i].frame, 0);
+
+  for (y = 0; y < height; y++) {
+    gint start = 0, end = 0;
+    guint8 *d;
+
+    for (i = 0; i < n_inputs; i++) {
+      const guint8 *s;
+      gint x0, x1;
+      guint w = rects[i].weight;
+
+      if (!_mix_rect_row (&rects[i], y, width, &x0, &x1, &s))
+        continue;
+
+      _mix_span_grow (acc, 4, &start, &end, x0, x1);
+      for (x = x0; x < x1; x++, s += 4) {
+        guint a = (w * s[A] + 127) / 255;
+
+        acc[4 * x] += a;
+        acc[4 * x + 1] += a * s[C1];
+        acc[4 * x + 2] += a * s[C2];
+        acc[4 * x + 3] += a * s[C3];
+      }
+    }
+
+    d = dest + y * dest_stride + start * 4;
+    for (x = start; x < end; x++, d += 4) {
+      guint a = acc[4 * x];
+      guint c1 = acc[4 * x + 1], c2 = acc[4 * x + 2], c3 = acc[4 * x + 3];
+
+      /* more than opaque, scale the colors down to an alpha of 1 */
+      if (a > MIX_ONE) {
+        c1 = ((guint64) c1 << MIX_SHIFT) / a;
+        c2 = ((guint64) c2 << MIX_SHIFT) / a;
+        c3 = ((guint64) c3 << MIX_SHIFT) / a;
+        a = MIX_ONE;
+      }
+
+      if (!overlay) {
+        d[C1] = (c1 + d[C1] * (MIX_ONE - a) + MIX_ONE / 2) >> MIX_SHIFT;
+        d[C2] = (c2 + d[C2] * (MIX_ONE - a) + MIX_ONE / 2) >> MIX_SHIFT;
+        d[C3] = (c3 + d[C3] * (MIX_ONE - a) + MIX_ONE / 2) >> MIX_SHIFT;
+        d[A] = 0xff;
+      } else {
+        /* what remains visible of the output */
+        guint da = d[A] * (MIX_ONE - a) / 255;
+        guint oa = a + da;
+
+        if (oa == 0)
+          continue;
+
+        d[C1] = (c1 + d[C1] * da + oa / 2) / oa;
+        d[C2] = (c2 + d[C2] * da + oa / 2) / oa;
+        d[C3] = (c3 + d[C3] * da + oa / 2) / oa;
+        d[A] = (oa * 255 + MIX_ONE / 2) >> MIX_SHIFT;
+      }
+    }
+  }
+
+  g_free (acc);
+  g_free (rects);
+}
+
+#define MIX_A32(name, A, C1, C2, C3) \
+static void \
+mix_##name (const GstCompositorMixInput * inputs, guint n_inputs, \
+    GstVideoFrame * destframe, gboolean overlay) \
+{ \
+  _mix_a32 (inputs, n_inputs, destframe, overlay, A, C1, C2, C3); \
+}
+
+MIX_A32 (argb, 0, 1, 2, 3);
+MIX_A32 (bgra, 3, 2, 1, 0);
+
 /* Init function */
 BlendFunction gst_compositor_blend_argb;
 BlendFunction gst_compositor_blend_bgra;
@@ -983,6 +1643,13 @@ BlendFunction gst_compositor_blend_rgbx;
 /* BGRx, xRGB, xBGR are equal to RGBx */
 BlendFunction gst_compositor_blend_yuy2;
 /* YVYU and UYVY are equal to YUY2 */
+BlendFunction gst_compositor_blend_planar_u16;
+BlendFunction gst_compositor_blend_a64;
+BlendFunction gst_compositor_overlay_a64;
+
+MixFunction gst_compositor_mix_argb;
+MixFunction gst_compositor_mix_bgra;
+MixFunction gst_compositor_mix_u8;
 
 FillCheckerFunction gst_compositor_fill_checker_argb;
 FillCheckerFunction gst_compositor_fill_checker_bgra;
@@ -1002,6 +1669,9 @@ FillCheckerFunction gst_compositor_fill_checker_xrgb;
 FillCheckerFunction gst_compositor_fill_checker_yuy2;
 /* YVYU is equal to YUY2 */
 FillCheckerFunction gst_compositor_fill_checker_uyvy;
+FillCheckerFunction gst_compositor_fill_checker_planar_u16;
+FillCheckerFunction gst_compositor_fill_checker_argb64;
+FillCheckerFunction gst_compositor_fill_checker_ayuv64;
 
 FillColorFunction gst_compositor_fill_color_argb;
 FillColorFunction gst_compositor_fill_color_bgra;
@@ -1024,6 +1694,9 @@ FillColorFunction gst_compositor_fill_color_bgrx;
 FillColorFunction gst_compositor_fill_color_yuy2;
 FillColorFunction gst_compositor_fill_color_yvyu;
 FillColorFunction gst_compositor_fill_color_uyvy;
+FillColorFunction gst_compositor_fill_color_planar_u16;
+FillColorFunction gst_compositor_fill_color_argb64;
+FillColorFunction gst_compositor_fill_color_ayuv64;
 
 void
 gst_compositor_init_blend (void)
@@ -1044,6 +1717,13 @@ gst_compositor_init_blend (void)
   gst_compositor_blend_rgb = GST_DEBUG_FUNCPTR (blend_rgb);
   gst_compositor_blend_xrgb = GST_DEBUG_FUNCPTR (blend_xrgb);
   gst_compositor_blend_yuy2 = GST_DEBUG_FUNCPTR (blend_yuy2);
+  gst_compositor_blend_planar_u16 = GST_DEBUG_FUNCPTR (blend_planar_u16);
+  gst_compositor_blend_a64 = GST_DEBUG_FUNCPTR (blend_a64);
+  gst_compositor_overlay_a64 = GST_DEBUG_FUNCPTR (overlay_a64);
+
+  gst_compositor_mix_argb = GST_DEBUG_FUNCPTR (mix_argb);
+  gst_compositor_mix_bgra = GST_DEBUG_FUNCPTR (mix_bgra);
+  gst_compositor_mix_u8 = GST_DEBUG_FUNCPTR (mix_u8);
 
   gst_compositor_fill_checker_argb = GST_DEBUG_FUNCPTR (fill_checker_argb_c);
   gst_compositor_fill_checker_bgra = GST_DEBUG_FUNCPTR (fill_checker_bgra_c);
@@ -1058,6 +1738,10 @@ gst_compositor_init_blend (void)
   gst_compositor_fill_checker_xrgb = GST_DEBUG_FUNCPTR (fill_checker_xrgb_c);
   gst_compositor_fill_checker_yuy2 = GST_DEBUG_FUNCPTR (fill_checker_yuy2_c);
   gst_compositor_fill_checker_uyvy = GST_DEBUG_FUNCPTR (fill_checker_uyvy_c);
+  gst_compositor_fill_checker_planar_u16 =
+      GST_DEBUG_FUNCPTR (fill_checker_planar_u16);
+  gst_compositor_fill_checker_argb64 = GST_DEBUG_FUNCPTR (fill_checker_argb64);
+  gst_compositor_fill_checker_ayuv64 = GST_DEBUG_FUNCPTR (fill_checker_ayuv64);
 
   gst_compositor_fill_color_argb = GST_DEBUG_FUNCPTR (fill_color_argb);
   gst_compositor_fill_color_bgra = GST_DEBUG_FUNCPTR (fill_color_bgra);
@@ -1079,4 +1763,8 @@ gst_compositor_init_blend (void)
   gst_compositor_fill_color_yuy2 = GST_DEBUG_FUNCPTR (fill_color_yuy2);
   gst_compositor_fill_color_yvyu = GST_DEBUG_FUNCPTR (fill_color_yvyu);
   gst_compositor_fill_color_uyvy = GST_DEBUG_FUNCPTR (fill_color_uyvy);
+  gst_compositor_fill_color_planar_u16 =
+      GST_DEBUG_FUNCPTR (fill_color_planar_u16);
+  gst_compositor_fill_color_argb64 = GST_DEBUG_FUNCPTR (fill_color_argb64);
+  gst_compositor_fill_color_ayuv64 = GST_DEBUG_FUNCPTR (fill_color_ayuv64);
 }
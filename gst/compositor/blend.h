@@ -38,6 +38,26 @@ typedef enum
 
 typedef void (*BlendFunction) (GstVideoFrame *srcframe, gint xpos, gint ypos, gdouble src_alpha, GstVideoFrame * destframe,
     GstCompositorBlendMode mode);
+/**
+ * GstCompositorMixInput:
+ * @frame: the input frame, in the format of the output
+ * @xpos: the horizontal position of @frame on the output
+ * @ypos: the vertical position of @frame on the output
+ * @weight: the share of @frame in the mix, from 0.0 to 1.0
+ *
+ * One of the inputs of a #MixFunction.
+ */
+typedef struct
+{
+  GstVideoFrame *frame;
+  gint xpos, ypos;
+  gdouble weight;
+} GstCompositorMixInput;
+
+/* Blends the weighted sum of @inputs on @destframe in one pass, or overlays
+ * it if @overlay is TRUE to keep the transparency of @destframe */
+typedef void (*MixFunction) (const GstCompositorMixInput * inputs, guint n_inputs,
+    GstVideoFrame * destframe, gboolean overlay);
 typedef void (*FillCheckerFunction) (GstVideoFrame * frame);
 typedef void (*FillColorFunction) (GstVideoFrame * frame, gint c1, gint c2, gint c3);
 
@@ -73,6 +93,17 @@ extern BlendFunction gst_compositor_blend_rgbx;
 extern BlendFunction gst_compositor_blend_yuy2;
 #define gst_compositor_blend_uyvy gst_compositor_blend_yuy2;
 #define gst_compositor_blend_yvyu gst_compositor_blend_yuy2;
+extern BlendFunction gst_compositor_blend_planar_u16;
+extern BlendFunction gst_compositor_blend_a64;
+extern BlendFunction gst_compositor_overlay_a64;
+
+extern MixFunction gst_compositor_mix_argb;
+extern MixFunction gst_compositor_mix_bgra;
+#define gst_compositor_mix_ayuv gst_compositor_mix_argb
+#define gst_compositor_mix_abgr gst_compositor_mix_argb
+#define gst_compositor_mix_rgba gst_compositor_mix_bgra
+/* all formats without alpha and with 8 bits per component */
+extern MixFunction gst_compositor_mix_u8;
 
 extern FillCheckerFunction gst_compositor_fill_checker_argb;
 #define gst_compositor_fill_checker_abgr gst_compositor_fill_checker_argb
@@ -95,6 +126,9 @@ extern FillCheckerFunction gst_compositor_fill_checker_rgbx;
 extern FillCheckerFunction gst_compositor_fill_checker_yuy2;
 #define gst_compositor_fill_checker_yvyu gst_compositor_fill_checker_yuy2;
 extern FillCheckerFunction gst_compositor_fill_checker_uyvy;
+extern FillCheckerFunction gst_compositor_fill_checker_planar_u16;
+extern FillCheckerFunction gst_compositor_fill_checker_argb64;
+extern FillCheckerFunction gst_compositor_fill_checker_ayuv64;
 
 extern FillColorFunction gst_compositor_fill_color_argb;
 extern FillColorFunction gst_compositor_fill_color_abgr;
@@ -117,6 +151,9 @@ extern FillColorFunction gst_compositor_fill_color_bgrx;
 extern FillColorFunction gst_compositor_fill_color_yuy2;
 extern FillColorFunction gst_compositor_fill_color_yvyu;
 extern FillColorFunction gst_compositor_fill_color_uyvy;
+extern FillColorFunction gst_compositor_fill_color_planar_u16;
+extern FillColorFunction gst_compositor_fill_color_argb64;
+extern FillColorFunction gst_compositor_fill_color_ayuv64;
 
 void gst_compositor_init_blend (void);
 
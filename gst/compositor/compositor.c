@@ -42,6 +42,42 @@
  *   is a simple copy when fully-transparent (0.0) and fully-opaque (1.0). (#gdouble)
  * * "zorder": The z-order position of the picture in the composition (#guint)
  *
+ * When the output format has no alpha channel, the parts of the background
+ * and of the pictures that are hidden behind pictures with an alpha of 1.0
+ * are not drawn.
+ *
+ * When the #GstCompositor:n-threads property allows more than one thread,
+ * the output frame is split into horizontal stripes that are filled and
+ * blended in parallel. The result is the same as when blending in a single
+ * thread. Pads that are being crossfaded are always blended in the
+ * aggregating thread.
+ *
+ * Pictures that did not change since the previous output, in neither their
+ * content nor their position, size, alpha or z-order, are not blended again.
+ * Only the parts of the output where something changed are drawn, the rest
+ * is copied from the previous output.
+ *
+ * When downstream does not provide buffers from its own kind of memory,
+ * compositor recycles its output memories itself. Writing to them
+ * downstream copies them, so that the parts that only show the background
+ * do not need to be filled again when they are reused.
+ *
+ * Input buffers are converted to each size and format only once, also when
+ * they are fed into several pads or several compositors, or kept for more
+ * than one output.
+ *
+ * When a single picture covers the whole output with an alpha of 1.0, needs
+ * no conversion and nothing is visible above it, its buffers are pushed
+ * without copying them. Compositing resumes as soon as another picture
+ * becomes visible.
+ *
+ * A pad with a #GstCompositorPad:crossfade-ratio is mixed with the following
+ * pad in z-order, which gets a share of 1.0 minus the ratio. If that pad has
+ * a crossfade ratio as well, the mix is crossfaded with the pad after it, so
+ * that any number of pads can be dissolved into each other. For the formats
+ * with 8 bits per component, all pads of such a crossfade are mixed in a
+ * single pass over the output.
+ *
  * ## Sample pipelines
  * |[
  * gst-launch-1.0 \
@@ -94,6 +130,7 @@
 
 #include "compositor.h"
 #include "compositorpad.h"
+#include "convertcache.h"
 
 #ifdef DISABLE_ORC
 #define orc_memset memset
@@ -104,9 +141,15 @@
 GST_DEBUG_CATEGORY_STATIC (gst_compositor_debug);
 #define GST_CAT_DEFAULT gst_compositor_debug
 
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+#define FORMATS_U16 "I420_10LE, I422_10LE, Y444_10LE, P010_10LE"
+#else
+#define FORMATS_U16 "I420_10BE, I422_10BE, Y444_10BE, P010_10BE"
+#endif
+
 #define FORMATS " { AYUV, BGRA, ARGB, RGBA, ABGR, Y444, Y42B, YUY2, UYVY, "\
                 "   YVYU, I420, YV12, NV12, NV21, Y41B, RGB, BGR, xRGB, xBGR, "\
-                "   RGBx, BGRx } "
+                "   RGBx, BGRx, AYUV64, ARGB64, " FORMATS_U16 " } "
 
 static GstStaticPadTemplate src_factory = GST_STATIC_PAD_TEMPLATE ("src",
     GST_PAD_SRC,
@@ -371,6 +414,82 @@ clamp_rectangle (gint x, gint y, gint w, gint h, gint outer_width,
   return clamped;
 }
 
+/* Checks for each pad whether its frame is obscured by a higher-zorder
+ * frame, so that it is neither converted nor blended. This looks at the
+ * other pads and is done in the aggregating thread before the frames are
+ * prepared, which can happen in parallel.
+ * TODO: Also skip a frame if it's obscured by a combination of
+ * higher-zorder frames
+ * WITH GST_OBJECT_LOCK !! */
+static void
+gst_compositor_update_obscured (GstCompositor * self)
+{
+  GstVideoAggregator *vagg = GST_VIDEO_AGGREGATOR (self);
+  gint out_par_n = GST_VIDEO_INFO_PAR_N (&vagg->info);
+  gint out_par_d = GST_VIDEO_INFO_PAR_D (&vagg->info);
+  GList *l, *l2;
+
+  for (l = GST_ELEMENT (self)->sinkpads; l; l = l->next) {
+    GstVideoAggregatorPad *pad = l->data;
+    GstCompositorPad *cpad = GST_COMPOSITOR_PAD (pad);
+    GstVideoRectangle frame_rect;
+    gint width, height;
+
+    cpad->obscured = FALSE;
+
+    if (pad->buffer == NULL || cpad->alpha == 0.0)
+      continue;
+
+    /* Check if we are crossfading the pad one way or another */
+    if ((l->prev && GST_COMPOSITOR_PAD (l->prev->data)->crossfade >= 0.0) ||
+        cpad->crossfade >= 0.0) {
+      GST_DEBUG_OBJECT (pad, "Is being crossfaded with previous pad");
+      continue;
+    }
+
+    _mixer_pad_get_output_size (self, cpad, out_par_n, out_par_d, &width,
+        &height);
+    frame_rect = clamp_rectangle (cpad->xpos, cpad->ypos, width, height,
+        GST_VIDEO_INFO_WIDTH (&vagg->info),
+        GST_VIDEO_INFO_HEIGHT (&vagg->info));
+    if (frame_rect.w == 0 || frame_rect.h == 0)
+      continue;
+
+    for (l2 = l->next; l2; l2 = l2->next) {
+      GstVideoRectangle frame2_rect;
+      GstVideoAggregatorPad *pad2 = l2->data;
+      GstCompositorPad *cpad2 = GST_COMPOSITOR_PAD (pad2);
+      gint pad2_width, pad2_height;
+
+      _mixer_pad_get_output_size (self, cpad2, out_par_n, out_par_d,
+          &pad2_width, &pad2_height);
+
+      /* We don't need to clamp the coords of the second rectangle */
+      frame2_rect.x = cpad2->xpos;
+      frame2_rect.y = cpad2->ypos;
+      /* This is effectively what set_info and the conversion code in
+       * prepare_frame do to calculate the desired width/height */
+      frame2_rect.w = pad2_width;
+      frame2_rect.h = pad2_height;
+
+      /* Check if there's a buffer to be aggregated, ensure it can't have an
+       * alpha channel, then check opacity and frame boundaries */
+      if (pad2->buffer && cpad2->alpha == 1.0 &&
+          !GST_VIDEO_INFO_HAS_ALPHA (&pad2->info) &&
+          is_rectangle_contained (frame_rect, frame2_rect)) {
+        cpad->obscured = TRUE;
+        GST_DEBUG_OBJECT (pad, "%ix%i@(%i,%i) obscured by %s %ix%i@(%i,%i) "
+            "in output of size %ix%i; skipping frame", frame_rect.w,
+            frame_rect.h, frame_rect.x, frame_rect.y, GST_PAD_NAME (pad2),
+            frame2_rect.w, frame2_rect.h, frame2_rect.x, frame2_rect.y,
+            GST_VIDEO_INFO_WIDTH (&vagg->info),
+            GST_VIDEO_INFO_HEIGHT (&vagg->info));
+        break;
+      }
+    }
+  }
+}
+
 static gboolean
 gst_compositor_pad_prepare_frame (GstVideoAggregatorPad * pad,
     GstVideoAggregator * vagg)
@@ -383,8 +502,6 @@ gst_compositor_pad_prepare_frame (GstVideoAggregatorPad * pad,
   GstVideoFrame *frame;
   static GstAllocationParams params = { 0, 15, 0, 0, };
   gint width, height;
-  gboolean frame_obscured = FALSE;
-  GList *l;
   /* The rectangle representing this frame, clamped to the video's boundaries.
    * Due to the clamping, this is different from the frame width/height above. */
   GstVideoRectangle frame_rect;
@@ -392,6 +509,10 @@ gst_compositor_pad_prepare_frame (GstVideoAggregatorPad * pad,
   if (!pad->buffer)
     return TRUE;
 
+  /* Nothing to convert, the output is the buffer of a single pad */
+  if (comp->passthrough)
+    return TRUE;
+
   /* There's three types of width/height here:
    * 1. GST_VIDEO_FRAME_WIDTH/HEIGHT:
    *     The frame width/height (same as pad->info.height/width;
@@ -487,55 +608,7 @@ gst_compositor_pad_prepare_frame (GstVideoAggregatorPad * pad,
     goto done;
   }
 
-  GST_OBJECT_LOCK (vagg);
-  /* Check if we are crossfading the pad one way or another */
-  l = g_list_find (GST_ELEMENT (vagg)->sinkpads, pad);
-  if ((l->prev && GST_COMPOSITOR_PAD (l->prev->data)->crossfade >= 0.0) ||
-      (GST_COMPOSITOR_PAD (pad)->crossfade >= 0.0)) {
-    GST_DEBUG_OBJECT (pad, "Is being crossfaded with previous pad");
-    l = NULL;
-  } else {
-    l = l->next;
-  }
-
-  /* Check if this frame is obscured by a higher-zorder frame
-   * TODO: Also skip a frame if it's obscured by a combination of
-   * higher-zorder frames */
-  for (; l; l = l->next) {
-    GstVideoRectangle frame2_rect;
-    GstVideoAggregatorPad *pad2 = l->data;
-    GstCompositorPad *cpad2 = GST_COMPOSITOR_PAD (pad2);
-    gint pad2_width, pad2_height;
-
-    _mixer_pad_get_output_size (comp, cpad2, GST_VIDEO_INFO_PAR_N (&vagg->info),
-        GST_VIDEO_INFO_PAR_D (&vagg->info), &pad2_width, &pad2_height);
-
-    /* We don't need to clamp the coords of the second rectangle */
-    frame2_rect.x = cpad2->xpos;
-    frame2_rect.y = cpad2->ypos;
-    /* This is effectively what set_info and the above conversion
-     * code do to calculate the desired width/height */
-    frame2_rect.w = pad2_width;
-    frame2_rect.h = pad2_height;
-
-    /* Check if there's a buffer to be aggregated, ensure it can't have an alpha
-     * channel, then check opacity and frame boundaries */
-    if (pad2->buffer && cpad2->alpha == 1.0 &&
-        !GST_VIDEO_INFO_HAS_ALPHA (&pad2->info) &&
-        is_rectangle_contained (frame_rect, frame2_rect)) {
-      frame_obscured = TRUE;
-      GST_DEBUG_OBJECT (pad, "%ix%i@(%i,%i) obscured by %s %ix%i@(%i,%i) "
-          "in output of size %ix%i; skipping frame", frame_rect.w, frame_rect.h,
-          frame_rect.x, frame_rect.y, GST_PAD_NAME (pad2), frame2_rect.w,
-          frame2_rect.h, frame2_rect.x, frame2_rect.y,
-          GST_VIDEO_INFO_WIDTH (&vagg->info),
-          GST_VIDEO_INFO_HEIGHT (&vagg->info));
-      break;
-    }
-  }
-  GST_OBJECT_UNLOCK (vagg);
-
-  if (frame_obscured) {
+  if (cpad->obscured) {
     converted_frame = NULL;
     goto done;
   }
@@ -552,6 +625,27 @@ gst_compositor_pad_prepare_frame (GstVideoAggregatorPad * pad,
 
     converted_frame = g_slice_new0 (GstVideoFrame);
 
+    /* Another pad or an earlier output may have converted this buffer to
+     * the same size and format already */
+    converted_buf = gst_compositor_convert_cache_acquire (pad->buffer,
+        &pad->info, &cpad->conversion_info);
+    if (converted_buf) {
+      gst_video_frame_unmap (frame);
+      g_slice_free (GstVideoFrame, frame);
+
+      if (!gst_video_frame_map (converted_frame, &(cpad->conversion_info),
+              converted_buf, GST_MAP_READ)) {
+        GST_WARNING_OBJECT (vagg, "Could not map converted frame");
+
+        g_slice_free (GstVideoFrame, converted_frame);
+        gst_buffer_unref (converted_buf);
+        return FALSE;
+      }
+
+      cpad->converted_buffer = converted_buf;
+      goto done;
+    }
+
     /* We wait until here to set the conversion infos, in case vagg->info changed */
     converted_size = GST_VIDEO_INFO_SIZE (&cpad->conversion_info);
     outsize = GST_VIDEO_INFO_SIZE (&vagg->info);
@@ -562,6 +656,9 @@ gst_compositor_pad_prepare_frame (GstVideoAggregatorPad * pad,
             converted_buf, GST_MAP_READWRITE)) {
       GST_WARNING_OBJECT (vagg, "Could not map converted frame");
 
+      gst_compositor_convert_cache_release (pad->buffer, &pad->info,
+          &cpad->conversion_info, NULL);
+      gst_buffer_unref (converted_buf);
       g_slice_free (GstVideoFrame, converted_frame);
       gst_video_frame_unmap (frame);
       g_slice_free (GstVideoFrame, frame);
@@ -569,6 +666,8 @@ gst_compositor_pad_prepare_frame (GstVideoAggregatorPad * pad,
     }
 
     gst_video_converter_frame (cpad->convert, frame, converted_frame);
+    gst_compositor_convert_cache_release (pad->buffer, &pad->info,
+        &cpad->conversion_info, converted_buf);
     cpad->converted_buffer = converted_buf;
     gst_video_frame_unmap (frame);
     g_slice_free (GstVideoFrame, frame);
@@ -609,6 +708,8 @@ gst_compositor_pad_finalize (GObject * object)
     gst_video_converter_free (pad->convert);
   pad->convert = NULL;
 
+  gst_buffer_replace (&pad->damage_buffer, NULL);
+
   G_OBJECT_CLASS (gst_compositor_pad_parent_class)->finalize (object);
 }
 
@@ -669,10 +770,12 @@ gst_compositor_pad_init (GstCompositorPad * compo_pad)
 
 /* GstCompositor */
 #define DEFAULT_BACKGROUND COMPOSITOR_BACKGROUND_CHECKER
+#define DEFAULT_N_THREADS 1
 enum
 {
   PROP_0,
   PROP_BACKGROUND,
+  PROP_N_THREADS,
 };
 
 #define GST_TYPE_COMPOSITOR_BACKGROUND (gst_compositor_background_get_type())
@@ -708,6 +811,11 @@ gst_compositor_get_property (GObject * object,
     case PROP_BACKGROUND:
       g_value_set_enum (value, self->background);
       break;
+    case PROP_N_THREADS:
+      GST_OBJECT_LOCK (self);
+      g_value_set_uint (value, self->n_threads);
+      GST_OBJECT_UNLOCK (self);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -722,7 +830,16 @@ gst_compositor_set_property (GObject * object,
 
   switch (prop_id) {
     case PROP_BACKGROUND:
+      GST_OBJECT_LOCK (self);
       self->background = g_value_get_enum (value);
+      self->cache_valid = FALSE;
+      self->output_cookie++;
+      GST_OBJECT_UNLOCK (self);
+      break;
+    case PROP_N_THREADS:
+      GST_OBJECT_LOCK (self);
+      self->n_threads = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (self);
       break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -742,6 +859,7 @@ set_functions (GstCompositor * self, GstVideoInfo * info)
   self->overlay = NULL;
   self->fill_checker = NULL;
   self->fill_color = NULL;
+  self->mix = NULL;
 
   switch (GST_VIDEO_INFO_FORMAT (info)) {
     case GST_VIDEO_FORMAT_AYUV:
@@ -749,6 +867,7 @@ set_functions (GstCompositor * self, GstVideoInfo * info)
       self->overlay = gst_compositor_overlay_ayuv;
       self->fill_checker = gst_compositor_fill_checker_ayuv;
       self->fill_color = gst_compositor_fill_color_ayuv;
+      self->mix = gst_compositor_mix_ayuv;
       ret = TRUE;
       break;
     case GST_VIDEO_FORMAT_ARGB:
@@ -756,6 +875,7 @@ set_functions (GstCompositor * self, GstVideoInfo * info)
       self->overlay = gst_compositor_overlay_argb;
       self->fill_checker = gst_compositor_fill_checker_argb;
       self->fill_color = gst_compositor_fill_color_argb;
+      self->mix = gst_compositor_mix_argb;
       ret = TRUE;
       break;
     case GST_VIDEO_FORMAT_BGRA:
@@ -763,6 +883,7 @@ set_functions (GstCompositor * self, GstVideoInfo * info)
       self->overlay = gst_compositor_overlay_bgra;
       self->fill_checker = gst_compositor_fill_checker_bgra;
       self->fill_color = gst_compositor_fill_color_bgra;
+      self->mix = gst_compositor_mix_bgra;
       ret = TRUE;
       break;
     case GST_VIDEO_FORMAT_ABGR:
@@ -770,6 +891,7 @@ set_functions (GstCompositor * self, GstVideoInfo * info)
       self->overlay = gst_compositor_overlay_abgr;
       self->fill_checker = gst_compositor_fill_checker_abgr;
       self->fill_color = gst_compositor_fill_color_abgr;
+      self->mix = gst_compositor_mix_abgr;
       ret = TRUE;
       break;
     case GST_VIDEO_FORMAT_RGBA:
@@ -777,6 +899,7 @@ set_functions (GstCompositor * self, GstVideoInfo * info)
       self->overlay = gst_compositor_overlay_rgba;
       self->fill_checker = gst_compositor_fill_checker_rgba;
       self->fill_color = gst_compositor_fill_color_rgba;
+      self->mix = gst_compositor_mix_rgba;
       ret = TRUE;
       break;
     case GST_VIDEO_FORMAT_Y444:
@@ -784,6 +907,7 @@ set_functions (GstCompositor * self, GstVideoInfo * info)
       self->overlay = self->blend;
       self->fill_checker = gst_compositor_fill_checker_y444;
       self->fill_color = gst_compositor_fill_color_y444;
+      self->mix = gst_compositor_mix_u8;
       ret = TRUE;
       break;
     case GST_VIDEO_FORMAT_Y42B:
@@ -791,6 +915,7 @@ set_functions (GstCompositor * self, GstVideoInfo * info)
       self->overlay = self->blend;
       self->fill_checker = gst_compositor_fill_checker_y42b;
       self->fill_color = gst_compositor_fill_color_y42b;
+      self->mix = gst_compositor_mix_u8;
       ret = TRUE;
       break;
     case GST_VIDEO_FORMAT_YUY2:
@@ -798,6 +923,7 @@ set_functions (GstCompositor * self, GstVideoInfo * info)
       self->overlay = self->blend;
       self->fill_checker = gst_compositor_fill_checker_yuy2;
       self->fill_color = gst_compositor_fill_color_yuy2;
+      self->mix = gst_compositor_mix_u8;
       ret = TRUE;
       break;
     case GST_VIDEO_FORMAT_UYVY:
@@ -805,6 +931,7 @@ set_functions (GstCompositor * self, GstVideoInfo * info)
       self->overlay = self->blend;
       self->fill_checker = gst_compositor_fill_checker_uyvy;
       self->fill_color = gst_compositor_fill_color_uyvy;
+      self->mix = gst_compositor_mix_u8;
       ret = TRUE;
       break;
     case GST_VIDEO_FORMAT_YVYU:
@@ -812,6 +939,7 @@ set_functions (GstCompositor * self, GstVideoInfo * info)
       self->overlay = self->blend;
       self->fill_checker = gst_compositor_fill_checker_yvyu;
       self->fill_color = gst_compositor_fill_color_yvyu;
+      self->mix = gst_compositor_mix_u8;
       ret = TRUE;
       break;
     case GST_VIDEO_FORMAT_I420:
@@ -819,6 +947,7 @@ set_functions (GstCompositor * self, GstVideoInfo * info)
       self->overlay = self->blend;
       self->fill_checker = gst_compositor_fill_checker_i420;
       self->fill_color = gst_compositor_fill_color_i420;
+      self->mix = gst_compositor_mix_u8;
       ret = TRUE;
       break;
     case GST_VIDEO_FORMAT_YV12:
@@ -826,6 +955,7 @@ set_functions (GstCompositor * self, GstVideoInfo * info)
       self->overlay = self->blend;
       self->fill_checker = gst_compositor_fill_checker_yv12;
       self->fill_color = gst_compositor_fill_color_yv12;
+      self->mix = gst_compositor_mix_u8;
       ret = TRUE;
       break;
     case GST_VIDEO_FORMAT_NV12:
@@ -833,6 +963,7 @@ set_functions (GstCompositor * self, GstVideoInfo * info)
       self->overlay = self->blend;
       self->fill_checker = gst_compositor_fill_checker_nv12;
       self->fill_color = gst_compositor_fill_color_nv12;
+      self->mix = gst_compositor_mix_u8;
       ret = TRUE;
       break;
     case GST_VIDEO_FORMAT_NV21:
@@ -840,6 +971,7 @@ set_functions (GstCompositor * self, GstVideoInfo * info)
       self->overlay = self->blend;
       self->fill_checker = gst_compositor_fill_checker_nv21;
       self->fill_color = gst_compositor_fill_color_nv21;
+      self->mix = gst_compositor_mix_u8;
       ret = TRUE;
       break;
     case GST_VIDEO_FORMAT_Y41B:
@@ -847,6 +979,7 @@ set_functions (GstCompositor * self, GstVideoInfo * info)
       self->overlay = self->blend;
       self->fill_checker = gst_compositor_fill_checker_y41b;
       self->fill_color = gst_compositor_fill_color_y41b;
+      self->mix = gst_compositor_mix_u8;
       ret = TRUE;
       break;
     case GST_VIDEO_FORMAT_RGB:
@@ -854,6 +987,7 @@ set_functions (GstCompositor * self, GstVideoInfo * info)
       self->overlay = self->blend;
       self->fill_checker = gst_compositor_fill_checker_rgb;
       self->fill_color = gst_compositor_fill_color_rgb;
+      self->mix = gst_compositor_mix_u8;
       ret = TRUE;
       break;
     case GST_VIDEO_FORMAT_BGR:
@@ -861,6 +995,7 @@ set_functions (GstCompositor * self, GstVideoInfo * info)
       self->overlay = self->blend;
       self->fill_checker = gst_compositor_fill_checker_bgr;
       self->fill_color = gst_compositor_fill_color_bgr;
+      self->mix = gst_compositor_mix_u8;
       ret = TRUE;
       break;
     case GST_VIDEO_FORMAT_xRGB:
@@ -868,6 +1003,7 @@ set_functions (GstCompositor * self, GstVideoInfo * info)
       self->overlay = self->blend;
       self->fill_checker = gst_compositor_fill_checker_xrgb;
       self->fill_color = gst_compositor_fill_color_xrgb;
+      self->mix = gst_compositor_mix_u8;
       ret = TRUE;
       break;
     case GST_VIDEO_FORMAT_xBGR:
@@ -875,6 +1011,7 @@ set_functions (GstCompositor * self, GstVideoInfo * info)
       self->overlay = self->blend;
       self->fill_checker = gst_compositor_fill_checker_xbgr;
       self->fill_color = gst_compositor_fill_color_xbgr;
+      self->mix = gst_compositor_mix_u8;
       ret = TRUE;
       break;
     case GST_VIDEO_FORMAT_RGBx:
@@ -882,6 +1019,7 @@ set_functions (GstCompositor * self, GstVideoInfo * info)
       self->overlay = self->blend;
       self->fill_checker = gst_compositor_fill_checker_rgbx;
       self->fill_color = gst_compositor_fill_color_rgbx;
+      self->mix = gst_compositor_mix_u8;
       ret = TRUE;
       break;
     case GST_VIDEO_FORMAT_BGRx:
@@ -889,6 +1027,38 @@ set_functions (GstCompositor * self, GstVideoInfo * info)
       self->overlay = self->blend;
       self->fill_checker = gst_compositor_fill_checker_bgrx;
       self->fill_color = gst_compositor_fill_color_bgrx;
+      self->mix = gst_compositor_mix_u8;
+      ret = TRUE;
+      break;
+    case GST_VIDEO_FORMAT_AYUV64:
+      self->blend = gst_compositor_blend_a64;
+      self->overlay = gst_compositor_overlay_a64;
+      self->fill_checker = gst_compositor_fill_checker_ayuv64;
+      self->fill_color = gst_compositor_fill_color_ayuv64;
+      ret = TRUE;
+      break;
+    case GST_VIDEO_FORMAT_ARGB64:
+      self->blend = gst_compositor_blend_a64;
+      self->overlay = gst_compositor_overlay_a64;
+      self->fill_checker = gst_compositor_fill_checker_argb64;
+      self->fill_color = gst_compositor_fill_color_argb64;
+      ret = TRUE;
+      break;
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+    case GST_VIDEO_FORMAT_I420_10LE:
+    case GST_VIDEO_FORMAT_I422_10LE:
+    case GST_VIDEO_FORMAT_Y444_10LE:
+    case GST_VIDEO_FORMAT_P010_10LE:
+#else
+    case GST_VIDEO_FORMAT_I420_10BE:
+    case GST_VIDEO_FORMAT_I422_10BE:
+    case GST_VIDEO_FORMAT_Y444_10BE:
+    case GST_VIDEO_FORMAT_P010_10BE:
+#endif
+      self->blend = gst_compositor_blend_planar_u16;
+      self->overlay = self->blend;
+      self->fill_checker = gst_compositor_fill_checker_planar_u16;
+      self->fill_color = gst_compositor_fill_color_planar_u16;
       ret = TRUE;
       break;
     default:
@@ -974,6 +1144,40 @@ _fixate_caps (GstAggregator * agg, GstCaps * caps)
   return ret;
 }
 
+/* WITH GST_OBJECT_LOCK !!
+ * Forgets how the previous output looked, the next one is drawn
+ * completely */
+static void
+gst_compositor_reset_damage (GstCompositor * self)
+{
+  GList *l;
+
+  self->cache_valid = FALSE;
+
+  for (l = GST_ELEMENT (self)->sinkpads; l; l = l->next)
+    gst_buffer_replace (&GST_COMPOSITOR_PAD (l->data)->damage_buffer, NULL);
+}
+
+/* Releases the output memories, the ones downstream still has become
+ * writable again */
+static void
+gst_compositor_clear_outputs (GstCompositor * self)
+{
+  guint i;
+
+  for (i = 0; i < self->n_outputs; i++) {
+    GstCompositorOutput *output = &self->outputs[i];
+
+    if (output->locked)
+      gst_memory_unlock (output->memory, GST_LOCK_FLAG_EXCLUSIVE);
+    gst_memory_unref (output->memory);
+    g_free (output->clean);
+  }
+
+  self->n_outputs = 0;
+  self->output = NULL;
+}
+
 static gboolean
 _negotiated_caps (GstAggregator * agg, GstCaps * caps)
 {
@@ -989,6 +1193,13 @@ _negotiated_caps (GstAggregator * agg, GstCaps * caps)
     return FALSE;
   }
 
+  /* the previous output has the old size and format */
+  GST_OBJECT_LOCK (agg);
+  gst_compositor_reset_damage (GST_COMPOSITOR (agg));
+  gst_buffer_replace (&GST_COMPOSITOR (agg)->cache, NULL);
+  gst_compositor_clear_outputs (GST_COMPOSITOR (agg));
+  GST_OBJECT_UNLOCK (agg);
+
   return GST_AGGREGATOR_CLASS (parent_class)->negotiated_src_caps (agg, caps);
 }
 
@@ -1110,42 +1321,878 @@ gst_compositor_crossfade_frames (GstCompositor * self, GstVideoFrame * outframe)
   return all_crossfading;
 }
 
-static GstFlowReturn
-gst_compositor_aggregate_frames (GstVideoAggregator * vagg, GstBuffer * outbuf)
+/* WITH GST_OBJECT_LOCK !!
+ * Blends all pads on @outframe, with each run of crossfaded pads mixed in a
+ * single pass with self->mix */
+static void
+gst_compositor_mix_frames (GstCompositor * self, GstVideoFrame * outframe,
+    BlendFunction composite)
 {
+  gboolean overlay = self->background == COMPOSITOR_BACKGROUND_TRANSPARENT;
+  GstCompositorMixInput *inputs;
   GList *l;
-  GstCompositor *self = GST_COMPOSITOR (vagg);
-  BlendFunction composite;
-  GstVideoFrame out_frame, *outframe;
 
-  if (!gst_video_frame_map (&out_frame, &vagg->info, outbuf, GST_MAP_WRITE)) {
-    GST_WARNING_OBJECT (vagg, "Could not map output buffer");
-    return GST_FLOW_ERROR;
+  inputs = g_new (GstCompositorMixInput,
+      g_list_length (GST_ELEMENT (self)->sinkpads));
+
+  for (l = GST_ELEMENT (self)->sinkpads; l; l = l->next) {
+    GstVideoAggregatorPad *pad = l->data;
+    GstCompositorPad *compo_pad = GST_COMPOSITOR_PAD (pad);
+    guint i, n_inputs = 0;
+    gdouble weight;
+
+    if (compo_pad->crossfade < 0.0) {
+      if (pad->aggregated_frame)
+        composite (pad->aggregated_frame, compo_pad->xpos, compo_pad->ypos,
+            compo_pad->alpha, outframe, COMPOSITOR_BLEND_MODE_NORMAL);
+      continue;
+    }
+
+    /* Each ratio splits the weights between the mix of the pads so far and
+     * the next pad. A pad without a frame is skipped like in the pairwise
+     * path: the pads before it just fade out, and the pads after it are
+     * mixed on their own */
+    weight = compo_pad->alpha;
+    for (;;) {
+      gdouble ratio = compo_pad->crossfade;
+
+      if (pad->aggregated_frame == NULL)
+        break;
+
+      inputs[n_inputs].frame = pad->aggregated_frame;
+      inputs[n_inputs].xpos = compo_pad->xpos;
+      inputs[n_inputs].ypos = compo_pad->ypos;
+      inputs[n_inputs].weight = weight;
+      n_inputs++;
+
+      if (ratio < 0.0)
+        break;
+
+      for (i = 0; i < n_inputs; i++)
+        inputs[i].weight *= ratio;
+
+      if (!l->next) {
+        GST_LOG_OBJECT (self, "Simply fading out as no following pad found");
+        break;
+      }
+
+      l = l->next;
+      pad = l->data;
+      compo_pad = GST_COMPOSITOR_PAD (pad);
+      weight = (1.0 - ratio) * compo_pad->alpha;
+    }
+
+    if (n_inputs > 0) {
+      GST_LOG_OBJECT (self, "Mixing %u crossfaded frames", n_inputs);
+      self->mix (inputs, n_inputs, outframe, overlay);
+    }
   }
 
-  outframe = &out_frame;
-  /* default to blending */
-  composite = self->blend;
-  /* TODO: If the frames to be composited completely obscure the background,
-   * don't bother drawing the background at all. */
-  switch (self->background) {
+  g_free (inputs);
+}
+
+/* Fills @frame with @background */
+static void
+gst_compositor_fill_background (GstCompositor * self,
+    GstCompositorBackground background, GstVideoFrame * frame)
+{
+  switch (background) {
     case COMPOSITOR_BACKGROUND_CHECKER:
-      self->fill_checker (outframe);
+      self->fill_checker (frame);
       break;
     case COMPOSITOR_BACKGROUND_BLACK:
-      self->fill_color (outframe, 16, 128, 128);
+      self->fill_color (frame, 16, 128, 128);
       break;
     case COMPOSITOR_BACKGROUND_WHITE:
-      self->fill_color (outframe, 240, 128, 128);
+      self->fill_color (frame, 240, 128, 128);
       break;
     case COMPOSITOR_BACKGROUND_TRANSPARENT:
-      gst_compositor_fill_transparent (self, outframe, NULL);
-      /* use overlay to keep background transparent */
-      composite = self->overlay;
+      gst_compositor_fill_transparent (self, frame, NULL);
       break;
   }
+}
+
+/* The output frame is divided into cells of this size to find the parts
+ * that are hidden behind opaque frames, and it is split between the worker
+ * threads along rows of cells. Cells start at multiples of the period of the
+ * checker pattern (32 columns for packed 4:2:2) and of the subsampling of
+ * all formats, so that a view on some cells is filled and blended exactly
+ * like the same pixels of the whole frame */
+#define CELL_WIDTH 32
+#define CELL_HEIGHT 16
+
+/* The blend functions of subsampled formats round odd positions up, which
+ * moves a frame by up to this many pixels */
+#define CELL_MARGIN 4
+
+/* cover values of the cells that are copied from the previous output, and
+ * of the cells that already show the background in the output memory,
+ * which may have to be stored in the copy of the output */
+#define CELL_UNCHANGED G_MAXINT
+#define CELL_CLEAN (G_MAXINT - 1)
+#define CELL_CLEAN_STORE (G_MAXINT - 2)
+
+typedef struct
+{
+  GstVideoFrame *frame;
+  gint xpos, ypos;
+  gdouble alpha;
+  /* cells the frame can touch, ends excluded */
+  gint col_start, col_end;
+  gint row_start, row_end;
+} CompositorLayer;
+
+typedef struct
+{
+  GstVideoFrame *outframe;
+  GstCompositorBackground background;
+  BlendFunction composite;
+  CompositorLayer *layers;
+  gint n_layers;
+  gint n_cols, n_rows;
+  /* index of the highest opaque layer covering each cell completely, -1
+   * where the background is visible or CELL_UNCHANGED */
+  gint *cover;
+  /* the previous output, and whether to store the drawn cells in it */
+  GstVideoFrame *cache;
+  gboolean update_cache;
+} CompositorPlan;
+
+typedef struct
+{
+  CompositorPlan *plan;
+  gint row_start, row_end;
+} CompositorStripe;
+
+/* Makes @view a view on @width x @height pixels of @frame starting at @x,
+ * @y, which have to be on a cell boundary. The view must not be unmapped */
+static void
+gst_compositor_frame_view (GstVideoFrame * frame, gint x, gint y, gint width,
+    gint height, GstVideoFrame * view)
+{
+  const GstVideoFormatInfo *finfo = frame->info.finfo;
+  guint plane, comp;
+
+  *view = *frame;
+  view->info.width = width;
+  view->info.height = height;
+
+  for (plane = 0; plane < GST_VIDEO_FRAME_N_PLANES (frame); plane++) {
+    for (comp = 0; comp < GST_VIDEO_FORMAT_INFO_N_COMPONENTS (finfo) - 1;
+        comp++) {
+      if (GST_VIDEO_FORMAT_INFO_PLANE (finfo, comp) == plane)
+        break;
+    }
+
+    view->data[plane] = (guint8 *) frame->data[plane] +
+        GST_VIDEO_FORMAT_INFO_SCALE_HEIGHT (finfo, comp, y) *
+        GST_VIDEO_FRAME_PLANE_STRIDE (frame, plane) +
+        GST_VIDEO_FORMAT_INFO_SCALE_WIDTH (finfo, comp, x) *
+        GST_VIDEO_FRAME_COMP_PSTRIDE (frame, comp);
+  }
+}
+
+static void
+gst_compositor_damage_cells (CompositorPlan * plan, gboolean * damaged,
+    gint col_start, gint col_end, gint row_start, gint row_end)
+{
+  gint row, col;
+
+  col_end = MIN (col_end, plan->n_cols);
+  row_end = MIN (row_end, plan->n_rows);
+
+  for (row = row_start; row < row_end; row++) {
+    for (col = col_start; col < col_end; col++)
+      damaged[row * plan->n_cols + col] = TRUE;
+  }
+}
+
+/* Marks the cells where @cpad looks different than in the previous output
+ * and remembers how it looks now. @layer is NULL if the pad is not
+ * blended */
+static void
+gst_compositor_pad_damage (GstCompositorPad * cpad, CompositorLayer * layer,
+    CompositorPlan * plan, gboolean * damaged)
+{
+  GstVideoAggregatorPad *pad = GST_VIDEO_AGGREGATOR_PAD (cpad);
+  GstBuffer *buffer = layer ? pad->buffer : NULL;
+
+  if (buffer == cpad->damage_buffer && (layer == NULL ||
+          (layer->xpos == cpad->damage_xpos &&
+              layer->ypos == cpad->damage_ypos &&
+              GST_VIDEO_FRAME_WIDTH (layer->frame) == cpad->damage_width &&
+              GST_VIDEO_FRAME_HEIGHT (layer->frame) == cpad->damage_height &&
+              layer->alpha == cpad->damage_alpha &&
+              pad->zorder == cpad->damage_zorder)))
+    return;
+
+  if (cpad->damage_buffer)
+    gst_compositor_damage_cells (plan, damaged, cpad->damage_col_start,
+        cpad->damage_col_end, cpad->damage_row_start, cpad->damage_row_end);
+
+  if (layer) {
+    gst_compositor_damage_cells (plan, damaged, layer->col_start,
+        layer->col_end, layer->row_start, layer->row_end);
+
+    cpad->damage_xpos = layer->xpos;
+    cpad->damage_ypos = layer->ypos;
+    cpad->damage_width = GST_VIDEO_FRAME_WIDTH (layer->frame);
+    cpad->damage_height = GST_VIDEO_FRAME_HEIGHT (layer->frame);
+    cpad->damage_alpha = layer->alpha;
+    cpad->damage_zorder = pad->zorder;
+    cpad->damage_col_start = layer->col_start;
+    cpad->damage_col_end = layer->col_end;
+    cpad->damage_row_start = layer->row_start;
+    cpad->damage_row_end = layer->row_end;
+  }
+
+  /* the ref keeps the buffer from being reused for another picture */
+  gst_buffer_replace (&cpad->damage_buffer, buffer);
+}
+
+/* WITH GST_OBJECT_LOCK !!
+ * Collects the frames to blend on @outframe, finds the cells in which
+ * they are hidden behind opaque frames of a higher z-order, the cells
+ * that can be copied from @cache because nothing changed in them and the
+ * cells that already show the background in @output */
+static void
+gst_compositor_plan_init (GstCompositor * self, CompositorPlan * plan,
+    GstVideoFrame * outframe, GstVideoFrame * cache,
+    GstCompositorOutput * output)
+{
+  GstVideoAggregator *vagg = GST_VIDEO_AGGREGATOR (self);
+  gint width = GST_VIDEO_FRAME_WIDTH (outframe);
+  gint height = GST_VIDEO_FRAME_HEIGHT (outframe);
+  gboolean cull, clean, *damaged, *touched;
+  gint i, n_cells, n_covered = 0, n_damaged = 0, n_drawn = 0;
+  GList *l;
+
+  /* Without alpha in the output, blending with an alpha of 1.0 is a plain
+   * copy that replaces everything below the frame. Blending opaque alpha
+   * formats rounds, so the result still depends on what is below */
+  cull = !GST_VIDEO_INFO_HAS_ALPHA (&outframe->info);
+
+  plan->outframe = outframe;
+  plan->background = self->background;
+  /* use overlay to keep background transparent */
+  plan->composite = self->background == COMPOSITOR_BACKGROUND_TRANSPARENT ?
+      self->overlay : self->blend;
+  plan->n_cols = (width + CELL_WIDTH - 1) / CELL_WIDTH;
+  plan->n_rows = (height + CELL_HEIGHT - 1) / CELL_HEIGHT;
+  n_cells = plan->n_cols * plan->n_rows;
+  plan->cover = g_new (gint, n_cells);
+  for (i = 0; i < n_cells; i++)
+    plan->cover[i] = -1;
+  damaged = g_new0 (gboolean, n_cells);
+
+  plan->layers = g_new (CompositorLayer,
+      g_list_length (GST_ELEMENT (vagg)->sinkpads));
+  plan->n_layers = 0;
+
+  for (l = GST_ELEMENT (vagg)->sinkpads; l; l = l->next) {
+    GstVideoAggregatorPad *pad = l->data;
+    GstCompositorPad *compo_pad = GST_COMPOSITOR_PAD (pad);
+    CompositorLayer *layer;
+    gint x1, y1;
+
+    if (pad->aggregated_frame == NULL) {
+      gst_compositor_pad_damage (compo_pad, NULL, plan, damaged);
+      continue;
+    }
+
+    layer = &plan->layers[plan->n_layers];
+    layer->frame = pad->aggregated_frame;
+    layer->xpos = compo_pad->crossfaded ? 0 : compo_pad->xpos;
+    layer->ypos = compo_pad->crossfaded ? 0 : compo_pad->ypos;
+    layer->alpha = compo_pad->alpha;
+    compo_pad->crossfaded = FALSE;
+
+    x1 = layer->xpos + GST_VIDEO_FRAME_WIDTH (layer->frame);
+    y1 = layer->ypos + GST_VIDEO_FRAME_HEIGHT (layer->frame);
+
+    layer->col_start = MAX (layer->xpos - CELL_MARGIN, 0) / CELL_WIDTH;
+    layer->row_start = MAX (layer->ypos - CELL_MARGIN, 0) / CELL_HEIGHT;
+    layer->col_end = MIN ((MAX (x1 + CELL_MARGIN, 0) + CELL_WIDTH - 1) /
+        CELL_WIDTH, plan->n_cols);
+    layer->row_end = MIN ((MAX (y1 + CELL_MARGIN, 0) + CELL_HEIGHT - 1) /
+        CELL_HEIGHT, plan->n_rows);
+
+    if (cull && layer->alpha == 1.0) {
+      gint x0 = layer->xpos + CELL_MARGIN, y0 = layer->ypos + CELL_MARGIN;
+      gint col_start, col_end, row_start, row_end, row, col;
+
+      /* the cells inside of the frame, the last ones are cut by the edges
+       * of the output frame */
+      col_start = (MAX (x0, 0) + CELL_WIDTH - 1) / CELL_WIDTH;
+      row_start = (MAX (y0, 0) + CELL_HEIGHT - 1) / CELL_HEIGHT;
+      col_end = x1 >= width ? plan->n_cols : MAX (x1, 0) / CELL_WIDTH;
+      row_end = y1 >= height ? plan->n_rows : MAX (y1, 0) / CELL_HEIGHT;
+
+      for (row = row_start; row < row_end; row++) {
+        for (col = col_start; col < col_end; col++) {
+          if (plan->cover[row * plan->n_cols + col] < 0)
+            n_covered++;
+          plan->cover[row * plan->n_cols + col] = plan->n_layers;
+        }
+      }
+    }
+
+    gst_compositor_pad_damage (compo_pad, layer, plan, damaged);
+    plan->n_layers++;
+  }
+
+  /* pads were added or removed */
+  if (GST_ELEMENT (self)->pads_cookie != self->cache_cookie) {
+    self->cache_cookie = GST_ELEMENT (self)->pads_cookie;
+    self->cache_valid = FALSE;
+  }
+
+  /* the cells in which only the background is visible */
+  touched = g_new0 (gboolean, n_cells);
+  for (i = 0; i < plan->n_layers; i++) {
+    gst_compositor_damage_cells (plan, touched, plan->layers[i].col_start,
+        plan->layers[i].col_end, plan->layers[i].row_start,
+        plan->layers[i].row_end);
+  }
+
+  clean = output != NULL && output->n_cells == n_cells &&
+      output->cookie == self->output_cookie;
+
+  for (i = 0; i < n_cells; i++) {
+    if (damaged[i])
+      n_damaged++;
+    else if (self->cache_valid && cache != NULL)
+      plan->cover[i] = CELL_UNCHANGED;
+
+    if (clean && output->clean[i] && !touched[i])
+      plan->cover[i] = plan->cover[i] == CELL_UNCHANGED ?
+          CELL_CLEAN : CELL_CLEAN_STORE;
+    else if (plan->cover[i] != CELL_UNCHANGED)
+      n_drawn++;
+  }
+  g_free (damaged);
+
+  /* remember what the output memory shows after this */
+  if (output != NULL) {
+    output->clean = g_renew (gboolean, output->clean, n_cells);
+    for (i = 0; i < n_cells; i++)
+      output->clean[i] = !touched[i];
+    output->n_cells = n_cells;
+    output->cookie = self->output_cookie;
+  }
+  g_free (touched);
+
+  /* Only keep a copy of the output when part of it will probably be the
+   * same in the next one */
+  plan->cache = cache;
+  plan->update_cache = cache != NULL && n_damaged < n_cells;
+  self->cache_valid = plan->update_cache;
+
+  GST_LOG_OBJECT (self, "Blending %d frames, %d of %d cells covered by "
+      "opaque frames, drawing %d%% of the output", plan->n_layers, n_covered,
+      n_cells, n_drawn * 100 / n_cells);
+}
+
+static void
+gst_compositor_plan_clear (CompositorPlan * plan)
+{
+  g_free (plan->layers);
+  g_free (plan->cover);
+}
+
+static inline gboolean
+gst_compositor_cell_is_copied (gint cover, gboolean to_cache)
+{
+  if (to_cache)
+    return cover != CELL_UNCHANGED && cover != CELL_CLEAN;
+
+  return cover == CELL_UNCHANGED;
+}
+
+/* Copies the unchanged cells of @row from the copy of the previous output
+ * @src to @dest, or the cells that changed from the output @src to the copy
+ * @dest if @to_cache is TRUE */
+static void
+gst_compositor_copy_cells (CompositorPlan * plan, GstVideoFrame * src,
+    GstVideoFrame * dest, gint row, gboolean to_cache)
+{
+  gint width = GST_VIDEO_FRAME_WIDTH (plan->outframe);
+  gint height = GST_VIDEO_FRAME_HEIGHT (plan->outframe);
+  const gint *cover = &plan->cover[row * plan->n_cols];
+  gint y = row * CELL_HEIGHT;
+  gint rows = MIN (CELL_HEIGHT, height - y);
+  GstVideoFrame src_view, dest_view;
+  gint col, end, x, w;
+
+  for (col = 0; col < plan->n_cols; col = end) {
+    for (end = col; end < plan->n_cols &&
+        gst_compositor_cell_is_copied (cover[end], to_cache); end++);
+
+    if (end > col) {
+      x = col * CELL_WIDTH;
+      w = MIN (end * CELL_WIDTH, width) - x;
+      gst_compositor_frame_view (src, x, y, w, rows, &src_view);
+      gst_compositor_frame_view (dest, x, y, w, rows, &dest_view);
+      gst_video_frame_copy (&dest_view, &src_view);
+    } else {
+      end++;
+    }
+  }
+}
+
+/* Fills and blends the rows of cells from @row_start to @row_end, leaving
+ * out the cells where the background or a frame is hidden and copying the
+ * cells that did not change from the previous output */
+static void
+gst_compositor_blend_rows (GstCompositor * self, CompositorPlan * plan,
+    gint row_start, gint row_end)
+{
+  gint width = GST_VIDEO_FRAME_WIDTH (plan->outframe);
+  gint height = GST_VIDEO_FRAME_HEIGHT (plan->outframe);
+  GstVideoFrame view;
+  gint row, col, end, i;
+
+  for (row = row_start; row < row_end; row++) {
+    const gint *cover = &plan->cover[row * plan->n_cols];
+    gint y = row * CELL_HEIGHT;
+    gint rows = MIN (CELL_HEIGHT, height - y);
+
+    if (plan->cache)
+      gst_compositor_copy_cells (plan, plan->cache, plan->outframe, row,
+          FALSE);
+
+    for (col = 0; col < plan->n_cols; col = end) {
+      for (end = col; end < plan->n_cols && cover[end] < 0; end++);
+
+      if (end > col) {
+        gst_compositor_frame_view (plan->outframe, col * CELL_WIDTH, y,
+            MIN (end * CELL_WIDTH, width) - col * CELL_WIDTH, rows, &view);
+        gst_compositor_fill_background (self, plan->background, &view);
+      } else {
+        end++;
+      }
+    }
+
+    for (i = 0; i < plan->n_layers; i++) {
+      CompositorLayer *layer = &plan->layers[i];
+
+      if (row < layer->row_start || row >= layer->row_end)
+        continue;
+
+      for (col = layer->col_start; col < layer->col_end; col = end) {
+        for (end = col; end < layer->col_end && cover[end] <= i; end++);
+
+        if (end > col) {
+          gst_compositor_frame_view (plan->outframe, col * CELL_WIDTH, y,
+              MIN (end * CELL_WIDTH, width) - col * CELL_WIDTH, rows, &view);
+          /* the blend functions clip whatever is outside of the view */
+          plan->composite (layer->frame, layer->xpos - col * CELL_WIDTH,
+              layer->ypos - y, layer->alpha, &view,
+              COMPOSITOR_BLEND_MODE_NORMAL);
+        } else {
+          end++;
+        }
+      }
+    }
+
+    if (plan->update_cache)
+      gst_compositor_copy_cells (plan, plan->outframe, plan->cache, row, TRUE);
+  }
+}
+
+static void
+gst_compositor_blend_stripe_func (CompositorStripe * stripe,
+    GstCompositor * self)
+{
+  gst_compositor_blend_rows (self, stripe->plan, stripe->row_start,
+      stripe->row_end);
+
+  g_mutex_lock (&self->blend_lock);
+  if (--self->blend_pending == 0)
+    g_cond_signal (&self->blend_cond);
+  g_mutex_unlock (&self->blend_lock);
+}
+
+/* The frames of several pads can be prepared at the same time, as whether
+ * they are obscured is found out before in the aggregating thread */
+static guint
+gst_compositor_get_n_threads (GstVideoAggregator * vagg)
+{
+  GstCompositor *self = GST_COMPOSITOR (vagg);
+  guint n_threads;
+
+  GST_OBJECT_LOCK (self);
+  n_threads = self->n_threads;
+  GST_OBJECT_UNLOCK (self);
+
+  return n_threads;
+}
+
+/* WITH GST_OBJECT_LOCK !!
+ * Returns the number of stripes to split @outframe into, 1 to fill and
+ * blend it in the aggregating thread */
+static guint
+gst_compositor_get_n_stripes (GstCompositor * self, GstVideoFrame * outframe)
+{
+  guint n_threads = self->n_threads, max_stripes;
+
+  if (n_threads == 0)
+    n_threads = g_get_num_processors ();
+
+  max_stripes = (GST_VIDEO_FRAME_HEIGHT (outframe) + CELL_HEIGHT - 1) /
+      CELL_HEIGHT;
+
+  return MIN (n_threads, max_stripes);
+}
+
+/* Blends @plan in @n_stripes horizontal stripes, one of them in the calling
+ * thread and the others in the worker threads. This runs without the object
+ * lock, @plan holds everything it needs */
+static void
+gst_compositor_blend_stripes (GstCompositor * self, CompositorPlan * plan,
+    guint n_stripes)
+{
+  CompositorStripe *stripes;
+  gint stripe_rows;
+  guint i;
+
+  if (n_stripes > 1 && self->blend_pool == NULL) {
+    GError *err = NULL;
+
+    self->blend_pool =
+        g_thread_pool_new ((GFunc) gst_compositor_blend_stripe_func, self,
+        n_stripes - 1, FALSE, &err);
+    if (self->blend_pool == NULL) {
+      GST_WARNING_OBJECT (self, "Could not create worker threads: %s",
+          err->message);
+      g_clear_error (&err);
+    }
+  } else if (n_stripes > 1 &&
+      g_thread_pool_get_max_threads (self->blend_pool) < (gint) n_stripes - 1) {
+    g_thread_pool_set_max_threads (self->blend_pool, n_stripes - 1, NULL);
+  }
+
+  if (n_stripes <= 1 || self->blend_pool == NULL) {
+    gst_compositor_blend_rows (self, plan, 0, plan->n_rows);
+    return;
+  }
+
+  stripe_rows = (plan->n_rows + n_stripes - 1) / n_stripes;
+  n_stripes = (plan->n_rows + stripe_rows - 1) / stripe_rows;
+
+  GST_LOG_OBJECT (self, "Blending in %u stripes of %d rows", n_stripes,
+      stripe_rows * CELL_HEIGHT);
+
+  stripes = g_new (CompositorStripe, n_stripes);
+  for (i = 0; i < n_stripes; i++) {
+    stripes[i].plan = plan;
+    stripes[i].row_start = i * stripe_rows;
+    stripes[i].row_end = MIN ((i + 1) * stripe_rows, plan->n_rows);
+  }
+
+  g_mutex_lock (&self->blend_lock);
+  self->blend_pending = n_stripes - 1;
+  g_mutex_unlock (&self->blend_lock);
+
+  for (i = 1; i < n_stripes; i++)
+    g_thread_pool_push (self->blend_pool, &stripes[i], NULL);
+
+  gst_compositor_blend_rows (self, plan, stripes[0].row_start,
+      stripes[0].row_end);
+
+  g_mutex_lock (&self->blend_lock);
+  while (self->blend_pending > 0)
+    g_cond_wait (&self->blend_cond, &self->blend_lock);
+  g_mutex_unlock (&self->blend_lock);
+
+  g_free (stripes);
+}
+
+/* WITH GST_OBJECT_LOCK !!
+ * Maps the copy of the previous output into @frame, allocating it first if
+ * needed. Returns NULL if that failed */
+static GstVideoFrame *
+gst_compositor_map_cache (GstCompositor * self, GstVideoFrame * frame)
+{
+  GstVideoAggregator *vagg = GST_VIDEO_AGGREGATOR (self);
+
+  if (self->cache == NULL) {
+    self->cache = gst_buffer_new_allocate (NULL,
+        GST_VIDEO_INFO_SIZE (&vagg->info), NULL);
+    self->cache_valid = FALSE;
+  }
+
+  if (self->cache == NULL ||
+      !gst_video_frame_map (frame, &vagg->info, self->cache,
+          GST_MAP_READWRITE)) {
+    GST_WARNING_OBJECT (self, "Could not map the copy of the output");
+    self->cache_valid = FALSE;
+    return NULL;
+  }
+
+  return frame;
+}
+
+/* WITH GST_OBJECT_LOCK !! */
+static gboolean
+gst_compositor_has_crossfade (GstCompositor * self)
+{
+  GList *l;
+
+  for (l = GST_ELEMENT (self)->sinkpads; l; l = l->next) {
+    if (GST_COMPOSITOR_PAD (l->data)->crossfade >= 0.0f)
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+/* Whether @buffer can be read with the plane layout of @info */
+static gboolean
+gst_compositor_buffer_has_layout (GstBuffer * buffer, GstVideoInfo * info)
+{
+  GstVideoMeta *meta;
+  guint i;
+
+  meta = gst_buffer_get_video_meta (buffer);
+  if (meta == NULL)
+    return gst_buffer_get_size (buffer) >= GST_VIDEO_INFO_SIZE (info);
+
+  if (meta->n_planes != GST_VIDEO_INFO_N_PLANES (info))
+    return FALSE;
+
+  for (i = 0; i < meta->n_planes; i++) {
+    if (meta->offset[i] != GST_VIDEO_INFO_PLANE_OFFSET (info, i) ||
+        meta->stride[i] != GST_VIDEO_INFO_PLANE_STRIDE (info, i))
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* WITH GST_OBJECT_LOCK !!
+ * Returns the pad whose buffer is exactly what the output would be, because
+ * it covers the whole output with an alpha of 1.0, needs no conversion and
+ * nothing is visible above it. Returns NULL if the output must be
+ * composited. */
+static GstVideoAggregatorPad *
+gst_compositor_find_passthrough_pad (GstCompositor * self)
+{
+  GstVideoAggregator *vagg = GST_VIDEO_AGGREGATOR (self);
+  GstVideoInfo *out_info = &vagg->info;
+  gint out_width = GST_VIDEO_INFO_WIDTH (out_info);
+  gint out_height = GST_VIDEO_INFO_HEIGHT (out_info);
+  GList *l;
+
+  /* Blending on a background with alpha is not a plain copy */
+  if (GST_VIDEO_INFO_HAS_ALPHA (out_info))
+    return NULL;
+
+  /* Find the visible pad with the highest zorder, everything below it is
+   * hidden if it covers the whole output */
+  for (l = g_list_last (GST_ELEMENT (self)->sinkpads); l; l = l->prev) {
+    GstVideoAggregatorPad *pad = l->data;
+    GstCompositorPad *cpad = GST_COMPOSITOR_PAD (pad);
+    GstVideoInfo *info = &pad->info;
+    GstVideoRectangle rect;
+    gint width, height;
+
+    if (pad->buffer == NULL || cpad->alpha == 0.0)
+      continue;
+
+    _mixer_pad_get_output_size (self, cpad, GST_VIDEO_INFO_PAR_N (out_info),
+        GST_VIDEO_INFO_PAR_D (out_info), &width, &height);
+    rect = clamp_rectangle (cpad->xpos, cpad->ypos, width, height,
+        out_width, out_height);
+    if (rect.w == 0 || rect.h == 0)
+      continue;
+
+    if (cpad->alpha != 1.0 || cpad->crossfade >= 0.0 ||
+        (l->prev && GST_COMPOSITOR_PAD (l->prev->data)->crossfade >= 0.0))
+      return NULL;
+
+    if (cpad->xpos != 0 || cpad->ypos != 0 || width != out_width
+        || height != out_height)
+      return NULL;
+
+    if (GST_VIDEO_INFO_FORMAT (info) != GST_VIDEO_INFO_FORMAT (out_info)
+        || GST_VIDEO_INFO_WIDTH (info) != out_width
+        || GST_VIDEO_INFO_HEIGHT (info) != out_height
+        || GST_VIDEO_INFO_INTERLACE_MODE (info) !=
+        GST_VIDEO_INFO_INTERLACE_MODE (out_info)
+        || info->chroma_site != out_info->chroma_site
+        || !gst_video_colorimetry_is_equal (&info->colorimetry,
+            &out_info->colorimetry))
+      return NULL;
+
+    if (!gst_compositor_buffer_has_layout (pad->buffer, info))
+      return NULL;
+
+    return pad;
+  }
+
+  return NULL;
+}
+
+/* Wraps one of our output memories that downstream is done with into
+ * @outbuf, or a new one. Returns FALSE if the pool has to be used */
+static gboolean
+gst_compositor_acquire_output (GstCompositor * self, GstBuffer ** outbuf)
+{
+  GstAggregator *agg = GST_AGGREGATOR (self);
+  GstVideoAggregator *vagg = GST_VIDEO_AGGREGATOR (self);
+  GstCompositorOutput *output = NULL;
+  guint i;
+
+  /* Only replace the pool videoaggregator makes when downstream has none */
+  if (!self->own_outputs)
+    return FALSE;
+
+  for (i = 0; i < self->n_outputs; i++) {
+    GstCompositorOutput *o = &self->outputs[i];
+
+    /* the previous output was not composited */
+    if (!o->locked) {
+      gst_memory_lock (o->memory, GST_LOCK_FLAG_EXCLUSIVE);
+      o->locked = TRUE;
+    }
+
+    /* every buffer holding the memory has an exclusive lock on it too, so
+     * it is only writable once downstream released all of them */
+    if (output == NULL && gst_memory_is_writable (o->memory))
+      output = o;
+  }
+
+  if (output == NULL) {
+    GstAllocator *allocator;
+    GstAllocationParams params;
+    GstMemory *memory;
+
+    if (self->n_outputs == COMPOSITOR_MAX_OUTPUTS)
+      return FALSE;
+
+    gst_aggregator_get_allocator (agg, &allocator, &params);
+    memory = gst_allocator_alloc (allocator,
+        GST_VIDEO_INFO_SIZE (&vagg->info), &params);
+    if (allocator)
+      gst_object_unref (allocator);
+    if (memory == NULL)
+      return FALSE;
+
+    output = &self->outputs[self->n_outputs++];
+    output->memory = memory;
+    output->locked = FALSE;
+    output->n_cells = 0;
+    output->clean = NULL;
+  }
+
+  if (output->locked) {
+    gst_memory_unlock (output->memory, GST_LOCK_FLAG_EXCLUSIVE);
+    output->locked = FALSE;
+  }
+
+  *outbuf = gst_buffer_new ();
+  gst_buffer_append_memory (*outbuf, gst_memory_ref (output->memory));
+  self->output = output;
+
+  return TRUE;
+}
+
+static GstFlowReturn
+gst_compositor_get_output_buffer (GstVideoAggregator * vagg,
+    GstBuffer ** outbuf)
+{
+  GstCompositor *self = GST_COMPOSITOR (vagg);
+  GstVideoAggregatorPad *pad;
+
+  self->output = NULL;
+
+  GST_OBJECT_LOCK (vagg);
+  pad = gst_compositor_find_passthrough_pad (self);
+  if (pad != NULL) {
+    if (!self->passthrough)
+      GST_DEBUG_OBJECT (self, "Only %s is visible, pushing its buffers",
+          GST_PAD_NAME (pad));
+
+    /* Shares the memory of the input buffer, only the metadata is ours */
+    *outbuf = gst_buffer_copy (pad->buffer);
+    GST_BUFFER_FLAG_UNSET (*outbuf, GST_BUFFER_FLAG_DISCONT |
+        GST_BUFFER_FLAG_RESYNC | GST_BUFFER_FLAG_GAP);
+    GST_BUFFER_OFFSET (*outbuf) = GST_BUFFER_OFFSET_NONE;
+    GST_BUFFER_OFFSET_END (*outbuf) = GST_BUFFER_OFFSET_NONE;
+  } else {
+    if (self->passthrough)
+      GST_DEBUG_OBJECT (self, "Compositing again");
+    gst_compositor_update_obscured (self);
+  }
+  self->passthrough = (pad != NULL);
+  GST_OBJECT_UNLOCK (vagg);
+
+  if (pad != NULL || gst_compositor_acquire_output (self, outbuf))
+    return GST_FLOW_OK;
+
+  return GST_VIDEO_AGGREGATOR_CLASS (parent_class)->get_output_buffer (vagg,
+      outbuf);
+}
+
+static GstFlowReturn
+gst_compositor_aggregate_frames (GstVideoAggregator * vagg, GstBuffer * outbuf)
+{
+  GList *l;
+  GstCompositor *self = GST_COMPOSITOR (vagg);
+  BlendFunction composite;
+  GstVideoFrame out_frame, *outframe;
+  GstVideoFrame cache_frame, *cache;
+  CompositorPlan plan;
+  guint n_stripes;
+
+  /* outbuf already is the buffer of the only visible pad */
+  if (self->passthrough) {
+    GST_OBJECT_LOCK (vagg);
+    gst_compositor_reset_damage (self);
+    GST_OBJECT_UNLOCK (vagg);
+    gst_compositor_convert_cache_prune ();
+    return GST_FLOW_OK;
+  }
+
+  if (!gst_video_frame_map (&out_frame, &vagg->info, outbuf, GST_MAP_WRITE)) {
+    GST_WARNING_OBJECT (vagg, "Could not map output buffer");
+    return GST_FLOW_ERROR;
+  }
+
+  outframe = &out_frame;
 
   GST_OBJECT_LOCK (vagg);
+  if (!gst_compositor_has_crossfade (self)) {
+    n_stripes = gst_compositor_get_n_stripes (self, outframe);
+    cache = gst_compositor_map_cache (self, &cache_frame);
+    gst_compositor_plan_init (self, &plan, outframe, cache, self->output);
+    GST_OBJECT_UNLOCK (vagg);
+
+    /* Don't keep the property setters waiting for the worker threads */
+    gst_compositor_blend_stripes (self, &plan, n_stripes);
+    gst_compositor_plan_clear (&plan);
+    if (cache)
+      gst_video_frame_unmap (cache);
+    goto unmap;
+  }
+
+  gst_compositor_reset_damage (self);
+  if (self->output)
+    self->output->n_cells = 0;
+
+  /* Crossfaded pads are not part of the plan, blend everything on the whole
+   * output frame then */
+  gst_compositor_fill_background (self, self->background, outframe);
+  /* default to blending, use overlay to keep background transparent */
+  composite = self->background == COMPOSITOR_BACKGROUND_TRANSPARENT ?
+      self->overlay : self->blend;
+
+  if (self->mix) {
+    gst_compositor_mix_frames (self, outframe, composite);
+    goto done;
+  }
+
   /* First mix the crossfade frames as required */
   if (!gst_compositor_crossfade_frames (self, outframe)) {
     for (l = GST_ELEMENT (vagg)->sinkpads; l; l = l->next) {
@@ -1161,10 +2208,23 @@ gst_compositor_aggregate_frames (GstVideoAggregator * vagg, GstBuffer * outbuf)
       }
     }
   }
+
+done:
   GST_OBJECT_UNLOCK (vagg);
 
+unmap:
   gst_video_frame_unmap (outframe);
 
+  /* Writing to the memory downstream now makes a copy of it, so that it
+   * still shows what we know when it comes back */
+  if (self->output) {
+    gst_memory_lock (self->output->memory, GST_LOCK_FLAG_EXCLUSIVE);
+    self->output->locked = TRUE;
+  }
+
+  /* Don't keep the conversions of input buffers the pads released */
+  gst_compositor_convert_cache_prune ();
+
   return GST_FLOW_OK;
 }
 
@@ -1210,6 +2270,54 @@ _sink_query (GstAggregator * agg, GstAggregatorPad * bpad, GstQuery * query)
   }
 }
 
+static gboolean
+gst_compositor_decide_allocation (GstAggregator * agg, GstQuery * query)
+{
+  GstCompositor *self = GST_COMPOSITOR (agg);
+
+  /* A pool from downstream is always used, with its configuration. Our
+   * output memories also come from the allocator decided here */
+  GST_OBJECT_LOCK (agg);
+  self->own_outputs = gst_query_get_n_allocation_pools (query) == 0;
+  gst_compositor_clear_outputs (self);
+  GST_OBJECT_UNLOCK (agg);
+
+  return GST_AGGREGATOR_CLASS (parent_class)->decide_allocation (agg, query);
+}
+
+static gboolean
+gst_compositor_stop (GstAggregator * agg)
+{
+  GstCompositor *self = GST_COMPOSITOR (agg);
+
+  GST_OBJECT_LOCK (agg);
+  gst_compositor_reset_damage (self);
+  gst_buffer_replace (&self->cache, NULL);
+  gst_compositor_clear_outputs (self);
+  GST_OBJECT_UNLOCK (agg);
+
+  /* pads don't hold their last buffer anymore */
+  gst_compositor_convert_cache_prune ();
+
+  return GST_AGGREGATOR_CLASS (parent_class)->stop (agg);
+}
+
+static void
+gst_compositor_finalize (GObject * object)
+{
+  GstCompositor *self = GST_COMPOSITOR (object);
+
+  gst_buffer_replace (&self->cache, NULL);
+  gst_compositor_clear_outputs (self);
+
+  if (self->blend_pool)
+    g_thread_pool_free (self->blend_pool, FALSE, TRUE);
+  g_mutex_clear (&self->blend_lock);
+  g_cond_clear (&self->blend_cond);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
 /* GObject boilerplate */
 static void
 gst_compositor_class_init (GstCompositorClass * klass)
@@ -1222,17 +2330,38 @@ gst_compositor_class_init (GstCompositorClass * klass)
 
   gobject_class->get_property = gst_compositor_get_property;
   gobject_class->set_property = gst_compositor_set_property;
+  gobject_class->finalize = gst_compositor_finalize;
 
   agg_class->sink_query = _sink_query;
   agg_class->fixate_src_caps = _fixate_caps;
   agg_class->negotiated_src_caps = _negotiated_caps;
+  agg_class->decide_allocation = gst_compositor_decide_allocation;
+  agg_class->stop = gst_compositor_stop;
   videoaggregator_class->aggregate_frames = gst_compositor_aggregate_frames;
+  videoaggregator_class->get_output_buffer = gst_compositor_get_output_buffer;
+  videoaggregator_class->get_n_threads = gst_compositor_get_n_threads;
 
   g_object_class_install_property (gobject_class, PROP_BACKGROUND,
       g_param_spec_enum ("background", "Background", "Background type",
           GST_TYPE_COMPOSITOR_BACKGROUND,
           DEFAULT_BACKGROUND, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  /**
+   * GstCompositor:n-threads:
+   *
+   * Maximum number of threads used to convert the frames of the sink pads
+   * and to blend them, 0 meaning one thread per processor. With 1, all the
+   * work is done in the aggregating thread.
+   *
+   * Since: 1.14
+   */
+  g_object_class_install_property (gobject_class, PROP_N_THREADS,
+      g_param_spec_uint ("n-threads", "Number of threads",
+          "Maximum number of threads used to convert and blend the frames "
+          "(0 = number of processors, 1 = only use the aggregating thread)",
+          0, G_MAXINT, DEFAULT_N_THREADS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   gst_element_class_add_static_pad_template (gstelement_class, &src_factory);
   gst_element_class_add_static_pad_template_with_gtype (gstelement_class,
       &sink_factory, GST_TYPE_COMPOSITOR_PAD);
@@ -1248,6 +2377,10 @@ gst_compositor_init (GstCompositor * self)
 {
   /* initialize variables */
   self->background = DEFAULT_BACKGROUND;
+  self->n_threads = DEFAULT_N_THREADS;
+
+  g_mutex_init (&self->blend_lock);
+  g_cond_init (&self->blend_cond);
 }
 
 /* Element registration */
@@ -1257,6 +2390,7 @@ plugin_init (GstPlugin * plugin)
   GST_DEBUG_CATEGORY_INIT (gst_compositor_debug, "compositor", 0, "compositor");
 
   gst_compositor_init_blend ();
+  gst_compositor_init_convert_cache ();
 
   return gst_element_register (plugin, "compositor", GST_RANK_PRIMARY + 1,
       GST_TYPE_COMPOSITOR);
@@ -59,6 +59,21 @@ typedef enum
   COMPOSITOR_BACKGROUND_TRANSPARENT,
 } GstCompositorBackground;
 
+/* Number of output memories compositor keeps for itself */
+#define COMPOSITOR_MAX_OUTPUTS 4
+
+/* An output memory that is written again once downstream is done with it */
+typedef struct
+{
+  GstMemory *memory;
+  /* locked while downstream has it, so that writing to it copies it */
+  gboolean locked;
+  /* the cells that only show the background, n_cells is 0 if unknown */
+  guint32 cookie;
+  gint n_cells;
+  gboolean *clean;
+} GstCompositorOutput;
+
 /**
  * GstCompositor:
  *
@@ -72,6 +87,32 @@ struct _GstCompositor
   BlendFunction blend, overlay;
   FillCheckerFunction fill_checker;
   FillColorFunction fill_color;
+  /* NULL if crossfades are blended pad by pad */
+  MixFunction mix;
+
+  /* blending of horizontal stripes in worker threads */
+  guint n_threads;
+  GThreadPool *blend_pool;
+  GMutex blend_lock;
+  GCond blend_cond;
+  guint blend_pending;
+
+  /* TRUE while the buffer of a single pad is pushed as is */
+  gboolean passthrough;
+
+  /* copy of the previous output, for the cells that did not change */
+  GstBuffer *cache;
+  gboolean cache_valid;
+  guint32 cache_cookie;
+
+  /* output memories reused with their background when downstream provides
+   * no pool, and the one in use */
+  gboolean own_outputs;
+  GstCompositorOutput outputs[COMPOSITOR_MAX_OUTPUTS];
+  guint n_outputs;
+  GstCompositorOutput *output;
+  /* changes when the background of the outputs changes */
+  guint32 output_cookie;
 };
 
 struct _GstCompositorClass
@@ -59,6 +59,19 @@ struct _GstCompositorPad
   GstBuffer *converted_buffer;
 
   gboolean crossfaded;
+  /* hidden behind an opaque higher-zorder picture, set before the frames
+   * are prepared */
+  gboolean obscured;
+
+  /* how the pad was blended into the previous output, to find the cells
+   * that changed since then */
+  GstBuffer *damage_buffer;
+  gint damage_xpos, damage_ypos;
+  gint damage_width, damage_height;
+  gdouble damage_alpha;
+  guint damage_zorder;
+  gint damage_col_start, damage_col_end;
+  gint damage_row_start, damage_row_end;
 };
 
 struct _GstCompositorPadClass
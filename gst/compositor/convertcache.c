@@ -0,0 +1,222 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Converted input frames, shared by all compositor pads of the process.
+ *
+ * When the same buffer is fed into several pads, for example through a tee
+ * into several compositors, it is converted to each size and format only
+ * once. A pad also reuses its own conversion while its input buffer does not
+ * change.
+ *
+ * An entry holds a ref on the input buffer, so that it can not be recycled
+ * by its pool for another picture while the entry exists. Entries are
+ * dropped as soon as nobody else has the input buffer anymore, in which
+ * case nobody can ask for its conversion again. compositor prunes them at
+ * the end of each output, so the cache never keeps an upstream buffer
+ * longer than the pads holding it. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "convertcache.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_compositor_convert_debug);
+#define GST_CAT_DEFAULT gst_compositor_convert_debug
+
+/* Upper limit of the number of entries, the oldest ones are dropped first */
+#define MAX_ENTRIES 32
+
+typedef struct
+{
+  GstBuffer *inbuf;
+  GstVideoInfo in_info, out_info;
+  /* NULL while the buffer is being converted */
+  GstBuffer *outbuf;
+} ConvertCacheEntry;
+
+static GMutex cache_lock;
+static GCond cache_cond;
+/* most recently added first */
+static GQueue cache_entries = G_QUEUE_INIT;
+
+/* Whether converting to or from @a and @b gives the same pixels */
+static gboolean
+convert_info_is_equal (const GstVideoInfo * a, const GstVideoInfo * b)
+{
+  return GST_VIDEO_INFO_FORMAT (a) == GST_VIDEO_INFO_FORMAT (b) &&
+      GST_VIDEO_INFO_WIDTH (a) == GST_VIDEO_INFO_WIDTH (b) &&
+      GST_VIDEO_INFO_HEIGHT (a) == GST_VIDEO_INFO_HEIGHT (b) &&
+      GST_VIDEO_INFO_INTERLACE_MODE (a) == GST_VIDEO_INFO_INTERLACE_MODE (b) &&
+      a->chroma_site == b->chroma_site &&
+      gst_video_colorimetry_is_equal (&a->colorimetry, &b->colorimetry);
+}
+
+static void
+convert_cache_entry_free (ConvertCacheEntry * entry)
+{
+  gst_buffer_unref (entry->inbuf);
+  if (entry->outbuf)
+    gst_buffer_unref (entry->outbuf);
+  g_slice_free (ConvertCacheEntry, entry);
+}
+
+/* WITH cache_lock */
+static void
+convert_cache_prune_unlocked (void)
+{
+  GList *l, *next;
+
+  for (l = cache_entries.head; l; l = next) {
+    ConvertCacheEntry *entry = l->data;
+
+    next = l->next;
+
+    /* only the cache has the input buffer left */
+    if (entry->outbuf && GST_MINI_OBJECT_REFCOUNT_VALUE (entry->inbuf) == 1) {
+      convert_cache_entry_free (entry);
+      g_queue_delete_link (&cache_entries, l);
+    }
+  }
+
+  for (l = cache_entries.tail; l && cache_entries.length > MAX_ENTRIES;
+      l = next) {
+    ConvertCacheEntry *entry = l->data;
+
+    next = l->prev;
+
+    if (entry->outbuf) {
+      convert_cache_entry_free (entry);
+      g_queue_delete_link (&cache_entries, l);
+    }
+  }
+}
+
+/* WITH cache_lock */
+static GList *
+convert_cache_find (GstBuffer * inbuf, const GstVideoInfo * in_info,
+    const GstVideoInfo * out_info)
+{
+  GList *l;
+
+  for (l = cache_entries.head; l; l = l->next) {
+    ConvertCacheEntry *entry = l->data;
+
+    if (entry->inbuf == inbuf && convert_info_is_equal (&entry->in_info,
+            in_info) && convert_info_is_equal (&entry->out_info, out_info))
+      return l;
+  }
+
+  return NULL;
+}
+
+/* Returns a ref to the conversion of @inbuf to @out_info, waiting for it if
+ * it is being converted already. The returned buffer must not be written
+ * to. If NULL is returned, the caller has to convert @inbuf and pass the
+ * result to gst_compositor_convert_cache_release() */
+GstBuffer *
+gst_compositor_convert_cache_acquire (GstBuffer * inbuf,
+    const GstVideoInfo * in_info, const GstVideoInfo * out_info)
+{
+  ConvertCacheEntry *entry;
+  GstBuffer *outbuf = NULL;
+  GList *l;
+
+  g_mutex_lock (&cache_lock);
+  convert_cache_prune_unlocked ();
+
+  while ((l = convert_cache_find (inbuf, in_info, out_info))) {
+    entry = l->data;
+
+    if (entry->outbuf) {
+      outbuf = gst_buffer_ref (entry->outbuf);
+      GST_LOG ("Reusing conversion of %p to %dx%d %s", inbuf,
+          GST_VIDEO_INFO_WIDTH (out_info), GST_VIDEO_INFO_HEIGHT (out_info),
+          GST_VIDEO_INFO_NAME (out_info));
+      goto done;
+    }
+
+    g_cond_wait (&cache_cond, &cache_lock);
+  }
+
+  GST_LOG ("Converting %p to %dx%d %s", inbuf,
+      GST_VIDEO_INFO_WIDTH (out_info), GST_VIDEO_INFO_HEIGHT (out_info),
+      GST_VIDEO_INFO_NAME (out_info));
+
+  /* mark it as being converted by the caller */
+  entry = g_slice_new (ConvertCacheEntry);
+  entry->inbuf = gst_buffer_ref (inbuf);
+  entry->in_info = *in_info;
+  entry->out_info = *out_info;
+  entry->outbuf = NULL;
+  g_queue_push_head (&cache_entries, entry);
+
+done:
+  g_mutex_unlock (&cache_lock);
+
+  return outbuf;
+}
+
+/* Stores the conversion of @inbuf after gst_compositor_convert_cache_acquire()
+ * returned NULL for it, or NULL if converting failed. @outbuf must not be
+ * written to afterwards */
+void
+gst_compositor_convert_cache_release (GstBuffer * inbuf,
+    const GstVideoInfo * in_info, const GstVideoInfo * out_info,
+    GstBuffer * outbuf)
+{
+  ConvertCacheEntry *entry = NULL;
+  GList *l;
+
+  g_mutex_lock (&cache_lock);
+  for (l = cache_entries.head; l; l = l->next) {
+    entry = l->data;
+
+    if (entry->outbuf == NULL && entry->inbuf == inbuf &&
+        convert_info_is_equal (&entry->in_info, in_info) &&
+        convert_info_is_equal (&entry->out_info, out_info))
+      break;
+  }
+
+  if (l) {
+    if (outbuf) {
+      entry->outbuf = gst_buffer_ref (outbuf);
+    } else {
+      /* let the next one try again */
+      convert_cache_entry_free (entry);
+      g_queue_delete_link (&cache_entries, l);
+    }
+    g_cond_broadcast (&cache_cond);
+  }
+  g_mutex_unlock (&cache_lock);
+}
+
+/* Drops the conversions of the input buffers that nobody uses anymore */
+void
+gst_compositor_convert_cache_prune (void)
+{
+  g_mutex_lock (&cache_lock);
+  convert_cache_prune_unlocked ();
+  g_mutex_unlock (&cache_lock);
+}
+
+void
+gst_compositor_init_convert_cache (void)
+{
+  GST_DEBUG_CATEGORY_INIT (gst_compositor_convert_debug, "compositor_convert",
+      0, "video compositor conversion cache");
+}
@@ -0,0 +1,33 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __CONVERT_CACHE_H__
+#define __CONVERT_CACHE_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+GstBuffer * gst_compositor_convert_cache_acquire (GstBuffer * inbuf,
+    const GstVideoInfo * in_info, const GstVideoInfo * out_info);
+void        gst_compositor_convert_cache_release (GstBuffer * inbuf,
+    const GstVideoInfo * in_info, const GstVideoInfo * out_info,
+    GstBuffer * outbuf);
+void        gst_compositor_convert_cache_prune (void);
+
+void gst_compositor_init_convert_cache (void);
+
+#endif /* __CONVERT_CACHE_H__ */
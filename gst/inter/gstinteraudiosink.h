@@ -41,7 +41,8 @@ struct _GstInterAudioSink
   GstInterSurface *surface;
   char *channel;
 
-  GstAdapter *input_adapter;
+  /* the audio ring of the surface we write to */
+  GstInterAudioRing *ring;
   GstAudioInfo info;
 };
 
@@ -33,6 +33,13 @@
  * See the gstintertest.c example in the gst-plugins-bad source code for
  * more details.
  *
+ * The samples are passed through a ring of #GstInterAudioSrc:buffer-time
+ * that the interaudiosink writes and the interaudiosrc reads without
+ * locking. As the two pipelines usually run on different clocks, the
+ * amount of audio queued in it drifts. The #GstInterAudioSrc:fill-level
+ * and #GstInterAudioSrc:resample-ratio properties let the application
+ * follow it, and compensate by resampling the audio.
+ *
  */
 
 #ifdef HAVE_CONFIG_H
@@ -77,9 +84,16 @@ enum
   PROP_CHANNEL,
   PROP_BUFFER_TIME,
   PROP_LATENCY_TIME,
-  PROP_PERIOD_TIME
+  PROP_PERIOD_TIME,
+  PROP_FILL_LEVEL,
+  PROP_RESAMPLE_RATIO
 };
 
+/* the fill level is averaged over about this many periods */
+#define FILL_LEVEL_PERIODS 64
+/* and the resample ratio brings it back to the latency time in that time */
+#define DRIFT_CORRECTION_TIME (10 * GST_SECOND)
+
 #define DEFAULT_CHANNEL ("default")
 
 /* pad templates */
@@ -148,6 +162,35 @@ gst_inter_audio_src_class_init (GstInterAudioSrcClass * klass)
           "The minimum amount of data to read in each iteration",
           1, G_MAXUINT64, DEFAULT_AUDIO_PERIOD_TIME,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstInterAudioSrc:fill-level:
+   *
+   * Amount of audio that was queued by the interaudiosink after the last
+   * period was read. It stays around #GstInterAudioSrc:latency-time when
+   * the clocks of both pipelines run at the same rate.
+   *
+   * Since: 1.14
+   */
+  g_object_class_install_property (gobject_class, PROP_FILL_LEVEL,
+      g_param_spec_uint64 ("fill-level", "Fill Level",
+          "Amount of audio queued by the sink, in nanoseconds",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstInterAudioSrc:resample-ratio:
+   *
+   * Ratio by which to resample the audio of the interaudiosink, for
+   * example with the rate of a pitch element, to bring the average fill
+   * level back to #GstInterAudioSrc:latency-time over 10 seconds. Above 1
+   * when the sink writes faster than the source reads.
+   *
+   * Since: 1.14
+   */
+  g_object_class_install_property (gobject_class, PROP_RESAMPLE_RATIO,
+      g_param_spec_double ("resample-ratio", "Resample Ratio",
+          "Ratio by which to resample to compensate the drift of the clocks",
+          0.0, G_MAXDOUBLE, 1.0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 }
 
 static void
@@ -208,6 +251,13 @@ gst_inter_audio_src_get_property (GObject * object, guint property_id,
     case PROP_PERIOD_TIME:
       g_value_set_uint64 (value, interaudiosrc->period_time);
       break;
+    case PROP_FILL_LEVEL:
+      g_value_set_uint64 (value, interaudiosrc->fill_level);
+      break;
+    case PROP_RESAMPLE_RATIO:
+      g_value_set_double (value, 1.0 + (interaudiosrc->avg_fill_level -
+              interaudiosrc->latency_time) / DRIFT_CORRECTION_TIME);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -279,14 +329,42 @@ gst_inter_audio_src_start (GstBaseSrc * src)
 
   GST_DEBUG_OBJECT (interaudiosrc, "start");
 
+  if (interaudiosrc->buffer_time < interaudiosrc->period_time) {
+    GST_ELEMENT_ERROR (interaudiosrc, RESOURCE, SETTINGS, (NULL),
+        ("Buffer time smaller than period time (%" GST_TIME_FORMAT " < %"
+            GST_TIME_FORMAT ")", GST_TIME_ARGS (interaudiosrc->buffer_time),
+            GST_TIME_ARGS (interaudiosrc->period_time)));
+    return FALSE;
+  }
+
   interaudiosrc->surface = gst_inter_surface_get (interaudiosrc->channel);
+
+  /* The ring only supports one reader, and another source would also
+   * reset it under our feet */
+  g_mutex_lock (&interaudiosrc->surface->mutex);
+  if (interaudiosrc->surface->audio_reader) {
+    g_mutex_unlock (&interaudiosrc->surface->mutex);
+    GST_ELEMENT_ERROR (interaudiosrc, RESOURCE, BUSY, (NULL),
+        ("Channel '%s' is already used by another interaudiosrc",
+            interaudiosrc->channel));
+    gst_inter_surface_unref (interaudiosrc->surface);
+    interaudiosrc->surface = NULL;
+    return FALSE;
+  }
+  interaudiosrc->surface->audio_reader = TRUE;
+  g_mutex_unlock (&interaudiosrc->surface->mutex);
+
   interaudiosrc->timestamp_offset = 0;
   interaudiosrc->n_samples = 0;
+  interaudiosrc->fill_level = 0;
+  interaudiosrc->avg_fill_level = interaudiosrc->latency_time;
 
   g_mutex_lock (&interaudiosrc->surface->mutex);
   interaudiosrc->surface->audio_buffer_time = interaudiosrc->buffer_time;
   interaudiosrc->surface->audio_latency_time = interaudiosrc->latency_time;
   interaudiosrc->surface->audio_period_time = interaudiosrc->period_time;
+  /* for our buffer time */
+  gst_inter_surface_reset_audio (interaudiosrc->surface);
   g_mutex_unlock (&interaudiosrc->surface->mutex);
 
   return TRUE;
@@ -299,9 +377,18 @@ gst_inter_audio_src_stop (GstBaseSrc * src)
 
   GST_DEBUG_OBJECT (interaudiosrc, "stop");
 
+  g_mutex_lock (&interaudiosrc->surface->mutex);
+  interaudiosrc->surface->audio_reader = FALSE;
+  g_mutex_unlock (&interaudiosrc->surface->mutex);
+
   gst_inter_surface_unref (interaudiosrc->surface);
   interaudiosrc->surface = NULL;
 
+  if (interaudiosrc->ring) {
+    gst_inter_audio_ring_unref (interaudiosrc->ring);
+    interaudiosrc->ring = NULL;
+  }
+
   return TRUE;
 }
 
@@ -335,79 +422,94 @@ gst_inter_audio_src_create (GstBaseSrc * src, guint64 offset, guint size,
     GstBuffer ** buf)
 {
   GstInterAudioSrc *interaudiosrc = GST_INTER_AUDIO_SRC (src);
+  GstInterSurface *surface = interaudiosrc->surface;
+  GstInterAudioRing *ring;
   GstCaps *caps;
   GstBuffer *buffer;
-  guint n, bpf;
-  guint64 period_time;
+  GstMapInfo map;
+  guint n, bpf, silence;
   guint64 period_samples;
 
   GST_DEBUG_OBJECT (interaudiosrc, "create");
 
-  buffer = NULL;
   caps = NULL;
 
-  g_mutex_lock (&interaudiosrc->surface->mutex);
-  if (interaudiosrc->surface->audio_info.finfo) {
-    if (!gst_audio_info_is_equal (&interaudiosrc->surface->audio_info,
-            &interaudiosrc->info)) {
-      caps = gst_audio_info_to_caps (&interaudiosrc->surface->audio_info);
-      interaudiosrc->timestamp_offset +=
-          gst_util_uint64_scale (interaudiosrc->n_samples, GST_SECOND,
-          interaudiosrc->info.rate);
-      interaudiosrc->n_samples = 0;
+  /* The ring is replaced whenever the audio info of the sink changes, so we
+   * only need to take the lock and check it then */
+  ring = g_atomic_pointer_get (&surface->audio_ring);
+  if (ring != interaudiosrc->ring) {
+    g_mutex_lock (&surface->mutex);
+    if (surface->audio_info.finfo) {
+      if (!gst_audio_info_is_equal (&surface->audio_info,
+              &interaudiosrc->info)) {
+        caps = gst_audio_info_to_caps (&surface->audio_info);
+        interaudiosrc->timestamp_offset +=
+            gst_util_uint64_scale (interaudiosrc->n_samples, GST_SECOND,
+            interaudiosrc->info.rate);
+        interaudiosrc->n_samples = 0;
+      }
     }
-  }
-
-  bpf = interaudiosrc->surface->audio_info.bpf;
-  period_time = interaudiosrc->surface->audio_period_time;
-  period_samples =
-      gst_util_uint64_scale (period_time, interaudiosrc->info.rate, GST_SECOND);
 
-  if (bpf > 0)
-    n = gst_adapter_available (interaudiosrc->surface->audio_adapter) / bpf;
-  else
-    n = 0;
-
-  if (n > period_samples)
-    n = period_samples;
-  if (n > 0) {
-    buffer = gst_adapter_take_buffer (interaudiosrc->surface->audio_adapter,
-        n * bpf);
-  } else {
-    buffer = gst_buffer_new ();
-    GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_GAP);
+    if (interaudiosrc->ring)
+      gst_inter_audio_ring_unref (interaudiosrc->ring);
+    ring = surface->audio_ring;
+    interaudiosrc->ring = ring ? gst_inter_audio_ring_ref (ring) : NULL;
+    g_mutex_unlock (&surface->mutex);
+
+    /* Start with latency-time of audio, whatever the sink wrote before */
+    if (ring)
+      gst_inter_audio_ring_skip (ring, MIN (ring->max_fill,
+              gst_util_uint64_scale (ring->rate, interaudiosrc->latency_time,
+                  GST_SECOND) * ring->bpf));
   }
-  g_mutex_unlock (&interaudiosrc->surface->mutex);
 
   if (caps) {
     gboolean ret = gst_base_src_set_caps (src, caps);
-    gst_caps_unref (caps);
     if (!ret) {
       GST_ERROR_OBJECT (src, "Failed to set caps %" GST_PTR_FORMAT, caps);
-      if (buffer)
-        gst_buffer_unref (buffer);
+      gst_caps_unref (caps);
       return GST_FLOW_NOT_NEGOTIATED;
     }
+    gst_caps_unref (caps);
   }
 
-  buffer = gst_buffer_make_writable (buffer);
-
   bpf = interaudiosrc->info.bpf;
-  if (n < period_samples) {
-    GstMapInfo map;
-    GstMemory *mem;
-
+  period_samples = gst_util_uint64_scale (interaudiosrc->period_time,
+      interaudiosrc->info.rate, GST_SECOND);
+
+  buffer = gst_buffer_new_allocate (NULL, period_samples * bpf, NULL);
+  gst_buffer_map (buffer, &map, GST_MAP_WRITE);
+
+  /* The silence for the missing samples goes first, so that the samples we
+   * have stay right after the ones of the previous period */
+  n = 0;
+  if (ring && ring->bpf == bpf) {
+    n = MIN (gst_inter_audio_ring_get_fill (ring), map.size);
+    n -= n % bpf;
+  }
+  silence = map.size - n;
+  if (silence > 0) {
     GST_DEBUG_OBJECT (interaudiosrc,
-        "creating %" G_GUINT64_FORMAT " samples of silence",
-        period_samples - n);
-    mem = gst_allocator_alloc (NULL, (period_samples - n) * bpf, NULL);
-    if (gst_memory_map (mem, &map, GST_MAP_WRITE)) {
-      gst_audio_format_fill_silence (interaudiosrc->info.finfo, map.data,
-          map.size);
-      gst_memory_unmap (mem, &map);
-    }
-    gst_buffer_prepend_memory (buffer, mem);
+        "creating %u samples of silence", bpf ? silence / bpf : 0);
+    gst_audio_format_fill_silence (interaudiosrc->info.finfo, map.data,
+        silence);
+  }
+  if (n > 0)
+    gst_inter_audio_ring_read (ring, map.data + silence, n);
+
+  gst_buffer_unmap (buffer, &map);
+
+  if (n == 0)
+    GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_GAP);
+
+  if (ring) {
+    interaudiosrc->fill_level =
+        gst_util_uint64_scale (gst_inter_audio_ring_get_fill (ring) /
+        ring->bpf, GST_SECOND, ring->rate);
+    interaudiosrc->avg_fill_level += ((gdouble) interaudiosrc->fill_level -
+        interaudiosrc->avg_fill_level) / FILL_LEVEL_PERIODS;
   }
+
   n = period_samples;
 
   GST_BUFFER_OFFSET (buffer) = interaudiosrc->n_samples;
@@ -46,6 +46,11 @@ struct _GstInterAudioSrc
   GstClockTime timestamp_offset;
   GstAudioInfo info;
   guint64 buffer_time, latency_time, period_time;
+
+  /* the audio ring of the surface we read from */
+  GstInterAudioRing *ring;
+  GstClockTime fill_level;
+  gdouble avg_fill_level;
 };
 
 struct _GstInterAudioSrcClass
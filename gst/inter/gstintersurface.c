@@ -48,7 +48,7 @@ gst_inter_surface_get (const char *name)
   surface->ref_count = 1;
   surface->name = g_strdup (name);
   g_mutex_init (&surface->mutex);
-  surface->audio_adapter = gst_adapter_new ();
+  g_cond_init (&surface->video_cond);
   surface->audio_buffer_time = DEFAULT_AUDIO_BUFFER_TIME;
   surface->audio_latency_time = DEFAULT_AUDIO_LATENCY_TIME;
   surface->audio_period_time = DEFAULT_AUDIO_PERIOD_TIME;
@@ -68,6 +68,7 @@ gst_inter_surface_unref (GstInterSurface * surface)
   g_mutex_lock (&mutex);
   if ((--surface->ref_count) == 0) {
     GList *g;
+    guint i;
 
     for (g = list; g; g = g_list_next (g)) {
       GstInterSurface *tmp = g->data;
@@ -78,11 +79,210 @@ gst_inter_surface_unref (GstInterSurface * surface)
     }
 
     g_mutex_clear (&surface->mutex);
-    gst_buffer_replace (&surface->video_buffer, NULL);
+    g_cond_clear (&surface->video_cond);
+    for (i = 0; i < GST_INTER_SURFACE_VIDEO_SLOTS; i++)
+      gst_buffer_replace (&surface->video_slots[i].buffer, NULL);
     gst_buffer_replace (&surface->sub_buffer, NULL);
-    gst_object_unref (surface->audio_adapter);
+    if (surface->audio_ring)
+      gst_inter_audio_ring_unref (surface->audio_ring);
     g_free (surface->name);
     g_free (surface);
   }
   g_mutex_unlock (&mutex);
 }
+
+/* Makes @buffer the new frame of @surface, in place of the oldest one. Takes
+ * ownership of @buffer, which may be NULL for no frame. There must only be
+ * one producer at a time, which is also the only one changing the video
+ * info. */
+void
+gst_inter_surface_push_video (GstInterSurface * surface, GstBuffer * buffer)
+{
+  GstInterSurfaceSlot *slot;
+  GstBuffer *old;
+  guint seq;
+
+  seq = g_atomic_int_get (&surface->video_seq) + 1;
+  slot = &surface->video_slots[seq % GST_INTER_SURFACE_VIDEO_SLOTS];
+
+  /* only contends with a consumer reading this slot at the same time */
+  g_bit_lock (&slot->lock, 0);
+  old = slot->buffer;
+  slot->buffer = buffer;
+  slot->seq = seq;
+  slot->info_seq = surface->video_info_seq;
+  g_bit_unlock (&slot->lock, 0);
+
+  /* Full barrier: a consumer starting to wait either sees the new seq, or
+   * is seen here */
+  g_atomic_int_set (&surface->video_seq, seq);
+  if (g_atomic_int_get (&surface->video_waiters) > 0)
+    gst_inter_surface_wake_video (surface);
+
+  if (old)
+    gst_buffer_unref (old);
+}
+
+/* Replaces all the frames of @surface with no frame */
+void
+gst_inter_surface_clear_video (GstInterSurface * surface)
+{
+  guint i;
+
+  for (i = 0; i < GST_INTER_SURFACE_VIDEO_SLOTS; i++)
+    gst_inter_surface_push_video (surface, NULL);
+}
+
+/* Gets a new reference to frame @seq of @surface in @buffer, NULL if it was
+ * pushed as no frame, and the video info seq it was pushed with in
+ * @info_seq. Returns FALSE if the frame is not in the ring, because it was
+ * already replaced or was not pushed yet. */
+gboolean
+gst_inter_surface_get_video (GstInterSurface * surface, guint seq,
+    GstBuffer ** buffer, guint * info_seq)
+{
+  GstInterSurfaceSlot *slot;
+  gboolean ret = FALSE;
+
+  slot = &surface->video_slots[seq % GST_INTER_SURFACE_VIDEO_SLOTS];
+
+  g_bit_lock (&slot->lock, 0);
+  if (slot->seq == seq) {
+    *buffer = slot->buffer ? gst_buffer_ref (slot->buffer) : NULL;
+    *info_seq = slot->info_seq;
+    ret = TRUE;
+  }
+  g_bit_unlock (&slot->lock, 0);
+
+  return ret;
+}
+
+/* Wakes up the consumers waiting for a new frame */
+void
+gst_inter_surface_wake_video (GstInterSurface * surface)
+{
+  g_mutex_lock (&surface->mutex);
+  g_cond_broadcast (&surface->video_cond);
+  g_mutex_unlock (&surface->mutex);
+}
+
+/* Replaces the audio ring of @surface with an empty one for the current
+ * audio info and buffer time, or none if there is no audio info. The sink
+ * and the source switch to it the next time they access the ring. Must be
+ * called with the surface mutex. */
+void
+gst_inter_surface_reset_audio (GstInterSurface * surface)
+{
+  GstInterAudioRing *ring = NULL, *old;
+  guint64 max_fill;
+
+  if (surface->audio_info.finfo && surface->audio_info.bpf > 0 &&
+      surface->audio_info.rate > 0) {
+    ring = g_new0 (GstInterAudioRing, 1);
+    ring->ref_count = 1;
+    ring->bpf = surface->audio_info.bpf;
+    ring->rate = surface->audio_info.rate;
+
+    max_fill = gst_util_uint64_scale (surface->audio_buffer_time, ring->rate,
+        GST_SECOND) * ring->bpf;
+    max_fill = CLAMP (max_fill, ring->bpf, G_MAXINT / 2);
+    ring->max_fill = max_fill - max_fill % ring->bpf;
+    ring->size = 1 << g_bit_storage (ring->max_fill - 1);
+    ring->data = g_malloc (ring->size);
+  }
+
+  old = surface->audio_ring;
+  g_atomic_pointer_set (&surface->audio_ring, ring);
+  if (old)
+    gst_inter_audio_ring_unref (old);
+}
+
+GstInterAudioRing *
+gst_inter_audio_ring_ref (GstInterAudioRing * ring)
+{
+  g_atomic_int_inc (&ring->ref_count);
+
+  return ring;
+}
+
+void
+gst_inter_audio_ring_unref (GstInterAudioRing * ring)
+{
+  if (g_atomic_int_dec_and_test (&ring->ref_count)) {
+    g_free (ring->data);
+    g_free (ring);
+  }
+}
+
+/* Returns the number of bytes queued in @ring */
+guint
+gst_inter_audio_ring_get_fill (GstInterAudioRing * ring)
+{
+  return g_atomic_int_get (&ring->write_pos) -
+      g_atomic_int_get (&ring->read_pos);
+}
+
+/* Copies as many whole frames of @data as fit into @ring, and returns the
+ * number of bytes copied. Only called by the sink. */
+guint
+gst_inter_audio_ring_write (GstInterAudioRing * ring, const guint8 * data,
+    guint size)
+{
+  guint pos, offset, fill, space, n;
+
+  pos = ring->write_pos;
+  /* Never trust the read position to keep the fill within max_fill, a
+   * wrapped space would let the copy run over the other data */
+  fill = pos - g_atomic_int_get (&ring->read_pos);
+  space = fill < ring->max_fill ? ring->max_fill - fill : 0;
+  size = MIN (size, space);
+  size -= size % ring->bpf;
+
+  offset = pos & (ring->size - 1);
+  n = MIN (size, ring->size - offset);
+  memcpy (ring->data + offset, data, n);
+  memcpy (ring->data, data + n, size - n);
+
+  /* publishes the data to the source */
+  g_atomic_int_set (&ring->write_pos, pos + size);
+
+  return size;
+}
+
+/* Copies up to @size bytes of whole frames out of @ring into @data, and
+ * returns the number of bytes copied. Only called by the source. */
+guint
+gst_inter_audio_ring_read (GstInterAudioRing * ring, guint8 * data,
+    guint size)
+{
+  guint pos, offset, n;
+
+  pos = ring->read_pos;
+  size = MIN (size, g_atomic_int_get (&ring->write_pos) - pos);
+  size -= size % ring->bpf;
+
+  offset = pos & (ring->size - 1);
+  n = MIN (size, ring->size - offset);
+  memcpy (data, ring->data + offset, n);
+  memcpy (data + n, ring->data, size - n);
+
+  /* gives the space back to the sink */
+  g_atomic_int_set (&ring->read_pos, pos + size);
+
+  return size;
+}
+
+/* Drops the oldest data of @ring to leave at most @keep bytes queued. Only
+ * called by the source. */
+void
+gst_inter_audio_ring_skip (GstInterAudioRing * ring, guint keep)
+{
+  guint fill;
+
+  fill = gst_inter_audio_ring_get_fill (ring);
+  if (fill > keep) {
+    fill -= keep;
+    fill += (ring->bpf - fill % ring->bpf) % ring->bpf;
+    g_atomic_int_set (&ring->read_pos, ring->read_pos + fill);
+  }
+}
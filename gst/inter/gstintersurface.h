@@ -27,6 +27,41 @@
 G_BEGIN_DECLS
 
 typedef struct _GstInterSurface GstInterSurface;
+typedef struct _GstInterSurfaceSlot GstInterSurfaceSlot;
+typedef struct _GstInterAudioRing GstInterAudioRing;
+
+/* Number of the last video frames kept by the surface, a power of two */
+#define GST_INTER_SURFACE_VIDEO_SLOTS 4
+
+struct _GstInterSurfaceSlot
+{
+  /* bit 0 is locked with g_bit_lock() while the slot is accessed */
+  volatile gint lock;
+  guint seq;
+  /* video_info_seq of the surface when the frame was pushed */
+  guint info_seq;
+  GstBuffer *buffer;
+};
+
+/* Ring of interleaved samples, written by one interaudiosink and read by one
+ * interaudiosrc without locking. The positions are in bytes and wrap around
+ * at G_MAXUINT, which is fine as the size is a power of two. Only one
+ * source can read the ring, see audio_reader. */
+struct _GstInterAudioRing
+{
+  gint ref_count;
+
+  guint8 *data;
+  guint size;
+  /* at most buffer-time of whole frames are queued */
+  guint max_fill;
+  guint bpf;
+  gint rate;
+
+  /* only written by the sink and the source respectively */
+  volatile guint write_pos;
+  volatile guint read_pos;
+};
 
 struct _GstInterSurface
 {
@@ -37,17 +72,30 @@ struct _GstInterSurface
 
   /* video */
   GstVideoInfo video_info;
-  int video_buffer_count;
+  /* incremented with the mutex held whenever video_info changes */
+  guint video_info_seq;
+
+  /* The last frames, frame seq is in slot seq % GST_INTER_SURFACE_VIDEO_SLOTS.
+   * Only written by gst_inter_surface_push_video(), and read with
+   * gst_inter_surface_get_video() without taking the mutex. A consumer
+   * that wants to wait for a new frame increments video_waiters and waits
+   * on video_cond with the mutex until video_seq changes. */
+  GstInterSurfaceSlot video_slots[GST_INTER_SURFACE_VIDEO_SLOTS];
+  volatile guint video_seq;
+  volatile gint video_waiters;
+  GCond video_cond;
 
   /* audio */
   GstAudioInfo audio_info;
   guint64 audio_buffer_time;
   guint64 audio_latency_time;
   guint64 audio_period_time;
+  /* replaced with the mutex held, and then always read atomically */
+  GstInterAudioRing *audio_ring;
+  /* set with the mutex held while an interaudiosrc reads the ring */
+  gboolean audio_reader;
 
-  GstBuffer *video_buffer;
   GstBuffer *sub_buffer;
-  GstAdapter *audio_adapter;
 };
 
 #define DEFAULT_AUDIO_BUFFER_TIME  (GST_SECOND)
@@ -58,6 +106,24 @@ struct _GstInterSurface
 GstInterSurface * gst_inter_surface_get (const char *name);
 void gst_inter_surface_unref (GstInterSurface *surface);
 
+void gst_inter_surface_push_video (GstInterSurface *surface,
+    GstBuffer *buffer);
+void gst_inter_surface_clear_video (GstInterSurface *surface);
+gboolean gst_inter_surface_get_video (GstInterSurface *surface, guint seq,
+    GstBuffer **buffer, guint *info_seq);
+void gst_inter_surface_wake_video (GstInterSurface *surface);
+
+void gst_inter_surface_reset_audio (GstInterSurface *surface);
+
+GstInterAudioRing * gst_inter_audio_ring_ref (GstInterAudioRing *ring);
+void gst_inter_audio_ring_unref (GstInterAudioRing *ring);
+guint gst_inter_audio_ring_get_fill (GstInterAudioRing *ring);
+guint gst_inter_audio_ring_write (GstInterAudioRing *ring,
+    const guint8 *data, guint size);
+guint gst_inter_audio_ring_read (GstInterAudioRing *ring, guint8 *data,
+    guint size);
+void gst_inter_audio_ring_skip (GstInterAudioRing *ring, guint keep);
+
 
 G_END_DECLS
 
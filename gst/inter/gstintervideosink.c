@@ -199,6 +199,7 @@ gst_inter_video_sink_start (GstBaseSink * sink)
   intervideosink->surface = gst_inter_surface_get (intervideosink->channel);
   g_mutex_lock (&intervideosink->surface->mutex);
   memset (&intervideosink->surface->video_info, 0, sizeof (GstVideoInfo));
+  intervideosink->surface->video_info_seq++;
   g_mutex_unlock (&intervideosink->surface->mutex);
 
   return TRUE;
@@ -210,13 +211,12 @@ gst_inter_video_sink_stop (GstBaseSink * sink)
   GstInterVideoSink *intervideosink = GST_INTER_VIDEO_SINK (sink);
 
   g_mutex_lock (&intervideosink->surface->mutex);
-  if (intervideosink->surface->video_buffer) {
-    gst_buffer_unref (intervideosink->surface->video_buffer);
-  }
-  intervideosink->surface->video_buffer = NULL;
   memset (&intervideosink->surface->video_info, 0, sizeof (GstVideoInfo));
+  intervideosink->surface->video_info_seq++;
   g_mutex_unlock (&intervideosink->surface->mutex);
 
+  gst_inter_surface_clear_video (intervideosink->surface);
+
   gst_inter_surface_unref (intervideosink->surface);
   intervideosink->surface = NULL;
 
@@ -236,6 +236,7 @@ gst_inter_video_sink_set_caps (GstBaseSink * sink, GstCaps * caps)
 
   g_mutex_lock (&intervideosink->surface->mutex);
   intervideosink->surface->video_info = info;
+  intervideosink->surface->video_info_seq++;
   intervideosink->info = info;
   g_mutex_unlock (&intervideosink->surface->mutex);
 
@@ -250,13 +251,8 @@ gst_inter_video_sink_show_frame (GstVideoSink * sink, GstBuffer * buffer)
   GST_DEBUG_OBJECT (intervideosink, "render ts %" GST_TIME_FORMAT,
       GST_TIME_ARGS (GST_BUFFER_PTS (buffer)));
 
-  g_mutex_lock (&intervideosink->surface->mutex);
-  if (intervideosink->surface->video_buffer) {
-    gst_buffer_unref (intervideosink->surface->video_buffer);
-  }
-  intervideosink->surface->video_buffer = gst_buffer_ref (buffer);
-  intervideosink->surface->video_buffer_count = 0;
-  g_mutex_unlock (&intervideosink->surface->mutex);
+  gst_inter_surface_push_video (intervideosink->surface,
+      gst_buffer_ref (buffer));
 
   return GST_FLOW_OK;
 }
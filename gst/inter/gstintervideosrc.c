@@ -32,6 +32,14 @@
  * The intersubsrc element cannot be used effectively with gst-launch-1.0,
  * as it requires a second pipeline in the application to send subtitles.
  *
+ * The intervideosink keeps its last few frames, so that several
+ * intervideosrc can read them without blocking it. By default, the source
+ * outputs the latest frame at its own frame rate, repeating or skipping
+ * frames as needed. With #GstInterVideoSrc:wait-for-frame, it outputs every
+ * frame that was not replaced yet instead, waiting for the next one when
+ * it has output them all. The #GstInterVideoSrc:drop and
+ * #GstInterVideoSrc:duplicate properties count the frames that were
+ * skipped and repeated.
  */
 
 #ifdef HAVE_CONFIG_H
@@ -60,6 +68,8 @@ static gboolean gst_inter_video_src_set_caps (GstBaseSrc * src, GstCaps * caps);
 static GstCaps *gst_inter_video_src_fixate (GstBaseSrc * src, GstCaps * caps);
 static gboolean gst_inter_video_src_start (GstBaseSrc * src);
 static gboolean gst_inter_video_src_stop (GstBaseSrc * src);
+static gboolean gst_inter_video_src_unlock (GstBaseSrc * src);
+static gboolean gst_inter_video_src_unlock_stop (GstBaseSrc * src);
 static void
 gst_inter_video_src_get_times (GstBaseSrc * src, GstBuffer * buffer,
     GstClockTime * start, GstClockTime * end);
@@ -71,11 +81,15 @@ enum
 {
   PROP_0,
   PROP_CHANNEL,
-  PROP_TIMEOUT
+  PROP_TIMEOUT,
+  PROP_WAIT_FOR_FRAME,
+  PROP_DROP,
+  PROP_DUPLICATE
 };
 
 #define DEFAULT_CHANNEL ("default")
 #define DEFAULT_TIMEOUT (GST_SECOND)
+#define DEFAULT_WAIT_FOR_FRAME (FALSE)
 
 /* pad templates */
 static GstStaticPadTemplate gst_inter_video_src_src_template =
@@ -117,6 +131,9 @@ gst_inter_video_src_class_init (GstInterVideoSrcClass * klass)
   base_src_class->fixate = GST_DEBUG_FUNCPTR (gst_inter_video_src_fixate);
   base_src_class->start = GST_DEBUG_FUNCPTR (gst_inter_video_src_start);
   base_src_class->stop = GST_DEBUG_FUNCPTR (gst_inter_video_src_stop);
+  base_src_class->unlock = GST_DEBUG_FUNCPTR (gst_inter_video_src_unlock);
+  base_src_class->unlock_stop =
+      GST_DEBUG_FUNCPTR (gst_inter_video_src_unlock_stop);
   base_src_class->get_times = GST_DEBUG_FUNCPTR (gst_inter_video_src_get_times);
   base_src_class->create = GST_DEBUG_FUNCPTR (gst_inter_video_src_create);
 
@@ -130,6 +147,45 @@ gst_inter_video_src_class_init (GstInterVideoSrcClass * klass)
           "Timeout after which to start outputting black frames",
           0, G_MAXUINT64, DEFAULT_TIMEOUT,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstInterVideoSrc:wait-for-frame:
+   *
+   * Output every frame of the intervideosink that is still kept by the
+   * channel, and wait up to #GstInterVideoSrc:timeout for a new one
+   * instead of repeating the last frame, or forever if the timeout is 0. A
+   * black frame is output when the timeout expires. The frames are then
+   * timestamped with the running time at which they are output.
+   *
+   * Since: 1.14
+   */
+  g_object_class_install_property (gobject_class, PROP_WAIT_FOR_FRAME,
+      g_param_spec_boolean ("wait-for-frame", "Wait for frame",
+          "Wait for new frames instead of repeating the last one",
+          DEFAULT_WAIT_FOR_FRAME, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstInterVideoSrc:drop:
+   *
+   * Number of frames of the intervideosink that were not output.
+   *
+   * Since: 1.14
+   */
+  g_object_class_install_property (gobject_class, PROP_DROP,
+      g_param_spec_uint64 ("drop", "Drop", "Number of dropped frames",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstInterVideoSrc:duplicate:
+   *
+   * Number of frames of the intervideosink that were output more than once.
+   *
+   * Since: 1.14
+   */
+  g_object_class_install_property (gobject_class, PROP_DUPLICATE,
+      g_param_spec_uint64 ("duplicate", "Duplicate",
+          "Number of duplicated frames", 0, G_MAXUINT64, 0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 }
 
 static void
@@ -140,6 +196,7 @@ gst_inter_video_src_init (GstInterVideoSrc * intervideosrc)
 
   intervideosrc->channel = g_strdup (DEFAULT_CHANNEL);
   intervideosrc->timeout = DEFAULT_TIMEOUT;
+  intervideosrc->wait_for_frame = DEFAULT_WAIT_FOR_FRAME;
 }
 
 void
@@ -156,6 +213,9 @@ gst_inter_video_src_set_property (GObject * object, guint property_id,
     case PROP_TIMEOUT:
       intervideosrc->timeout = g_value_get_uint64 (value);
       break;
+    case PROP_WAIT_FOR_FRAME:
+      intervideosrc->wait_for_frame = g_value_get_boolean (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -175,6 +235,15 @@ gst_inter_video_src_get_property (GObject * object, guint property_id,
     case PROP_TIMEOUT:
       g_value_set_uint64 (value, intervideosrc->timeout);
       break;
+    case PROP_WAIT_FOR_FRAME:
+      g_value_set_boolean (value, intervideosrc->wait_for_frame);
+      break;
+    case PROP_DROP:
+      g_value_set_uint64 (value, intervideosrc->dropped);
+      break;
+    case PROP_DUPLICATE:
+      g_value_set_uint64 (value, intervideosrc->duplicated);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -277,6 +346,16 @@ gst_inter_video_src_start (GstBaseSrc * src)
   intervideosrc->timestamp_offset = 0;
   intervideosrc->n_frames = 0;
 
+  /* start with the latest frame, if any */
+  intervideosrc->video_seq =
+      g_atomic_int_get (&intervideosrc->surface->video_seq);
+  if (intervideosrc->video_seq > 0)
+    intervideosrc->video_seq--;
+  intervideosrc->video_count = 0;
+  intervideosrc->flushing = FALSE;
+  intervideosrc->dropped = 0;
+  intervideosrc->duplicated = 0;
+
   return TRUE;
 }
 
@@ -294,6 +373,39 @@ gst_inter_video_src_stop (GstBaseSrc * src)
   return TRUE;
 }
 
+static gboolean
+gst_inter_video_src_unlock (GstBaseSrc * src)
+{
+  GstInterVideoSrc *intervideosrc = GST_INTER_VIDEO_SRC (src);
+
+  GST_DEBUG_OBJECT (intervideosrc, "unlock");
+
+  if (intervideosrc->surface) {
+    g_mutex_lock (&intervideosrc->surface->mutex);
+    intervideosrc->flushing = TRUE;
+    g_cond_broadcast (&intervideosrc->surface->video_cond);
+    g_mutex_unlock (&intervideosrc->surface->mutex);
+  }
+
+  return TRUE;
+}
+
+static gboolean
+gst_inter_video_src_unlock_stop (GstBaseSrc * src)
+{
+  GstInterVideoSrc *intervideosrc = GST_INTER_VIDEO_SRC (src);
+
+  GST_DEBUG_OBJECT (intervideosrc, "unlock_stop");
+
+  if (intervideosrc->surface) {
+    g_mutex_lock (&intervideosrc->surface->mutex);
+    intervideosrc->flushing = FALSE;
+    g_mutex_unlock (&intervideosrc->surface->mutex);
+  }
+
+  return TRUE;
+}
+
 static void
 gst_inter_video_src_get_times (GstBaseSrc * src, GstBuffer * buffer,
     GstClockTime * start, GstClockTime * end)
@@ -319,6 +431,80 @@ gst_inter_video_src_get_times (GstBaseSrc * src, GstBuffer * buffer,
   }
 }
 
+/* Waits up to @end_time, or forever if the timeout is 0, for a frame newer
+ * than the last one output. Returns FALSE if flushing. */
+static gboolean
+gst_inter_video_src_wait_frame (GstInterVideoSrc * intervideosrc,
+    gint64 end_time)
+{
+  GstInterSurface *surface = intervideosrc->surface;
+  gboolean flushing;
+
+  g_mutex_lock (&surface->mutex);
+  g_atomic_int_inc (&surface->video_waiters);
+  while (!intervideosrc->flushing &&
+      g_atomic_int_get (&surface->video_seq) == intervideosrc->video_seq) {
+    if (intervideosrc->timeout == 0)
+      g_cond_wait (&surface->video_cond, &surface->mutex);
+    else if (!g_cond_wait_until (&surface->video_cond, &surface->mutex,
+            end_time))
+      break;
+  }
+  g_atomic_int_add (&surface->video_waiters, -1);
+  flushing = intervideosrc->flushing;
+  g_mutex_unlock (&surface->mutex);
+
+  return !flushing;
+}
+
+/* Takes the next frame to output from the surface, the oldest one not
+ * output yet when waiting for frames and the latest one otherwise. Frames
+ * that were not pushed with video info @info_seq are skipped. Returns FALSE
+ * if there is no new frame. Must be called with the surface mutex, so that
+ * the video info does not change meanwhile. */
+static gboolean
+gst_inter_video_src_next_frame (GstInterVideoSrc * intervideosrc,
+    guint info_seq, GstBuffer ** buffer)
+{
+  GstInterSurface *surface = intervideosrc->surface;
+  guint head, seq, frame_info_seq;
+
+  for (;;) {
+    /* the producer may replace the frame before we get it */
+    do {
+      head = g_atomic_int_get (&surface->video_seq);
+      if (head == intervideosrc->video_seq)
+        return FALSE;
+
+      if (!intervideosrc->wait_for_frame)
+        seq = head;
+      else if (head - intervideosrc->video_seq > GST_INTER_SURFACE_VIDEO_SLOTS)
+        seq = head - GST_INTER_SURFACE_VIDEO_SLOTS + 1;
+      else
+        seq = intervideosrc->video_seq + 1;
+    } while (!gst_inter_surface_get_video (surface, seq, buffer,
+            &frame_info_seq));
+
+    if (seq - intervideosrc->video_seq > 1) {
+      GST_LOG_OBJECT (intervideosrc, "Dropped %u frames",
+          seq - intervideosrc->video_seq - 1);
+      intervideosrc->dropped += seq - intervideosrc->video_seq - 1;
+    }
+    intervideosrc->video_seq = seq;
+
+    if (frame_info_seq == info_seq)
+      return TRUE;
+
+    /* Pushed before the caps changed, it does not match the video info */
+    if (*buffer) {
+      GST_LOG_OBJECT (intervideosrc, "Dropping frame %u with old caps", seq);
+      gst_buffer_unref (*buffer);
+      *buffer = NULL;
+      intervideosrc->dropped++;
+    }
+  }
+}
+
 static GstFlowReturn
 gst_inter_video_src_create (GstBaseSrc * src, guint64 offset, guint size,
     GstBuffer ** buf)
@@ -327,7 +513,10 @@ gst_inter_video_src_create (GstBaseSrc * src, guint64 offset, guint size,
   GstCaps *caps;
   GstBuffer *buffer;
   guint64 frames;
-  gboolean is_gap = FALSE;
+  guint info_seq, frame_info_seq;
+  gint64 end_time;
+  gboolean have_frame, is_gap = FALSE;
+  GstClockTime running_time = GST_CLOCK_TIME_NONE;
 
   GST_DEBUG_OBJECT (intervideosrc, "create");
 
@@ -338,7 +527,26 @@ gst_inter_video_src_create (GstBaseSrc * src, guint64 offset, guint size,
       GST_VIDEO_INFO_FPS_N (&intervideosrc->info),
       GST_VIDEO_INFO_FPS_D (&intervideosrc->info) * GST_SECOND);
 
-  g_mutex_lock (&intervideosrc->surface->mutex);
+  end_time = g_get_monotonic_time () + intervideosrc->timeout / GST_USECOND;
+
+  /* The frame is taken with the video info it was pushed with, the sink
+   * cannot change the info before we are done. When waiting, frames that
+   * were pushed with the previous info do not end the wait. */
+  for (;;) {
+    if (intervideosrc->wait_for_frame &&
+        !gst_inter_video_src_wait_frame (intervideosrc, end_time))
+      return GST_FLOW_FLUSHING;
+
+    g_mutex_lock (&intervideosrc->surface->mutex);
+    info_seq = intervideosrc->surface->video_info_seq;
+    have_frame = gst_inter_video_src_next_frame (intervideosrc, info_seq,
+        &buffer);
+    if (have_frame || !intervideosrc->wait_for_frame ||
+        (intervideosrc->timeout != 0 && g_get_monotonic_time () >= end_time))
+      break;
+    g_mutex_unlock (&intervideosrc->surface->mutex);
+  }
+
   if (intervideosrc->surface->video_info.finfo) {
     GstVideoInfo tmp_info = intervideosrc->surface->video_info;
 
@@ -360,25 +568,46 @@ gst_inter_video_src_create (GstBaseSrc * src, guint64 offset, guint size,
     }
   }
 
-  if (intervideosrc->surface->video_buffer) {
-    /* We have a buffer to push */
-    buffer = gst_buffer_ref (intervideosrc->surface->video_buffer);
+  g_mutex_unlock (&intervideosrc->surface->mutex);
 
-    /* Can only be true if timeout > 0 */
-    if (intervideosrc->surface->video_buffer_count == frames) {
-      gst_buffer_unref (intervideosrc->surface->video_buffer);
-      intervideosrc->surface->video_buffer = NULL;
+  if (have_frame) {
+    intervideosrc->video_count = 0;
+  } else if (intervideosrc->wait_for_frame) {
+    /* Timed out, output a black frame */
+    is_gap = TRUE;
+  } else if (intervideosrc->video_count <= frames) {
+    /* Repeat the last frame until the timeout, unless it was replaced */
+    if (gst_inter_surface_get_video (intervideosrc->surface,
+            intervideosrc->video_seq, &buffer, &frame_info_seq) && buffer) {
+      if (frame_info_seq == info_seq) {
+        intervideosrc->duplicated++;
+      } else {
+        gst_buffer_unref (buffer);
+        buffer = NULL;
+      }
     }
   }
 
-  if (intervideosrc->surface->video_buffer_count != 0 &&
-      intervideosrc->surface->video_buffer_count != (frames + 1)) {
-    /* This is a repeat of the stored buffer or of a black frame */
+  if (!intervideosrc->wait_for_frame && intervideosrc->video_count != 0 &&
+      intervideosrc->video_count != (frames + 1)) {
+    /* This is a repeat of the last frame or of a black frame */
     is_gap = TRUE;
   }
 
-  intervideosrc->surface->video_buffer_count++;
-  g_mutex_unlock (&intervideosrc->surface->mutex);
+  intervideosrc->video_count++;
+
+  if (intervideosrc->wait_for_frame) {
+    GstClock *clock;
+
+    /* The frames come at the rate of the producer, timestamp them with
+     * the time they are output at instead of our own frame rate */
+    clock = gst_element_get_clock (GST_ELEMENT_CAST (src));
+    if (clock) {
+      running_time = gst_clock_get_time (clock) -
+          gst_element_get_base_time (GST_ELEMENT_CAST (src));
+      gst_object_unref (clock);
+    }
+  }
 
   if (caps) {
     gboolean ret;
@@ -451,17 +680,25 @@ gst_inter_video_src_create (GstBaseSrc * src, guint64 offset, guint size,
   if (is_gap)
     GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_GAP);
 
-  GST_BUFFER_PTS (buffer) = intervideosrc->timestamp_offset +
-      gst_util_uint64_scale (GST_SECOND * intervideosrc->n_frames,
-      GST_VIDEO_INFO_FPS_D (&intervideosrc->info),
-      GST_VIDEO_INFO_FPS_N (&intervideosrc->info));
+  if (GST_CLOCK_TIME_IS_VALID (running_time)) {
+    GST_BUFFER_PTS (buffer) = running_time;
+    GST_BUFFER_DURATION (buffer) = gst_util_uint64_scale (GST_SECOND,
+        GST_VIDEO_INFO_FPS_D (&intervideosrc->info),
+        GST_VIDEO_INFO_FPS_N (&intervideosrc->info));
+  } else {
+    GST_BUFFER_PTS (buffer) = intervideosrc->timestamp_offset +
+        gst_util_uint64_scale (GST_SECOND * intervideosrc->n_frames,
+        GST_VIDEO_INFO_FPS_D (&intervideosrc->info),
+        GST_VIDEO_INFO_FPS_N (&intervideosrc->info));
+    GST_BUFFER_DURATION (buffer) = intervideosrc->timestamp_offset +
+        gst_util_uint64_scale (GST_SECOND * (intervideosrc->n_frames + 1),
+        GST_VIDEO_INFO_FPS_D (&intervideosrc->info),
+        GST_VIDEO_INFO_FPS_N (&intervideosrc->info)) -
+        GST_BUFFER_PTS (buffer);
+  }
   GST_BUFFER_DTS (buffer) = GST_CLOCK_TIME_NONE;
   GST_DEBUG_OBJECT (intervideosrc, "create ts %" GST_TIME_FORMAT,
       GST_TIME_ARGS (GST_BUFFER_PTS (buffer)));
-  GST_BUFFER_DURATION (buffer) = intervideosrc->timestamp_offset +
-      gst_util_uint64_scale (GST_SECOND * (intervideosrc->n_frames + 1),
-      GST_VIDEO_INFO_FPS_D (&intervideosrc->info),
-      GST_VIDEO_INFO_FPS_N (&intervideosrc->info)) - GST_BUFFER_PTS (buffer);
   GST_BUFFER_OFFSET (buffer) = intervideosrc->n_frames;
   GST_BUFFER_OFFSET_END (buffer) = -1;
   GST_BUFFER_FLAG_UNSET (buffer, GST_BUFFER_FLAG_DISCONT);
@@ -43,11 +43,20 @@ struct _GstInterVideoSrc
 
   char *channel;
   guint64 timeout;
+  gboolean wait_for_frame;
 
   GstVideoInfo info;
   GstBuffer *black_frame;
   int n_frames;
   GstClockTime timestamp_offset;
+
+  /* last frame taken from the surface, and number of frames output since */
+  guint video_seq;
+  guint video_count;
+  guint64 dropped;
+  guint64 duplicated;
+  /* protected by the surface mutex */
+  gboolean flushing;
 };
 
 struct _GstInterVideoSrcClass
@@ -177,23 +177,22 @@ mpegts_base_reset (MpegTSBase * base)
   MpegTSBaseClass *klass = GST_MPEGTS_BASE_GET_CLASS (base);
 
   mpegts_packetizer_clear (base->packetizer);
-  memset (base->is_pes, 0, 1024);
-  memset (base->known_psi, 0, 1024);
+  memset (base->pid_types, 0, MPEGTS_BASE_NB_PIDS);
 
   /* FIXME : Actually these are not *always* know SI streams
    * depending on the variant of mpeg-ts being used. */
 
   /* Known PIDs : PAT, TSDT, IPMP CIT */
-  MPEGTS_BIT_SET (base->known_psi, 0);
-  MPEGTS_BIT_SET (base->known_psi, 2);
-  MPEGTS_BIT_SET (base->known_psi, 3);
+  MPEGTS_BASE_SET_PSI (base, 0);
+  MPEGTS_BASE_SET_PSI (base, 2);
+  MPEGTS_BASE_SET_PSI (base, 3);
   /* TDT, TOT, ST */
-  MPEGTS_BIT_SET (base->known_psi, 0x14);
+  MPEGTS_BASE_SET_PSI (base, 0x14);
   /* network synchronization */
-  MPEGTS_BIT_SET (base->known_psi, 0x15);
+  MPEGTS_BASE_SET_PSI (base, 0x15);
 
   /* ATSC */
-  MPEGTS_BIT_SET (base->known_psi, 0x1ffb);
+  MPEGTS_BASE_SET_PSI (base, 0x1ffb);
 
   if (base->pat) {
     g_ptr_array_unref (base->pat);
@@ -236,8 +235,7 @@ mpegts_base_init (MpegTSBase * base)
       NULL, (GDestroyNotify) mpegts_base_free_program);
 
   base->parse_private_sections = FALSE;
-  base->is_pes = g_new0 (guint8, 1024);
-  base->known_psi = g_new0 (guint8, 1024);
+  base->pid_types = g_new0 (guint8, MPEGTS_BASE_NB_PIDS);
   base->program_size = sizeof (MpegTSBaseProgram);
   base->stream_size = sizeof (MpegTSBaseStream);
 
@@ -255,8 +253,7 @@ mpegts_base_dispose (GObject * object)
   if (!base->disposed) {
     g_object_unref (base->packetizer);
     base->disposed = TRUE;
-    g_free (base->known_psi);
-    g_free (base->is_pes);
+    g_free (base->pid_types);
   }
 
   if (G_OBJECT_CLASS (parent_class)->dispose)
@@ -411,11 +408,11 @@ mpegts_base_add_program (MpegTSBase * base,
   program = mpegts_base_new_program (base, program_number, pmt_pid);
 
   /* Mark the PMT PID as being a known PSI PID */
-  if (G_UNLIKELY (MPEGTS_BIT_IS_SET (base->known_psi, pmt_pid))) {
+  if (G_UNLIKELY (MPEGTS_BASE_IS_PSI (base, pmt_pid))) {
     GST_FIXME ("Refcounting. Setting twice a PID (0x%04x) as known PSI",
         pmt_pid);
   }
-  MPEGTS_BIT_SET (base->known_psi, pmt_pid);
+  MPEGTS_BASE_SET_PSI (base, pmt_pid);
 
   g_hash_table_insert (base->programs,
       GINT_TO_POINTER (program_number), program);
@@ -845,14 +842,14 @@ mpegts_base_deactivate_program (MpegTSBase * base, MpegTSBaseProgram * program)
 
       mpegts_base_program_remove_stream (base, program, stream->pid);
 
-      /* Only unset the is_pes/known_psi bit if the PID isn't used in any other active
+      /* Only unset the PES/PSI type if the PID isn't used in any other active
        * program */
       if (!mpegts_pid_in_active_programs (base, stream->pid)) {
         if (_stream_is_private_section (stream)) {
           if (base->parse_private_sections)
-            MPEGTS_BIT_UNSET (base->known_psi, stream->pid);
+            MPEGTS_BASE_UNSET_PSI (base, stream->pid);
         } else {
-          MPEGTS_BIT_UNSET (base->is_pes, stream->pid);
+          MPEGTS_BASE_UNSET_PES (base, stream->pid);
         }
       }
     }
@@ -861,7 +858,7 @@ mpegts_base_deactivate_program (MpegTSBase * base, MpegTSBaseProgram * program)
     /* FIXME : This might actually be shared with another stream ? */
     mpegts_base_program_remove_stream (base, program, program->pcr_pid);
     if (!mpegts_pid_in_active_programs (base, program->pcr_pid))
-      MPEGTS_BIT_UNSET (base->is_pes, program->pcr_pid);
+      MPEGTS_BASE_UNSET_PES (base, program->pcr_pid);
 
     GST_DEBUG ("program stream_list is now %p", program->stream_list);
   }
@@ -903,19 +900,19 @@ mpegts_base_activate_program (MpegTSBase * base, MpegTSBaseProgram * program,
     GstMpegtsPMTStream *stream = g_ptr_array_index (pmt->streams, i);
     if (_stream_is_private_section (stream)) {
       if (base->parse_private_sections)
-        MPEGTS_BIT_SET (base->known_psi, stream->pid);
+        MPEGTS_BASE_SET_PSI (base, stream->pid);
     } else {
-      if (G_UNLIKELY (MPEGTS_BIT_IS_SET (base->is_pes, stream->pid)))
+      if (G_UNLIKELY (MPEGTS_BASE_IS_PES (base, stream->pid)))
         GST_FIXME
             ("Refcounting issue. Setting twice a PID (0x%04x) as known PES",
             stream->pid);
-      if (G_UNLIKELY (MPEGTS_BIT_IS_SET (base->known_psi, stream->pid))) {
+      if (G_UNLIKELY (MPEGTS_BASE_IS_PSI (base, stream->pid))) {
         GST_FIXME
             ("Refcounting issue. Setting a known PSI PID (0x%04x) as known PES",
             stream->pid);
-        MPEGTS_BIT_UNSET (base->known_psi, stream->pid);
+        MPEGTS_BASE_UNSET_PSI (base, stream->pid);
       }
-      MPEGTS_BIT_SET (base->is_pes, stream->pid);
+      MPEGTS_BASE_SET_PES (base, stream->pid);
     }
     mpegts_base_program_add_stream (base, program,
         stream->pid, stream->stream_type, stream);
@@ -923,7 +920,7 @@ mpegts_base_activate_program (MpegTSBase * base, MpegTSBaseProgram * program,
   /* We add the PCR pid last. If that PID is already used by one of the media
    * streams above, no new stream will be created */
   mpegts_base_program_add_stream (base, program, pmt->pcr_pid, -1, NULL);
-  MPEGTS_BIT_SET (base->is_pes, pmt->pcr_pid);
+  MPEGTS_BASE_SET_PES (base, pmt->pcr_pid);
 
   program->active = TRUE;
   program->initial_program = initial_program;
@@ -974,15 +971,15 @@ mpegts_base_apply_pat (MpegTSBase * base, GstMpegtsSection * section)
           /* FIXME: when this happens it may still be pmt pid of another
            * program, so setting to False may make it go through expensive
            * path in is_psi unnecessarily */
-          MPEGTS_BIT_UNSET (base->known_psi, program->pmt_pid);
+          MPEGTS_BASE_UNSET_PSI (base, program->pmt_pid);
         }
 
         program->pmt_pid = patp->network_or_program_map_PID;
-        if (G_UNLIKELY (MPEGTS_BIT_IS_SET (base->known_psi, program->pmt_pid)))
+        if (G_UNLIKELY (MPEGTS_BASE_IS_PSI (base, program->pmt_pid)))
           GST_FIXME
               ("Refcounting issue. Setting twice a PMT PID (0x%04x) as know PSI",
               program->pmt_pid);
-        MPEGTS_BIT_SET (base->known_psi, patp->network_or_program_map_PID);
+        MPEGTS_BASE_SET_PSI (base, patp->network_or_program_map_PID);
       }
     } else {
       /* Create a new program */
@@ -1028,13 +1025,13 @@ mpegts_base_apply_pat (MpegTSBase * base, GstMpegtsSection * section)
       /* FIXME: when this happens it may still be pmt pid of another
        * program, so setting to False may make it go through expensive
        * path in is_psi unnecessarily */
-      if (G_UNLIKELY (MPEGTS_BIT_IS_SET (base->known_psi,
+      if (G_UNLIKELY (MPEGTS_BASE_IS_PSI (base,
                   patp->network_or_program_map_PID))) {
         GST_FIXME
             ("Program refcounting : Setting twice a pid (0x%04x) as known PSI",
             patp->network_or_program_map_PID);
       }
-      MPEGTS_BIT_SET (base->known_psi, patp->network_or_program_map_PID);
+      MPEGTS_BASE_SET_PSI (base, patp->network_or_program_map_PID);
       mpegts_packetizer_remove_stream (base->packetizer,
           patp->network_or_program_map_PID);
     }
@@ -1198,7 +1195,7 @@ mpegts_base_parse_atsc_mgt (MpegTSBase * base, GstMpegtsSection * section)
             table->table_type <= GST_MPEGTS_ATSC_MGT_TABLE_TYPE_EIT127) ||
         (table->table_type >= GST_MPEGTS_ATSC_MGT_TABLE_TYPE_ETT0 &&
             table->table_type <= GST_MPEGTS_ATSC_MGT_TABLE_TYPE_ETT127)) {
-      MPEGTS_BIT_SET (base->known_psi, table->pid);
+      MPEGTS_BASE_SET_PSI (base, table->pid);
     }
   }
 
@@ -1353,21 +1350,68 @@ mpegts_base_sink_event (GstPad * pad, GstObject * parent, GstEvent * event)
   return res;
 }
 
+static inline GstFlowReturn
+mpegts_base_handle_packet (MpegTSBase * base, MpegTSBaseClass * klass,
+    MpegTSPacketizerPacket * packet, MpegTSPacketizerPacketReturn pret)
+{
+  GstFlowReturn res = GST_FLOW_OK;
+  guint8 pid_type;
+
+  if (G_UNLIKELY (pret == PACKET_BAD)) {
+    /* bad header, skip the packet */
+    GST_DEBUG_OBJECT (base, "bad packet, skipping");
+    return res;
+  }
+
+  if (klass->inspect_packet)
+    klass->inspect_packet (base, packet);
+
+  /* Single lookup for all dispatching decisions */
+  pid_type = base->pid_types[packet->pid];
+
+  /* If it's a known PES, push it */
+  if (pid_type & MPEGTS_BASE_PID_TYPE_PES) {
+    /* push the packet downstream */
+    if (base->push_data)
+      res = klass->push (base, packet, NULL);
+  } else if (packet->payload && (pid_type & MPEGTS_BASE_PID_TYPE_PSI)) {
+    /* base PSI data */
+    GList *others, *tmp;
+    GstMpegtsSection *section;
+
+    section = mpegts_packetizer_push_section (base->packetizer, packet,
+        &others);
+    if (section)
+      mpegts_base_handle_psi (base, section);
+    if (G_UNLIKELY (others)) {
+      for (tmp = others; tmp; tmp = tmp->next)
+        mpegts_base_handle_psi (base, (GstMpegtsSection *) tmp->data);
+      g_list_free (others);
+    }
+
+    /* we need to push section packet downstream */
+    if (base->push_section)
+      res = klass->push (base, packet, section);
+
+  } else if (packet->payload && packet->pid != 0x1fff)
+    GST_LOG ("PID 0x%04x Saw packet on a pid we don't handle", packet->pid);
+
+  return res;
+}
+
 static GstFlowReturn
 mpegts_base_chain (GstPad * pad, GstObject * parent, GstBuffer * buf)
 {
   GstFlowReturn res = GST_FLOW_OK;
   MpegTSBase *base;
-  MpegTSPacketizerPacketReturn pret;
-  MpegTSPacketizer2 *packetizer;
-  MpegTSPacketizerPacket packet;
+  MpegTSPacketizerPacketReturn rets[MPEGTS_PACKETIZER_MAX_BATCH];
+  MpegTSPacketizerPacket packets[MPEGTS_PACKETIZER_MAX_BATCH];
+  guint i, n_packets;
   MpegTSBaseClass *klass;
 
   base = GST_MPEGTS_BASE (parent);
   klass = GST_MPEGTS_BASE_GET_CLASS (base);
 
-  packetizer = base->packetizer;
-
   if (klass->input_done)
     gst_buffer_ref (buf);
 
@@ -1392,50 +1436,19 @@ mpegts_base_chain (GstPad * pad, GstObject * parent, GstBuffer * buf)
   mpegts_packetizer_push (base->packetizer, buf);
 
   while (res == GST_FLOW_OK) {
-    pret = mpegts_packetizer_next_packet (base->packetizer, &packet);
+    n_packets = mpegts_packetizer_next_packets (base->packetizer, packets,
+        rets, MPEGTS_PACKETIZER_MAX_BATCH);
 
     /* If we don't have enough data, return */
-    if (G_UNLIKELY (pret == PACKET_NEED_MORE))
+    if (G_UNLIKELY (n_packets == 0))
       break;
 
-    if (G_UNLIKELY (pret == PACKET_BAD)) {
-      /* bad header, skip the packet */
-      GST_DEBUG_OBJECT (base, "bad packet, skipping");
-      goto next;
-    }
-
-    if (klass->inspect_packet)
-      klass->inspect_packet (base, &packet);
-
-    /* If it's a known PES, push it */
-    if (MPEGTS_BIT_IS_SET (base->is_pes, packet.pid)) {
-      /* push the packet downstream */
-      if (base->push_data)
-        res = klass->push (base, &packet, NULL);
-    } else if (packet.payload
-        && MPEGTS_BIT_IS_SET (base->known_psi, packet.pid)) {
-      /* base PSI data */
-      GList *others, *tmp;
-      GstMpegtsSection *section;
-
-      section = mpegts_packetizer_push_section (packetizer, &packet, &others);
-      if (section)
-        mpegts_base_handle_psi (base, section);
-      if (G_UNLIKELY (others)) {
-        for (tmp = others; tmp; tmp = tmp->next)
-          mpegts_base_handle_psi (base, (GstMpegtsSection *) tmp->data);
-        g_list_free (others);
-      }
-
-      /* we need to push section packet downstream */
-      if (base->push_section)
-        res = klass->push (base, &packet, section);
-
-    } else if (packet.payload && packet.pid != 0x1fff)
-      GST_LOG ("PID 0x%04x Saw packet on a pid we don't handle", packet.pid);
+    /* Packets are handled in stream order, PSI changes have to be applied
+     * before the following packets of the batch are dispatched */
+    for (i = 0; i < n_packets && res == GST_FLOW_OK; i++)
+      res = mpegts_base_handle_packet (base, klass, &packets[i], rets[i]);
 
-  next:
-    mpegts_packetizer_clear_packet (base->packetizer, &packet);
+    mpegts_packetizer_clear_packets (base->packetizer, i, n_packets);
   }
 
   if (klass->input_done) {
@@ -127,10 +127,10 @@ struct _MpegTSBase {
   GPtrArray  *pat;
   MpegTSPacketizer2 *packetizer;
 
-  /* arrays that say whether a pid is a known psi pid or a pes pid */
-  /* Use MPEGTS_BIT_* to set/unset/check the values */
-  guint8 *known_psi;
-  guint8 *is_pes;
+  /* Per-PID table saying whether a pid is a known psi pid and/or a pes pid,
+   * so that dispatching a packet only needs one lookup.
+   * Use MPEGTS_BASE_{SET,UNSET,IS}_{PSI,PES} to set/unset/check the values */
+  guint8 *pid_types;
 
   gboolean disposed;
 
@@ -217,6 +217,18 @@ struct _MpegTSBaseClass {
 #define MPEGTS_BIT_UNSET(field, offs)  ((field)[(offs) >> 3] &= ~(1 << ((offs) & 0x7)))
 #define MPEGTS_BIT_IS_SET(field, offs) ((field)[(offs) >> 3] &   (1 << ((offs) & 0x7)))
 
+#define MPEGTS_BASE_NB_PIDS 0x2000
+
+#define MPEGTS_BASE_PID_TYPE_PSI (1 << 0)
+#define MPEGTS_BASE_PID_TYPE_PES (1 << 1)
+
+#define MPEGTS_BASE_SET_PSI(base, pid)   ((base)->pid_types[pid] |=  MPEGTS_BASE_PID_TYPE_PSI)
+#define MPEGTS_BASE_UNSET_PSI(base, pid) ((base)->pid_types[pid] &= ~MPEGTS_BASE_PID_TYPE_PSI)
+#define MPEGTS_BASE_IS_PSI(base, pid)    ((base)->pid_types[pid] &   MPEGTS_BASE_PID_TYPE_PSI)
+#define MPEGTS_BASE_SET_PES(base, pid)   ((base)->pid_types[pid] |=  MPEGTS_BASE_PID_TYPE_PES)
+#define MPEGTS_BASE_UNSET_PES(base, pid) ((base)->pid_types[pid] &= ~MPEGTS_BASE_PID_TYPE_PES)
+#define MPEGTS_BASE_IS_PES(base, pid)    ((base)->pid_types[pid] &   MPEGTS_BASE_PID_TYPE_PES)
+
 G_GNUC_INTERNAL GType mpegts_base_get_type(void);
 
 G_GNUC_INTERNAL MpegTSBaseProgram *mpegts_base_get_program (MpegTSBase * base, gint program_number);
@@ -134,21 +134,26 @@ mpegts_packetizer_get_current_time (MpegTSPacketizer2 * packetizer,
       pcr_pid);
 }
 
+#define SUBTABLE_KEY(table_id, subtable_extension) \
+  GUINT_TO_POINTER (((guint) (table_id) << 16) | (subtable_extension))
+
 static inline MpegTSPacketizerStreamSubtable *
-find_subtable (GSList * subtables, guint8 table_id, guint16 subtable_extension)
+find_subtable (MpegTSPacketizerStream * stream, guint8 table_id,
+    guint16 subtable_extension)
 {
-  GSList *tmp;
+  MpegTSPacketizerStreamSubtable *sub = stream->last_subtable;
 
-  /* FIXME: Make this an array ! */
-  for (tmp = subtables; tmp; tmp = tmp->next) {
-    MpegTSPacketizerStreamSubtable *sub =
-        (MpegTSPacketizerStreamSubtable *) tmp->data;
-    if (sub->table_id == table_id
-        && sub->subtable_extension == subtable_extension)
-      return sub;
-  }
+  /* Sections of the same subtable usually come in a row */
+  if (sub && sub->table_id == table_id
+      && sub->subtable_extension == subtable_extension)
+    return sub;
 
-  return NULL;
+  sub = g_hash_table_lookup (stream->subtables,
+      SUBTABLE_KEY (table_id, subtable_extension));
+  if (sub)
+    stream->last_subtable = sub;
+
+  return sub;
 }
 
 static gboolean
@@ -159,7 +164,7 @@ seen_section_before (MpegTSPacketizerStream * stream, guint8 table_id,
   MpegTSPacketizerStreamSubtable *subtable;
 
   /* Check if we've seen this table_id/subtable_extension first */
-  subtable = find_subtable (stream->subtables, table_id, subtable_extension);
+  subtable = find_subtable (stream, table_id, subtable_extension);
   if (!subtable) {
     GST_DEBUG ("Haven't seen subtable");
     return FALSE;
@@ -192,6 +197,13 @@ mpegts_packetizer_stream_subtable_new (guint8 table_id,
   return subtable;
 }
 
+static void
+mpegts_packetizer_stream_subtable_free (MpegTSPacketizerStreamSubtable *
+    subtable)
+{
+  g_free (subtable);
+}
+
 static MpegTSPacketizerStream *
 mpegts_packetizer_stream_new (guint16 pid)
 {
@@ -199,7 +211,8 @@ mpegts_packetizer_stream_new (guint16 pid)
 
   stream = (MpegTSPacketizerStream *) g_new0 (MpegTSPacketizerStream, 1);
   stream->continuity_counter = CONTINUITY_UNSET;
-  stream->subtables = NULL;
+  stream->subtables = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+      NULL, (GDestroyNotify) mpegts_packetizer_stream_subtable_free);
   stream->table_id = TABLE_ID_UNSET;
   stream->pid = pid;
   return stream;
@@ -216,20 +229,11 @@ mpegts_packetizer_clear_section (MpegTSPacketizerStream * stream)
   stream->section_data = NULL;
 }
 
-static void
-mpegts_packetizer_stream_subtable_free (MpegTSPacketizerStreamSubtable *
-    subtable)
-{
-  g_free (subtable);
-}
-
 static void
 mpegts_packetizer_stream_free (MpegTSPacketizerStream * stream)
 {
   mpegts_packetizer_clear_section (stream);
-  g_slist_foreach (stream->subtables,
-      (GFunc) mpegts_packetizer_stream_subtable_free, NULL);
-  g_slist_free (stream->subtables);
+  g_hash_table_destroy (stream->subtables);
   g_free (stream);
 }
 
@@ -498,8 +502,7 @@ mpegts_packetizer_parse_section_header (MpegTSPacketizer2 * packetizer,
   GstMpegtsSection *res;
 
   subtable =
-      find_subtable (stream->subtables, stream->table_id,
-      stream->subtable_extension);
+      find_subtable (stream, stream->table_id, stream->subtable_extension);
   if (subtable) {
     GST_DEBUG ("Found previous subtable_extension:0x%04x",
         stream->subtable_extension);
@@ -516,7 +519,9 @@ mpegts_packetizer_parse_section_header (MpegTSPacketizer2 * packetizer,
         stream->subtable_extension, stream->last_section_number);
     subtable->version_number = stream->version_number;
 
-    stream->subtables = g_slist_prepend (stream->subtables, subtable);
+    g_hash_table_insert (stream->subtables,
+        SUBTABLE_KEY (stream->table_id, stream->subtable_extension), subtable);
+    stream->last_subtable = subtable;
   }
 
   GST_MEMDUMP ("Full section data", stream->section_data,
@@ -719,11 +724,29 @@ mpegts_packetizer_map (MpegTSPacketizer2 * packetizer, gsize size)
   return TRUE;
 }
 
+/* Returns the position of the first sync byte in data[offset..limit), or
+ * limit if there is none. memchr() is vectorized by the C library on all
+ * the platforms we care about, which makes skipping over garbage after a
+ * corruption burst much cheaper than testing one byte at a time. */
+static inline gsize
+mpegts_packetizer_find_sync_byte (const guint8 * data, gsize offset,
+    gsize limit)
+{
+  const guint8 *p;
+
+  if (offset >= limit)
+    return limit;
+
+  p = memchr (data + offset, PACKET_SYNC_BYTE, limit - offset);
+
+  return p ? (gsize) (p - data) : limit;
+}
+
 static gboolean
 mpegts_try_discover_packet_size (MpegTSPacketizer2 * packetizer)
 {
   guint8 *data;
-  gsize size, i, j;
+  gsize size, limit, i, j;
 
   static const guint psizes[] = {
     MPEGTS_NORMAL_PACKETSIZE,
@@ -737,12 +760,10 @@ mpegts_try_discover_packet_size (MpegTSPacketizer2 * packetizer)
 
   size = packetizer->map_size - packetizer->map_offset;
   data = packetizer->map_data + packetizer->map_offset;
+  limit = size - 3 * MPEGTS_MAX_PACKETSIZE;
 
-  for (i = 0; i + 3 * MPEGTS_MAX_PACKETSIZE < size; i++) {
-    /* find a sync byte */
-    if (data[i] != PACKET_SYNC_BYTE)
-      continue;
-
+  for (i = mpegts_packetizer_find_sync_byte (data, 0, limit); i < limit;
+      i = mpegts_packetizer_find_sync_byte (data, i + 1, limit)) {
     /* check for 4 consecutive sync bytes with each possible packet size */
     for (j = 0; j < G_N_ELEMENTS (psizes); j++) {
       guint packet_size = psizes[j];
@@ -781,7 +802,7 @@ mpegts_packetizer_sync (MpegTSPacketizer2 * packetizer)
   gboolean found = FALSE;
   guint8 *data;
   guint packet_size;
-  gsize size, sync_offset, i;
+  gsize size, limit, sync_offset, i;
 
   packet_size = packetizer->packet_size;
 
@@ -790,15 +811,16 @@ mpegts_packetizer_sync (MpegTSPacketizer2 * packetizer)
 
   size = packetizer->map_size - packetizer->map_offset;
   data = packetizer->map_data + packetizer->map_offset;
+  limit = size - 2 * packet_size;
 
   if (packet_size == MPEGTS_M2TS_PACKETSIZE)
     sync_offset = 4;
   else
     sync_offset = 0;
 
-  for (i = sync_offset; i + 2 * packet_size < size; i++) {
-    if (data[i] == PACKET_SYNC_BYTE &&
-        data[i + packet_size] == PACKET_SYNC_BYTE &&
+  for (i = mpegts_packetizer_find_sync_byte (data, sync_offset, limit);
+      i < limit; i = mpegts_packetizer_find_sync_byte (data, i + 1, limit)) {
+    if (data[i + packet_size] == PACKET_SYNC_BYTE &&
         data[i + 2 * packet_size] == PACKET_SYNC_BYTE) {
       found = TRUE;
       break;
@@ -892,6 +914,98 @@ mpegts_packetizer_clear_packet (MpegTSPacketizer2 * packetizer,
   }
 }
 
+/* Returns TRUE if the packet starting at data carries a PCR in its
+ * adaptation field */
+static inline gboolean
+mpegts_packetizer_peek_has_pcr (const guint8 * data)
+{
+  return FLAGS_HAS_AFC (data[3]) && data[4] != 0
+      && (data[5] & MPEGTS_AFC_PCR_FLAG);
+}
+
+/* Parses up to max_packets consecutive packets out of the currently mapped
+ * data, without going back to the adapter for each of them. rets receives
+ * the parsing result of each packet (PACKET_OK or PACKET_BAD).
+ *
+ * Parsing a packet carrying a PCR updates the PCR observations, so a batch
+ * always ends before such a packet: all packets of a batch can then be
+ * handled as if they had been returned one by one by
+ * mpegts_packetizer_next_packet().
+ *
+ * Returns the number of packets parsed, 0 if more data is needed. The
+ * packets are valid until mpegts_packetizer_clear_packets() is called. */
+guint
+mpegts_packetizer_next_packets (MpegTSPacketizer2 * packetizer,
+    MpegTSPacketizerPacket * packets, MpegTSPacketizerPacketReturn * rets,
+    guint max_packets)
+{
+  guint8 *packet_data;
+  guint packet_size;
+  gsize sync_offset, offset;
+  guint n;
+
+  if (G_UNLIKELY (max_packets == 0))
+    return 0;
+
+  /* The first packet goes through the regular code path, which takes care
+   * of packet size discovery, resyncing and mapping */
+  rets[0] = mpegts_packetizer_next_packet (packetizer, &packets[0]);
+  if (rets[0] == PACKET_NEED_MORE)
+    return 0;
+
+  packet_size = packetizer->packet_size;
+  if (packet_size == MPEGTS_M2TS_PACKETSIZE)
+    sync_offset = 4;
+  else
+    sync_offset = 0;
+
+  offset = packetizer->map_offset + packet_size;
+  for (n = 1; n < max_packets && offset + packet_size <= packetizer->map_size;
+      n++) {
+    packet_data = &packetizer->map_data[offset + sync_offset];
+
+    /* Leave resyncing to mpegts_packetizer_next_packet() */
+    if (G_UNLIKELY (*packet_data != PACKET_SYNC_BYTE))
+      break;
+
+    if (mpegts_packetizer_peek_has_pcr (packet_data))
+      break;
+
+    packets[n].data_start = packet_data;
+    packets[n].data_end = packet_data + 188;
+    packets[n].offset = packetizer->offset;
+    packetizer->offset += packet_size;
+
+    rets[n] = mpegts_packetizer_parse_packet (packetizer, &packets[n]);
+    offset += packet_size;
+  }
+
+  GST_LOG ("parsed a batch of %u packets", n);
+
+  return n;
+}
+
+/* Releases the first n_handled packets of a batch of n_packets returned by
+ * mpegts_packetizer_next_packets(). Unhandled packets will be returned
+ * again by the next call. */
+void
+mpegts_packetizer_clear_packets (MpegTSPacketizer2 * packetizer,
+    guint n_handled, guint n_packets)
+{
+  guint packet_size = packetizer->packet_size;
+
+  g_return_if_fail (n_handled <= n_packets);
+
+  /* The packetizer was flushed while handling the batch */
+  if (!packetizer->map_data)
+    return;
+
+  packetizer->offset -= (guint64) (n_packets - n_handled) * packet_size;
+  packetizer->map_offset += n_handled * packet_size;
+  if (packetizer->map_size - packetizer->map_offset < packet_size)
+    mpegts_packetizer_flush_bytes (packetizer, packetizer->map_offset);
+}
+
 gboolean
 mpegts_packetizer_has_packets (MpegTSPacketizer2 * packetizer)
 {
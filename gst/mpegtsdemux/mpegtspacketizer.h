@@ -85,7 +85,10 @@ typedef struct
   guint8  section_number;
   guint8  last_section_number;
 
-  GSList *subtables;
+  /* MpegTSPacketizerStreamSubtable indexed by table_id/subtable_extension */
+  GHashTable *subtables;
+  /* Last subtable looked up */
+  gpointer last_subtable;
 
   /* Upstream offset of the data contained in the section */
   guint64 offset;
@@ -335,6 +338,10 @@ typedef enum {
   PACKET_NEED_MORE
 } MpegTSPacketizerPacketReturn;
 
+/* Maximum number of packets handled in one go by
+ * mpegts_packetizer_next_packets() users */
+#define MPEGTS_PACKETIZER_MAX_BATCH 32
+
 G_GNUC_INTERNAL GType mpegts_packetizer_get_type(void);
 
 G_GNUC_INTERNAL MpegTSPacketizer2 *mpegts_packetizer_new (void);
@@ -348,6 +355,11 @@ G_GNUC_INTERNAL MpegTSPacketizerPacketReturn
 mpegts_packetizer_process_next_packet(MpegTSPacketizer2 * packetizer);
 G_GNUC_INTERNAL void mpegts_packetizer_clear_packet (MpegTSPacketizer2 *packetizer,
 				     MpegTSPacketizerPacket *packet);
+G_GNUC_INTERNAL guint mpegts_packetizer_next_packets (MpegTSPacketizer2 *packetizer,
+  MpegTSPacketizerPacket *packets, MpegTSPacketizerPacketReturn *rets,
+  guint max_packets);
+G_GNUC_INTERNAL void mpegts_packetizer_clear_packets (MpegTSPacketizer2 *packetizer,
+  guint n_handled, guint n_packets);
 G_GNUC_INTERNAL void mpegts_packetizer_remove_stream(MpegTSPacketizer2 *packetizer,
   gint16 pid);
 
@@ -37,6 +37,12 @@
 /* latency in mseconds is maximum 100 ms between PCR */
 #define TS_LATENCY 100
 
+/* Maximum number of packets gathered on a program pad before pushing them
+ * out in one buffer. Splitting a multiplex is done with one tsdemux per
+ * program pad, each behind its own queue and so in its own thread, and
+ * what limited that was the per-packet buffer push on each program pad. */
+#define PROGRAM_PAD_MAX_PACKETS 64
+
 #define TABLE_ID_UNSET 0xFF
 #define RUNNING_STATUS_RUNNING 4
 
@@ -64,6 +70,15 @@ struct _MpegTSParsePad
 
   /* the return of the latest push */
   GstFlowReturn flow_return;
+
+  /* Packets gathered for the next push downstream (mapped for writing) */
+  GstBuffer *pending;
+  GstMapInfo pending_map;
+  gsize pending_size;
+
+  /* the return of the latest actual push downstream, packets are only
+   * gathered while it is GST_FLOW_OK */
+  GstFlowReturn last_flow;
 };
 
 static GstStaticPadTemplate src_template =
@@ -123,6 +138,8 @@ static GstFlowReturn mpegts_parse_input_done (MpegTSBase * base,
     GstBuffer * buffer);
 static GstFlowReturn
 drain_pending_buffers (MpegTSParse2 * parse, gboolean drain_all);
+static GstFlowReturn mpegts_parse_push_pending_packets (MpegTSParse2 * parse);
+static void mpegts_parse_drop_pending_packets (MpegTSParse2 * parse);
 
 static void
 mpegts_parse_dispose (GObject * object)
@@ -217,25 +234,25 @@ mpegts_parse_reset (MpegTSBase * base)
   /* Set the various know PIDs we are interested in */
 
   /* CAT */
-  MPEGTS_BIT_SET (base->known_psi, 1);
+  MPEGTS_BASE_SET_PSI (base, 1);
   /* NIT, ST */
-  MPEGTS_BIT_SET (base->known_psi, 0x10);
+  MPEGTS_BASE_SET_PSI (base, 0x10);
   /* SDT, BAT, ST */
-  MPEGTS_BIT_SET (base->known_psi, 0x11);
+  MPEGTS_BASE_SET_PSI (base, 0x11);
   /* EIT, ST, CIT (TS 102 323) */
-  MPEGTS_BIT_SET (base->known_psi, 0x12);
+  MPEGTS_BASE_SET_PSI (base, 0x12);
   /* RST, ST */
-  MPEGTS_BIT_SET (base->known_psi, 0x13);
+  MPEGTS_BASE_SET_PSI (base, 0x13);
   /* RNT (TS 102 323) */
-  MPEGTS_BIT_SET (base->known_psi, 0x16);
+  MPEGTS_BASE_SET_PSI (base, 0x16);
   /* inband signalling */
-  MPEGTS_BIT_SET (base->known_psi, 0x1c);
+  MPEGTS_BASE_SET_PSI (base, 0x1c);
   /* measurement */
-  MPEGTS_BIT_SET (base->known_psi, 0x1d);
+  MPEGTS_BASE_SET_PSI (base, 0x1d);
   /* DIT */
-  MPEGTS_BIT_SET (base->known_psi, 0x1e);
+  MPEGTS_BASE_SET_PSI (base, 0x1e);
   /* SIT */
-  MPEGTS_BIT_SET (base->known_psi, 0x1f);
+  MPEGTS_BASE_SET_PSI (base, 0x1f);
 
   parse->first = TRUE;
   parse->have_group_id = FALSE;
@@ -243,6 +260,7 @@ mpegts_parse_reset (MpegTSBase * base)
 
   g_list_free_full (parse->pending_buffers, (GDestroyNotify) gst_buffer_unref);
   parse->pending_buffers = NULL;
+  mpegts_parse_drop_pending_packets (parse);
 
   parse->current_pcr = GST_CLOCK_TIME_NONE;
   parse->previous_pcr = GST_CLOCK_TIME_NONE;
@@ -374,6 +392,13 @@ push_event (MpegTSBase * base, GstEvent * event)
   if (G_UNLIKELY (GST_EVENT_TYPE (event) == GST_EVENT_EOS))
     drain_pending_buffers (parse, TRUE);
 
+  /* Packets gathered on the program pads have to go out before any
+   * serialized event, and be discarded on flushes */
+  if (GST_EVENT_TYPE (event) == GST_EVENT_FLUSH_STOP)
+    mpegts_parse_drop_pending_packets (parse);
+  else if (GST_EVENT_IS_SERIALIZED (event))
+    mpegts_parse_push_pending_packets (parse);
+
   if (G_UNLIKELY (GST_EVENT_TYPE (event) == GST_EVENT_SEGMENT))
     parse->ts_offset = 0;
 
@@ -407,15 +432,29 @@ mpegts_parse_create_tspad (MpegTSParse2 * parse, const gchar * pad_name)
   tspad->program = NULL;
   tspad->pushed = FALSE;
   tspad->flow_return = GST_FLOW_NOT_LINKED;
+  tspad->last_flow = GST_FLOW_NOT_LINKED;
   gst_pad_set_element_private (pad, tspad);
   gst_flow_combiner_add_pad (parse->flowcombiner, pad);
 
   return tspad;
 }
 
+static void
+mpegts_parse_tspad_drop_pending (MpegTSParsePad * tspad)
+{
+  if (tspad->pending) {
+    gst_buffer_unmap (tspad->pending, &tspad->pending_map);
+    gst_buffer_unref (tspad->pending);
+    tspad->pending = NULL;
+    tspad->pending_size = 0;
+  }
+}
+
 static void
 mpegts_parse_destroy_tspad (MpegTSParse2 * parse, MpegTSParsePad * tspad)
 {
+  mpegts_parse_tspad_drop_pending (tspad);
+
   /* free the wrapper */
   g_free (tspad);
 }
@@ -517,12 +556,124 @@ mpegts_parse_request_new_pad (GstElement * element, GstPadTemplate * template,
 static void
 mpegts_parse_release_pad (GstElement * element, GstPad * pad)
 {
+  MpegTSBase *base = (MpegTSBase *) element;
   MpegTSParse2 *parse = (MpegTSParse2 *) element;
 
   gst_pad_set_active (pad, FALSE);
-  /* we do the cleanup in GstElement::pad-removed */
+
+  /* The packets gathered on the pad are only accessed by the streaming
+   * thread, wait for it to be done with the current input before freeing
+   * them. We do the cleanup in GstElement::pad-removed */
+  GST_PAD_STREAM_LOCK (base->sinkpad);
   gst_flow_combiner_remove_pad (parse->flowcombiner, pad);
   gst_element_remove_pad (element, pad);
+  GST_PAD_STREAM_UNLOCK (base->sinkpad);
+}
+
+static GstFlowReturn
+mpegts_parse_tspad_push_pending (MpegTSParse2 * parse, MpegTSParsePad * tspad)
+{
+  GstBuffer *buf = tspad->pending;
+  GstFlowReturn ret;
+
+  if (buf == NULL)
+    return tspad->last_flow;
+
+  gst_buffer_unmap (buf, &tspad->pending_map);
+  gst_buffer_set_size (buf, tspad->pending_size);
+  tspad->pending = NULL;
+  tspad->pending_size = 0;
+
+  GST_LOG_OBJECT (parse, "pushing %" G_GSIZE_FORMAT " bytes on %s:%s",
+      gst_buffer_get_size (buf), GST_DEBUG_PAD_NAME (tspad->pad));
+
+  ret = gst_pad_push (tspad->pad, buf);
+  ret = gst_flow_combiner_update_flow (parse->flowcombiner, ret);
+  tspad->last_flow = ret;
+
+  return ret;
+}
+
+/* Gathers packets on a program pad, so that downstream (typically a queue
+ * feeding one tsdemux per program) gets a buffer per batch of packets
+ * instead of one per packet */
+static GstFlowReturn
+mpegts_parse_tspad_queue_packet (MpegTSParse2 * parse, MpegTSParsePad * tspad,
+    MpegTSPacketizerPacket * packet)
+{
+  gsize size = packet->data_end - packet->data_start;
+  gboolean batch = tspad->last_flow == GST_FLOW_OK;
+
+  if (tspad->pending == NULL) {
+    tspad->pending = gst_buffer_new_allocate (NULL,
+        batch ? PROGRAM_PAD_MAX_PACKETS * MPEGTS_NORMAL_PACKETSIZE : size,
+        NULL);
+    gst_buffer_map (tspad->pending, &tspad->pending_map, GST_MAP_WRITE);
+  }
+
+  memcpy (tspad->pending_map.data + tspad->pending_size, packet->data_start,
+      size);
+  tspad->pending_size += size;
+
+  /* Until downstream accepted a buffer (the pad is not linked yet, or
+   * flushing), push each packet right away so that the actual flow return
+   * is reported instead of the one of an earlier push */
+  if (!batch
+      || tspad->pending_size + MPEGTS_NORMAL_PACKETSIZE >
+      tspad->pending_map.size)
+    return mpegts_parse_tspad_push_pending (parse, tspad);
+
+  return tspad->last_flow;
+}
+
+static GList *
+mpegts_parse_get_srcpads (MpegTSParse2 * parse)
+{
+  GList *pads;
+
+  GST_OBJECT_LOCK (parse);
+  pads = g_list_copy_deep (parse->srcpads, (GCopyFunc) gst_object_ref, NULL);
+  GST_OBJECT_UNLOCK (parse);
+
+  return pads;
+}
+
+/* Pushes out the packets gathered on all program pads */
+static GstFlowReturn
+mpegts_parse_push_pending_packets (MpegTSParse2 * parse)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+  GList *pads, *tmp;
+
+  pads = mpegts_parse_get_srcpads (parse);
+  for (tmp = pads; tmp; tmp = tmp->next) {
+    MpegTSParsePad *tspad = gst_pad_get_element_private ((GstPad *) tmp->data);
+
+    if (tspad && tspad->pending) {
+      GstFlowReturn pad_ret = mpegts_parse_tspad_push_pending (parse, tspad);
+
+      if (pad_ret != GST_FLOW_OK && pad_ret != GST_FLOW_NOT_LINKED)
+        ret = pad_ret;
+    }
+  }
+  g_list_free_full (pads, (GDestroyNotify) gst_object_unref);
+
+  return ret;
+}
+
+static void
+mpegts_parse_drop_pending_packets (MpegTSParse2 * parse)
+{
+  GList *pads, *tmp;
+
+  pads = mpegts_parse_get_srcpads (parse);
+  for (tmp = pads; tmp; tmp = tmp->next) {
+    MpegTSParsePad *tspad = gst_pad_get_element_private ((GstPad *) tmp->data);
+
+    if (tspad)
+      mpegts_parse_tspad_drop_pending (tspad);
+  }
+  g_list_free_full (pads, (GDestroyNotify) gst_object_unref);
 }
 
 static GstFlowReturn
@@ -553,14 +704,8 @@ mpegts_parse_tspad_push_section (MpegTSParse2 * parse, MpegTSParsePad * tspad,
       "pushing section: %d program number: %d table_id: %d", to_push,
       tspad->program_number, section->table_id);
 
-  if (to_push) {
-    GstBuffer *buf =
-        gst_buffer_new_and_alloc (packet->data_end - packet->data_start);
-    gst_buffer_fill (buf, 0, packet->data_start,
-        packet->data_end - packet->data_start);
-    ret = gst_pad_push (tspad->pad, buf);
-    ret = gst_flow_combiner_update_flow (parse->flowcombiner, ret);
-  }
+  if (to_push)
+    ret = mpegts_parse_tspad_queue_packet (parse, tspad, packet);
 
   GST_LOG_OBJECT (parse, "Returning %s", gst_flow_get_name (ret));
   return ret;
@@ -584,13 +729,8 @@ mpegts_parse_tspad_push (MpegTSParse2 * parse, MpegTSParsePad * tspad,
   if (bp) {
     if (packet->pid == bp->pmt_pid || bp->streams == NULL
         || bp->streams[packet->pid]) {
-      GstBuffer *buf =
-          gst_buffer_new_and_alloc (packet->data_end - packet->data_start);
-      gst_buffer_fill (buf, 0, packet->data_start,
-          packet->data_end - packet->data_start);
       /* push if there's no filter or if the pid is in the filter */
-      ret = gst_pad_push (tspad->pad, buf);
-      ret = gst_flow_combiner_update_flow (parse->flowcombiner, ret);
+      ret = mpegts_parse_tspad_queue_packet (parse, tspad, packet);
     }
   }
   GST_DEBUG_OBJECT (parse, "Returning %s", gst_flow_get_name (ret));
@@ -865,6 +1005,13 @@ mpegts_parse_input_done (MpegTSBase * base, GstBuffer * buffer)
 
   GST_LOG_OBJECT (parse, "Received buffer %" GST_PTR_FORMAT, buffer);
 
+  /* Flush out what the program pads gathered from this buffer */
+  ret = mpegts_parse_push_pending_packets (parse);
+  if (ret != GST_FLOW_OK) {
+    gst_buffer_unref (buffer);
+    return ret;
+  }
+
   if (parse->current_pcr != GST_CLOCK_TIME_NONE) {
     GST_DEBUG_OBJECT (parse,
         "InputTS %" GST_TIME_FORMAT " PCR %" GST_TIME_FORMAT,
@@ -70,6 +70,10 @@
  */
 #define SEEK_TIMESTAMP_OFFSET (2500 * GST_MSECOND)
 
+/* maximum number of random access points remembered. When reached, every
+ * other one is dropped, so the index keeps covering the whole file */
+#define MAX_KEYFRAMES 8192
+
 #define GST_FLOW_REWINDING GST_FLOW_CUSTOM_ERROR
 
 /* latency in nsecs */
@@ -110,6 +114,16 @@ typedef struct
   guint64 pts, dts;
 } PendingBuffer;
 
+/* Random access point seen on a video stream */
+typedef struct
+{
+  /* offset of the TS packet starting the PES */
+  guint64 offset;
+
+  /* PTS (or DTS) of the PES */
+  GstClockTime time;
+} TSDemuxKeyframe;
+
 typedef struct _TSDemuxStream TSDemuxStream;
 
 typedef struct _TSDemuxH264ParsingInfos TSDemuxH264ParsingInfos;
@@ -152,6 +166,9 @@ struct _TSDemuxStream
   /* Whether this is a sparse stream (subtitles or metadata) */
   gboolean sparse;
 
+  /* Whether this is a video stream */
+  gboolean is_video;
+
   /* TRUE if we are waiting for a valid timestamp */
   gboolean pending_ts;
 
@@ -169,6 +186,15 @@ struct _TSDemuxStream
   /* Size of ->data */
   guint allocated_size;
 
+  /* Size to pre-allocate for PES of unknown length, based on the
+   * previous PES sizes. Avoids growing ->data packet after packet */
+  guint pes_size_hint;
+
+  /* Statistics on PES reconstruction */
+  guint64 nb_pes;
+  guint64 nb_reallocs;
+  guint64 bytes_copied;
+
   /* Current PTS/DTS for this stream (in running time) */
   GstClockTime pts;
   GstClockTime dts;
@@ -348,6 +374,11 @@ gst_ts_demux_dispose (GObject * object)
 
   gst_flow_combiner_free (demux->flowcombiner);
 
+  if (demux->keyframes) {
+    g_array_free (demux->keyframes, TRUE);
+    demux->keyframes = NULL;
+  }
+
   GST_CALL_PARENT (G_OBJECT_CLASS, dispose, (object));
 }
 
@@ -432,6 +463,10 @@ gst_ts_demux_reset (MpegTSBase * base)
 
   demux->last_seek_offset = -1;
   demux->program_generation = 0;
+
+  /* Also called from the base class init, before ours */
+  if (demux->keyframes)
+    g_array_set_size (demux->keyframes, 0);
 }
 
 static void
@@ -445,6 +480,7 @@ gst_ts_demux_init (GstTSDemux * demux)
   base->push_section = FALSE;
 
   demux->flowcombiner = gst_flow_combiner_new ();
+  demux->keyframes = g_array_new (FALSE, FALSE, sizeof (TSDemuxKeyframe));
   demux->requested_program_number = -1;
   demux->program_number = -1;
   gst_ts_demux_reset (base);
@@ -815,6 +851,84 @@ gst_ts_demux_adjust_seek_offset_for_keyframe (TSDemuxStream * stream,
   return TRUE;
 }
 
+/* Returns the index of the first keyframe at an offset >= offset */
+static guint
+gst_ts_demux_keyframe_offset_index (GstTSDemux * demux, guint64 offset)
+{
+  GArray *keyframes = demux->keyframes;
+  guint low = 0, high = keyframes->len;
+
+  while (low < high) {
+    guint mid = low + (high - low) / 2;
+
+    if (g_array_index (keyframes, TSDemuxKeyframe, mid).offset < offset)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+
+  return low;
+}
+
+static void
+gst_ts_demux_record_keyframe (GstTSDemux * demux, guint64 offset,
+    GstClockTime time)
+{
+  GArray *keyframes = demux->keyframes;
+  TSDemuxKeyframe keyframe = { offset, time };
+  guint idx, i;
+
+  idx = gst_ts_demux_keyframe_offset_index (demux, offset);
+  if (idx < keyframes->len
+      && g_array_index (keyframes, TSDemuxKeyframe, idx).offset == offset)
+    return;
+
+  if (G_UNLIKELY (keyframes->len >= MAX_KEYFRAMES)) {
+    GST_DEBUG_OBJECT (demux, "Too many keyframes known, dropping half");
+    for (i = 0; i < keyframes->len / 2; i++)
+      g_array_index (keyframes, TSDemuxKeyframe, i) =
+          g_array_index (keyframes, TSDemuxKeyframe, 2 * i);
+    g_array_set_size (keyframes, keyframes->len / 2);
+    idx = gst_ts_demux_keyframe_offset_index (demux, offset);
+  }
+
+  /* Common case: playing forward through new data */
+  if (idx == keyframes->len)
+    g_array_append_val (keyframes, keyframe);
+  else
+    g_array_insert_val (keyframes, idx, keyframe);
+}
+
+/* Returns the offset of the last known keyframe at or before time, or -1
+ * if there is none or if it is before min_offset. Keyframe times are
+ * assumed to grow with their offset */
+static guint64
+gst_ts_demux_find_keyframe_offset (GstTSDemux * demux, GstClockTime time,
+    guint64 min_offset)
+{
+  GArray *keyframes = demux->keyframes;
+  guint low = 0, high = keyframes->len;
+  TSDemuxKeyframe *keyframe;
+
+  while (low < high) {
+    guint mid = low + (high - low) / 2;
+
+    if (g_array_index (keyframes, TSDemuxKeyframe, mid).time <= time)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+
+  if (low == 0)
+    return -1;
+
+  keyframe = &g_array_index (keyframes, TSDemuxKeyframe, low - 1);
+  if (keyframe->offset < min_offset)
+    return -1;
+
+  return keyframe->offset;
+}
+
 static GstFlowReturn
 gst_ts_demux_do_seek (MpegTSBase * base, GstEvent * event)
 {
@@ -858,6 +972,25 @@ gst_ts_demux_do_seek (MpegTSBase * base, GstEvent * event)
       GST_WARNING ("Couldn't convert start position to an offset");
       goto done;
     }
+
+    /* If a keyframe was already seen between that offset and the requested
+     * position, start from it directly. This saves reading up to
+     * SEEK_TIMESTAMP_OFFSET worth of data, and going backward looking for
+     * a keyframe. The keyframe times are used rather than the offset of the
+     * requested position, as the interpolated offset can land after the
+     * keyframe preceding it */
+    if (demux->keyframes->len) {
+      guint64 keyframe_offset;
+
+      keyframe_offset =
+          gst_ts_demux_find_keyframe_offset (demux, MAX (0, start),
+          start_offset);
+      if (keyframe_offset != -1) {
+        GST_DEBUG_OBJECT (demux, "Using known keyframe at offset %"
+            G_GUINT64_FORMAT, keyframe_offset);
+        start_offset = keyframe_offset;
+      }
+    }
   } else {
     for (tmp = demux->program->stream_list; tmp; tmp = tmp->next) {
       TSDemuxStream *stream = tmp->data;
@@ -1704,6 +1837,7 @@ done:
           GST_STREAM_FLAG_SPARSE);
     }
     stream->sparse = sparse;
+    stream->is_video = is_video;
     gst_stream_set_caps (bstream->stream_object, caps);
     if (!stream->taglist)
       stream->taglist = gst_tag_list_new_empty ();
@@ -1791,6 +1925,10 @@ gst_ts_demux_stream_removed (MpegTSBase * base, MpegTSBaseStream * bstream)
 {
   TSDemuxStream *stream = (TSDemuxStream *) bstream;
 
+  GST_DEBUG_OBJECT (base, "pid 0x%04x: %" G_GUINT64_FORMAT " PES, %"
+      G_GUINT64_FORMAT " bytes copied, %" G_GUINT64_FORMAT " reallocations",
+      bstream->pid, stream->nb_pes, stream->bytes_copied, stream->nb_reallocs);
+
   if (stream->pad) {
     gst_flow_combiner_remove_pad (GST_TS_DEMUX_CAST (base)->flowcombiner,
         stream->pad);
@@ -2298,12 +2436,13 @@ gst_ts_demux_parse_pes_header (GstTSDemux * demux, TSDemuxStream * stream,
   if (stream->expected_size)
     stream->allocated_size = MAX (stream->expected_size, length);
   else
-    stream->allocated_size = MAX (8192, length);
+    stream->allocated_size = MAX (MAX (8192, stream->pes_size_hint), length);
 
   g_assert (stream->data == NULL);
   stream->data = g_malloc (stream->allocated_size);
   memcpy (stream->data, data, length);
   stream->current_size = length;
+  stream->bytes_copied += length;
 
   stream->state = PENDING_PACKET_BUFFER;
 
@@ -2372,9 +2511,11 @@ gst_ts_demux_queue_data (GstTSDemux * demux, TSDemuxStream * stream,
           stream->allocated_size *= 2;
         } while (stream->current_size + size > stream->allocated_size);
         stream->data = g_realloc (stream->data, stream->allocated_size);
+        stream->nb_reallocs++;
       }
       memcpy (stream->data + stream->current_size, data, size);
       stream->current_size += size;
+      stream->bytes_copied += size;
       break;
     }
     case PENDING_PACKET_DISCONT:
@@ -3037,6 +3178,14 @@ gst_ts_demux_push_pending_data (GstTSDemux * demux, TSDemuxStream * stream,
   }
 
 beach:
+  if (stream->state == PENDING_PACKET_BUFFER && stream->current_size) {
+    /* Follow the largest recent PES size, slowly decaying so that a single
+     * big PES doesn't keep over-allocating forever */
+    stream->pes_size_hint = MAX (stream->current_size,
+        stream->pes_size_hint - stream->pes_size_hint / 16);
+    stream->nb_pes++;
+  }
+
   /* Reset everything */
   GST_LOG ("Resetting to EMPTY, returning %s", gst_flow_get_name (res));
   stream->state = PENDING_PACKET_EMPTY;
@@ -3065,6 +3214,20 @@ gst_ts_demux_handle_packet (GstTSDemux * demux, TSDemuxStream * stream,
   if (packet->payload && (res == GST_FLOW_OK || res == GST_FLOW_NOT_LINKED)
       && stream->pad) {
     gst_ts_demux_queue_data (demux, stream, packet);
+
+    /* Remember random access points to speed up later seeks, once their
+     * PES header gave their time */
+    if (G_UNLIKELY (packet->payload_unit_start_indicator &&
+            (packet->afc_flags & MPEGTS_AFC_RANDOM_ACCES_FLAGS))
+        && stream->is_video && stream->state == PENDING_PACKET_BUFFER
+        && ((MpegTSBase *) demux)->mode != BASE_MODE_PUSHING) {
+      GstClockTime time = GST_CLOCK_TIME_IS_VALID (stream->pts) ?
+          stream->pts : stream->dts;
+
+      if (GST_CLOCK_TIME_IS_VALID (time))
+        gst_ts_demux_record_keyframe (demux, packet->offset, time);
+    }
+
     GST_LOG ("current_size:%d, expected_size:%d",
         stream->current_size, stream->expected_size);
     /* Finally check if the data we queued completes a packet */
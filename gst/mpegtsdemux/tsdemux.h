@@ -101,6 +101,10 @@ struct _GstTSDemux
 
   /* Used when seeking for a keyframe to go backward in the stream */
   guint64 last_seek_offset;
+
+  /* Random access points seen on video streams (pull mode only), sorted
+   * by offset */
+  GArray *keyframes;
 };
 
 struct _GstTSDemuxClass
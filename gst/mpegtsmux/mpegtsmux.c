@@ -113,10 +113,15 @@ enum
   PROP_PAT_INTERVAL,
   PROP_PMT_INTERVAL,
   PROP_ALIGNMENT,
-  PROP_SI_INTERVAL
+  PROP_SI_INTERVAL,
+  PROP_BITRATE
 };
 
 #define MPEGTSMUX_DEFAULT_ALIGNMENT    -1
+#define MPEGTSMUX_DEFAULT_BITRATE      0
+
+/* packet buffers kept around for recycling */
+#define MPEGTSMUX_PACKET_POOL_MIN      64
 #define MPEGTSMUX_DEFAULT_M2TS         FALSE
 
 static GstStaticPadTemplate mpegtsmux_sink_factory =
@@ -303,6 +308,26 @@ mpegtsmux_class_init (MpegTsMuxClass * klass)
           "Set the interval (in ticks of the 90kHz clock) for writing out the Service"
           "Information tables", 1, G_MAXUINT, TSMUX_DEFAULT_SI_INTERVAL,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * MpegTsMux:bitrate:
+   *
+   * Constant output bitrate in bits per second, or 0 for a variable bitrate.
+   * The output is padded with null packets until the stream data is due,
+   * and the PCRs are derived from the position of their packet in the
+   * output. Gaps of more than a second in the stream data are not padded
+   * entirely, the output clock jumps over the rest instead, and the next
+   * PCR has its discontinuity indicator set.
+   *
+   * Since: 1.14
+   */
+  g_object_class_install_property (G_OBJECT_CLASS (klass), PROP_BITRATE,
+      g_param_spec_uint64 ("bitrate", "Bitrate (in bits per second)",
+          "Set the target bitrate, the output is padded with null packets "
+          "to reach it and buffers are timestamped with their departure "
+          "time (0 = variable bitrate)", 0, G_MAXUINT64,
+          MPEGTSMUX_DEFAULT_BITRATE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 }
 
 static void
@@ -336,6 +361,7 @@ mpegtsmux_init (MpegTsMux * mux)
   mux->si_interval = TSMUX_DEFAULT_SI_INTERVAL;
   mux->prog_map = NULL;
   mux->alignment = MPEGTSMUX_DEFAULT_ALIGNMENT;
+  mux->bitrate = MPEGTSMUX_DEFAULT_BITRATE;
 
   /* initial state */
   mpegtsmux_reset (mux, TRUE);
@@ -415,6 +441,12 @@ mpegtsmux_reset (MpegTsMux * mux, gboolean alloc)
   gst_event_replace (&mux->force_key_unit_event, NULL);
   gst_buffer_replace (&mux->out_buffer, NULL);
 
+  if (mux->packet_pool) {
+    gst_buffer_pool_set_active (mux->packet_pool, FALSE);
+    gst_object_unref (mux->packet_pool);
+    mux->packet_pool = NULL;
+  }
+
   if (mux->collect) {
     GST_COLLECT_PADS_STREAM_LOCK (mux->collect);
     for (walk = mux->collect->data; walk != NULL; walk = g_slist_next (walk))
@@ -426,6 +458,7 @@ mpegtsmux_reset (MpegTsMux * mux, gboolean alloc)
     mux->tsmux = tsmux_new ();
     tsmux_set_write_func (mux->tsmux, new_packet_cb, mux);
     tsmux_set_alloc_func (mux->tsmux, alloc_packet_cb, mux);
+    tsmux_set_bitrate (mux->tsmux, mux->bitrate);
   }
 }
 
@@ -506,6 +539,11 @@ gst_mpegtsmux_set_property (GObject * object, guint prop_id,
       mux->si_interval = g_value_get_uint (value);
       tsmux_set_si_interval (mux->tsmux, mux->si_interval);
       break;
+    case PROP_BITRATE:
+      mux->bitrate = g_value_get_uint64 (value);
+      if (mux->tsmux)
+        tsmux_set_bitrate (mux->tsmux, mux->bitrate);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -537,6 +575,9 @@ gst_mpegtsmux_get_property (GObject * object, guint prop_id,
     case PROP_SI_INTERVAL:
       g_value_set_uint (value, mux->si_interval);
       break;
+    case PROP_BITRATE:
+      g_value_set_uint64 (value, mux->bitrate);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -1833,6 +1874,8 @@ new_packet_cb (GstBuffer * buf, void *user_data, gint64 new_pcr)
 {
   MpegTsMux *mux = (MpegTsMux *) user_data;
   gint offset = 0;
+  gboolean move = FALSE;
+  gint64 packet_time;
   GstMapInfo map;
 
 #if 0
@@ -1841,18 +1884,33 @@ new_packet_cb (GstBuffer * buf, void *user_data, gint64 new_pcr)
 #endif
 
   if (mux->m2ts_mode) {
+    gsize skip;
+
     offset = 4;
-    gst_buffer_set_size (buf, NORMAL_TS_PACKET_LENGTH + offset);
+    gst_buffer_get_sizes (buf, &skip, NULL);
+    if (skip >= offset) {
+      /* the packet was written after the room reserved for the prefix,
+       * so simply expose the prefix again */
+      gst_buffer_resize (buf, -offset, NORMAL_TS_PACKET_LENGTH + offset);
+      move = FALSE;
+    } else {
+      /* section packets carry spare room at the end instead */
+      gst_buffer_set_size (buf, NORMAL_TS_PACKET_LENGTH + offset);
+      move = TRUE;
+    }
   }
 
   gst_buffer_map (buf, &map, GST_MAP_READWRITE);
 
-  if (offset) {
-    /* there should be a better way to do this */
+  if (move)
     memmove (map.data + offset, map.data, map.size - offset);
-  }
 
-  GST_BUFFER_PTS (buf) = mux->last_ts;
+  packet_time = tsmux_get_packet_time (mux->tsmux);
+  if (packet_time >= 0)
+    /* constant bitrate, stamp with the departure time of the packet */
+    GST_BUFFER_PTS (buf) = MPEG_SYS_TIME_TO_GSTTIME (packet_time);
+  else
+    GST_BUFFER_PTS (buf) = mux->last_ts;
   /* do common init (flags and streamheaders) */
   new_packet_common_init (mux, buf, map.data + offset, map.size);
 
@@ -1878,8 +1936,31 @@ alloc_packet_cb (GstBuffer ** _buf, void *user_data)
   if (mux->m2ts_mode == TRUE)
     offset = 4;
 
-  buf = gst_buffer_new_and_alloc (NORMAL_TS_PACKET_LENGTH + offset);
-  gst_buffer_set_size (buf, NORMAL_TS_PACKET_LENGTH);
+  if (G_UNLIKELY (mux->packet_pool == NULL)) {
+    GstStructure *config;
+
+    mux->packet_pool = gst_buffer_pool_new ();
+    config = gst_buffer_pool_get_config (mux->packet_pool);
+    gst_buffer_pool_config_set_params (config, NULL,
+        NORMAL_TS_PACKET_LENGTH + offset, MPEGTSMUX_PACKET_POOL_MIN, 0);
+    if (!gst_buffer_pool_set_config (mux->packet_pool, config) ||
+        !gst_buffer_pool_set_active (mux->packet_pool, TRUE)) {
+      GST_WARNING_OBJECT (mux, "failed to set up packet pool");
+      gst_object_unref (mux->packet_pool);
+      mux->packet_pool = NULL;
+    }
+  }
+
+  /* recycle packets rather than allocating each one, the pool restores
+   * the full size when a buffer comes back */
+  if (G_UNLIKELY (!mux->packet_pool ||
+          gst_buffer_pool_acquire_buffer (mux->packet_pool, &buf,
+              NULL) != GST_FLOW_OK))
+    buf = gst_buffer_new_and_alloc (NORMAL_TS_PACKET_LENGTH + offset);
+
+  /* reserve room for the m2ts prefix up front, so it does not need
+   * to be made by moving the packet data afterwards */
+  gst_buffer_resize (buf, offset, NORMAL_TS_PACKET_LENGTH);
 
   *_buf = buf;
 }
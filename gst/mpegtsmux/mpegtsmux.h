@@ -139,6 +139,7 @@ struct MpegTsMux {
   guint pmt_interval;
   gint alignment;
   guint si_interval;
+  guint64 bitrate;
 
   /* state */
   gboolean first;
@@ -164,6 +165,9 @@ struct MpegTsMux {
   GstAdapter *out_adapter;
   GstBuffer *out_buffer;
 
+  /* recycled packet buffers handed out to TsMux */
+  GstBufferPool *packet_pool;
+
 #if 0
   /* SPN/PTS index handling */
   GstIndex *element_index;
@@ -113,6 +113,19 @@
  * so we have some slack to go backwards */
 #define CLOCK_BASE (TSMUX_CLOCK_FREQ * 10 * 360)
 
+/* A PCR gives the arrival time of the byte holding the last bit of the
+ * program_clock_reference_base, which is at this offset in the packet */
+#define TSMUX_PCR_BYTE_OFFSET 10
+
+/* Longest gap in the stream data that is filled with null packets in
+ * constant bitrate mode, in cycles of the 27MHz clock. The output clock
+ * jumps over the rest of longer gaps */
+#define TSMUX_MAX_PADDING TSMUX_SYS_CLOCK_FREQ
+
+#define TSMUX_TS_TO_PCR(ts) \
+    (((ts) + CLOCK_BASE - TSMUX_PCR_OFFSET) * \
+    (TSMUX_SYS_CLOCK_FREQ / TSMUX_CLOCK_FREQ))
+
 static gboolean tsmux_write_pat (TsMux * mux);
 static gboolean tsmux_write_pmt (TsMux * mux, TsMuxProgram * program);
 static void
@@ -153,6 +166,8 @@ tsmux_new (void)
   mux->si_sections = g_hash_table_new_full (g_direct_hash, g_direct_equal,
       NULL, (GDestroyNotify) tsmux_section_free);
 
+  mux->first_pcr = -1;
+
   return mux;
 }
 
@@ -260,6 +275,81 @@ tsmux_get_si_interval (TsMux * mux)
   return mux->si_interval;
 }
 
+/* PCR of the byte at @offset in the constant bitrate output */
+static inline gint64
+tsmux_get_pcr_at (TsMux * mux, guint64 offset)
+{
+  return mux->first_pcr + gst_util_uint64_scale (offset * 8,
+      TSMUX_SYS_CLOCK_FREQ, mux->bitrate);
+}
+
+/**
+ * tsmux_set_bitrate:
+ * @mux: a #TsMux
+ * @bitrate: the output bitrate in bits per second, or 0
+ *
+ * Set a constant output bitrate. When set, @mux paces its output by
+ * inserting null packets until the stream data is due, and derives the
+ * written PCR values from the position of the packets in the output.
+ * A @bitrate of 0 produces a variable bitrate stream.
+ */
+void
+tsmux_set_bitrate (TsMux * mux, guint64 bitrate)
+{
+  g_return_if_fail (mux != NULL);
+
+  if (mux->bitrate && bitrate && mux->first_pcr != -1) {
+    gint64 cur_pcr = tsmux_get_pcr_at (mux, mux->n_bytes);
+
+    /* keep the PCR continuous over the rate change */
+    mux->first_pcr = cur_pcr - gst_util_uint64_scale (mux->n_bytes * 8,
+        TSMUX_SYS_CLOCK_FREQ, bitrate);
+  } else {
+    mux->first_pcr = -1;
+  }
+
+  mux->bitrate = bitrate;
+}
+
+/**
+ * tsmux_get_bitrate:
+ * @mux: a #TsMux
+ *
+ * Get the configured output bitrate. See also tsmux_set_bitrate().
+ *
+ * Returns: the configured output bitrate, or 0 for variable bitrate
+ */
+guint64
+tsmux_get_bitrate (TsMux * mux)
+{
+  g_return_val_if_fail (mux != NULL, 0);
+
+  return mux->bitrate;
+}
+
+/**
+ * tsmux_get_packet_time:
+ * @mux: a #TsMux
+ *
+ * Get the departure time of the packet being output in constant bitrate
+ * mode, in cycles of the 27MHz clock. The time uses the same origin as
+ * the timestamps of the stream data, so data is due at the time of its
+ * PTS.
+ *
+ * Returns: the departure time of the current packet, or -1 if @mux does
+ * not produce a constant bitrate or has not output any data yet.
+ */
+gint64
+tsmux_get_packet_time (TsMux * mux)
+{
+  g_return_val_if_fail (mux != NULL, -1);
+
+  if (!mux->bitrate || mux->first_pcr == -1)
+    return -1;
+
+  return tsmux_get_pcr_at (mux, mux->n_bytes) - TSMUX_TS_TO_PCR (0);
+}
+
 /**
  * tsmux_add_mpegts_si_section:
  * @mux: a #TsMux
@@ -585,13 +675,19 @@ tsmux_get_buffer (TsMux * mux, GstBuffer ** buf)
 static gboolean
 tsmux_packet_out (TsMux * mux, GstBuffer * buf, gint64 pcr)
 {
+  gboolean res;
+
   if (G_UNLIKELY (mux->write_func == NULL)) {
     if (buf)
       gst_buffer_unref (buf);
-    return TRUE;
+    res = TRUE;
+  } else {
+    res = mux->write_func (buf, mux->write_func_data, pcr);
   }
 
-  return mux->write_func (buf, mux->write_func_data, pcr);
+  mux->n_bytes += TSMUX_PACKET_LENGTH;
+
+  return res;
 }
 
 /*
@@ -976,6 +1072,141 @@ tsmux_write_si (TsMux * mux)
 
 }
 
+static gboolean
+tsmux_write_null_packet (TsMux * mux)
+{
+  GstBuffer *buf;
+  GstMapInfo map;
+
+  if (!tsmux_get_buffer (mux, &buf))
+    return FALSE;
+
+  gst_buffer_map (buf, &map, GST_MAP_WRITE);
+  map.data[0] = TSMUX_SYNC_BYTE;
+  /* null packet PID */
+  GST_WRITE_UINT16_BE (map.data + 1, 0x1FFF);
+  /* no adaptation field exists | continuity counter undefined */
+  map.data[3] = 0x10;
+  memset (map.data + TSMUX_HEADER_LENGTH, 0xff, TSMUX_PAYLOAD_LENGTH);
+  gst_buffer_unmap (buf, &map);
+
+  return tsmux_packet_out (mux, buf, -1);
+}
+
+/* Write a packet carrying only a PCR on the PID of @stream */
+static gboolean
+tsmux_write_pcr_packet (TsMux * mux, TsMuxStream * stream, gint64 pcr)
+{
+  TsMuxPacketInfo pi = { 0, };
+  guint payload_len, payload_offs;
+  GstBuffer *buf;
+  GstMapInfo map;
+
+  pi.pid = stream->pi.pid;
+  /* no payload, so the continuity counter stays that of the last packet */
+  pi.packet_count = stream->pi.packet_count - 1;
+  pi.flags = TSMUX_PACKET_FLAG_ADAPTATION | TSMUX_PACKET_FLAG_WRITE_PCR;
+  pi.pcr = pcr;
+  if (stream->pcr_discont)
+    pi.flags |= TSMUX_PACKET_FLAG_DISCONT;
+
+  if (!tsmux_get_buffer (mux, &buf))
+    return FALSE;
+
+  gst_buffer_map (buf, &map, GST_MAP_WRITE);
+  if (!tsmux_write_ts_header (map.data, &pi, &payload_len, &payload_offs)) {
+    gst_buffer_unmap (buf, &map);
+    gst_buffer_unref (buf);
+    return FALSE;
+  }
+  gst_buffer_unmap (buf, &map);
+
+  TS_DEBUG ("Writing PCR-only packet on PID 0x%04x, PCR %" G_GINT64_FORMAT
+      "%s", pi.pid, pcr, stream->pcr_discont ? " (discont)" : "");
+  stream->last_pcr = pcr;
+  stream->pcr_discont = FALSE;
+
+  return tsmux_packet_out (mux, buf, pcr);
+}
+
+/* In constant bitrate mode, fill the output with null packets until data
+ * with timestamp @ts is due, inserting PCR packets wherever a program
+ * would otherwise go without a PCR for too long */
+static gboolean
+tsmux_pad_stream (TsMux * mux, gint64 ts)
+{
+  gint64 target_pcr = TSMUX_TS_TO_PCR (ts);
+  gint64 cur_pcr;
+  guint n_null = 0;
+  GList *cur;
+
+  if (mux->first_pcr == -1) {
+    mux->first_pcr = target_pcr - gst_util_uint64_scale (mux->n_bytes * 8,
+        TSMUX_SYS_CLOCK_FREQ, mux->bitrate);
+    TS_DEBUG ("First PCR is %" G_GINT64_FORMAT, mux->first_pcr);
+  }
+
+  cur_pcr = tsmux_get_pcr_at (mux, mux->n_bytes);
+
+  if (target_pcr - cur_pcr > TSMUX_MAX_PADDING) {
+    TS_DEBUG ("Gap of %" G_GINT64_FORMAT " ms in the stream data, "
+        "jumping the output clock instead of padding it all",
+        (target_pcr - cur_pcr) / (TSMUX_SYS_CLOCK_FREQ / 1000));
+    mux->first_pcr += target_pcr - cur_pcr - TSMUX_MAX_PADDING;
+
+    /* write a PCR at the new clock right away, signalling the jump */
+    for (cur = mux->programs; cur; cur = cur->next) {
+      TsMuxProgram *program = (TsMuxProgram *) cur->data;
+
+      if (program->pcr_stream) {
+        program->pcr_stream->last_pcr = -1;
+        program->pcr_stream->pcr_discont = TRUE;
+      }
+    }
+  } else if (cur_pcr - target_pcr > TSMUX_PCR_OFFSET *
+      (TSMUX_SYS_CLOCK_FREQ / TSMUX_CLOCK_FREQ)) {
+    /* the data only arrives after its PTS */
+    if (!mux->overrun)
+      TS_DEBUG ("The stream data needs more than the bitrate of %"
+          G_GUINT64_FORMAT " bits per second", mux->bitrate);
+    mux->overrun = TRUE;
+  } else if (cur_pcr < target_pcr) {
+    mux->overrun = FALSE;
+  }
+
+  while (tsmux_get_pcr_at (mux, mux->n_bytes + TSMUX_PACKET_LENGTH) <=
+      target_pcr) {
+    gint64 pcr = tsmux_get_pcr_at (mux, mux->n_bytes + TSMUX_PCR_BYTE_OFFSET);
+    TsMuxStream *late = NULL;
+
+    for (cur = mux->programs; cur; cur = cur->next) {
+      TsMuxProgram *program = (TsMuxProgram *) cur->data;
+      TsMuxStream *pcr_stream = program->pcr_stream;
+
+      if (pcr_stream && (pcr_stream->last_pcr == -1 ||
+              pcr - pcr_stream->last_pcr >=
+              TSMUX_SYS_CLOCK_FREQ / TSMUX_DEFAULT_PCR_FREQ)) {
+        late = pcr_stream;
+        break;
+      }
+    }
+
+    if (late) {
+      if (!tsmux_write_pcr_packet (mux, late, pcr))
+        return FALSE;
+    } else {
+      if (!tsmux_write_null_packet (mux))
+        return FALSE;
+      n_null++;
+    }
+  }
+
+  if (n_null)
+    TS_DEBUG ("Inserted %u null packets", n_null);
+
+  return TRUE;
+}
+
 /**
  * tsmux_write_stream_packet:
  * @mux: a #TsMux
@@ -998,6 +1229,18 @@ tsmux_write_stream_packet (TsMux * mux, TsMuxStream * stream)
   g_return_val_if_fail (mux != NULL, FALSE);
   g_return_val_if_fail (stream != NULL, FALSE);
 
+  if (mux->bitrate) {
+    gint64 cur_pts = tsmux_stream_get_pts (stream);
+
+    if (cur_pts != G_MININT64) {
+      if (!tsmux_pad_stream (mux, cur_pts))
+        return FALSE;
+    } else if (mux->first_pcr == -1) {
+      /* no timing information, start the output clock at 0 */
+      mux->first_pcr = TSMUX_TS_TO_PCR (0);
+    }
+  }
+
   if (tsmux_stream_is_pcr (stream)) {
     gint64 cur_pts = tsmux_stream_get_pts (stream);
     gboolean write_pat;
@@ -1018,8 +1261,11 @@ tsmux_write_stream_packet (TsMux * mux, TsMuxStream * stream)
           (TSMUX_SYS_CLOCK_FREQ / TSMUX_CLOCK_FREQ);
     }
 
-    /* Need to decide whether to write a new PCR in this packet */
-    if (stream->last_pcr == -1 ||
+    /* Need to decide whether to write a new PCR in this packet, with a
+     * constant bitrate that is done once the tables are written */
+    if (mux->bitrate) {
+      cur_pcr = -1;
+    } else if (stream->last_pcr == -1 ||
         (cur_pcr - stream->last_pcr >
             (TSMUX_SYS_CLOCK_FREQ / TSMUX_DEFAULT_PCR_FREQ))) {
 
@@ -1079,6 +1325,25 @@ tsmux_write_stream_packet (TsMux * mux, TsMuxStream * stream)
     }
   }
 
+  if (mux->bitrate && tsmux_stream_is_pcr (stream)) {
+    /* the PCR is the departure time of this very packet */
+    cur_pcr = tsmux_get_pcr_at (mux, mux->n_bytes + TSMUX_PCR_BYTE_OFFSET);
+
+    if (stream->last_pcr == -1 ||
+        (cur_pcr - stream->last_pcr >
+            (TSMUX_SYS_CLOCK_FREQ / TSMUX_DEFAULT_PCR_FREQ))) {
+      stream->pi.flags |=
+          TSMUX_PACKET_FLAG_ADAPTATION | TSMUX_PACKET_FLAG_WRITE_PCR;
+      if (stream->pcr_discont)
+        stream->pi.flags |= TSMUX_PACKET_FLAG_DISCONT;
+      stream->pi.pcr = cur_pcr;
+      stream->last_pcr = cur_pcr;
+      stream->pcr_discont = FALSE;
+    } else {
+      cur_pcr = -1;
+    }
+  }
+
   pi->packet_start_unit_indicator = tsmux_stream_at_pes_start (stream);
   if (pi->packet_start_unit_indicator) {
     tsmux_stream_initialize_pes_packet (stream);
@@ -176,6 +176,15 @@ struct TsMux {
   TsMuxAllocFunc alloc_func;
   void *alloc_func_data;
 
+  /* constant output bitrate in bits per second, 0 for variable bitrate */
+  guint64 bitrate;
+  /* number of bytes output so far */
+  guint64 n_bytes;
+  /* PCR of the first output byte in constant bitrate mode */
+  gint64 first_pcr;
+  /* whether the stream data is output later than its PTS */
+  gboolean overrun;
+
   /* scratch space for writing ES_info descriptors */
   guint8 es_info_buf[TSMUX_MAX_ES_INFO_LENGTH];
 };
@@ -190,6 +199,9 @@ void 		tsmux_set_alloc_func 		(TsMux *mux, TsMuxAllocFunc func, void *user_data)
 void 		tsmux_set_pat_interval          (TsMux *mux, guint interval);
 guint 		tsmux_get_pat_interval          (TsMux *mux);
 guint16		tsmux_get_new_pid 		(TsMux *mux);
+void 		tsmux_set_bitrate               (TsMux *mux, guint64 bitrate);
+guint64 	tsmux_get_bitrate               (TsMux *mux);
+gint64 		tsmux_get_packet_time           (TsMux *mux);
 
 /* pid/program management */
 TsMuxProgram *	tsmux_program_new 		(TsMux *mux, gint prog_id);
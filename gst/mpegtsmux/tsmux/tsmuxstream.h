@@ -201,6 +201,8 @@ struct TsMuxStream {
   gint   pcr_ref;
   /* last time PCR written */
   gint64 last_pcr;
+  /* whether the next PCR follows a jump of the constant bitrate clock */
+  gboolean pcr_discont;
 
   /* audio parameters for stream
    * (used in stream descriptor) */
@@ -58,7 +58,9 @@ enum
   PROP_PERMS,
   PROP_SHM_SIZE,
   PROP_WAIT_FOR_CONNECTION,
-  PROP_BUFFER_TIME
+  PROP_BUFFER_TIME,
+  PROP_RING_SIZE,
+  PROP_USE_MEMFD
 };
 
 struct GstShmClient
@@ -69,6 +71,8 @@ struct GstShmClient
 
 #define DEFAULT_SIZE ( 64 * 1024 * 1024 )
 #define DEFAULT_WAIT_FOR_CONNECTION (TRUE)
+#define DEFAULT_RING_SIZE 0
+#define DEFAULT_USE_MEMFD FALSE
 /* Default is user read/write, group read */
 #define DEFAULT_PERMS ( S_IRUSR | S_IWUSR | S_IRGRP )
 
@@ -101,6 +105,8 @@ static gboolean gst_shm_sink_propose_allocation (GstBaseSink * sink,
     GstQuery * query);
 
 static gpointer pollthread_func (gpointer data);
+static gboolean gst_shm_sink_recv_releases (GstShmSink * self);
+static void gst_shm_sink_check_ring_perms (GstShmSink * self);
 
 static guint signals[LAST_SIGNAL] = { 0 };
 
@@ -302,16 +308,25 @@ gst_shm_sink_allocator_alloc (GstAllocator * allocator, gsize size,
 {
   GstShmSinkAllocator *self = GST_SHM_SINK_ALLOCATOR (allocator);
   GstMemory *memory = NULL;
+  ShmAllocStats stats;
 
   GST_OBJECT_LOCK (self->sink);
   memory = gst_shm_sink_allocator_alloc_locked (self, size, params);
+  /* Clients may have released buffers through their rings meanwhile */
+  if (!memory && gst_shm_sink_recv_releases (self->sink))
+    memory = gst_shm_sink_allocator_alloc_locked (self, size, params);
+  if (!memory)
+    sp_writer_get_alloc_stats (self->sink->pipe, &stats);
   GST_OBJECT_UNLOCK (self->sink);
 
   if (!memory) {
     memory = gst_allocator_alloc (NULL, size, params);
     GST_LOG_OBJECT (self,
         "Not enough shared memory for GstMemory of %" G_GSIZE_FORMAT
-        "bytes, allocating using standard allocator", size);
+        "bytes, allocating using standard allocator (%lu bytes free in %lu "
+        "blocks, the largest has %lu bytes, %lu bytes in %lu blocks in use)",
+        size, stats.free_size, stats.n_free_blocks, stats.largest_free_size,
+        stats.allocated_size, stats.n_blocks);
   }
 
   return memory;
@@ -353,6 +368,8 @@ gst_shm_sink_init (GstShmSink * self)
   self->size = DEFAULT_SIZE;
   self->wait_for_connection = DEFAULT_WAIT_FOR_CONNECTION;
   self->perms = DEFAULT_PERMS;
+  self->ring_size = DEFAULT_RING_SIZE;
+  self->use_memfd = DEFAULT_USE_MEMFD;
 
   gst_allocation_params_init (&self->params);
 }
@@ -415,6 +432,45 @@ gst_shm_sink_class_init (GstShmSinkClass * klass)
           -1, G_MAXINT64, -1,
           G_PARAM_CONSTRUCT | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  /**
+   * GstShmSink:ring-size:
+   *
+   * Send buffers to the clients that connect afterwards through rings in
+   * shared memory that hold this many buffers, instead of one message on
+   * the control socket per buffer and per release. The socket is then only
+   * used to wake up a side that ran out of work. Clients need write access
+   * to the rings (see #GstShmSink:perms) and must be new enough to support
+   * them.
+   *
+   * Since: 1.14
+   */
+  g_object_class_install_property (gobject_class, PROP_RING_SIZE,
+      g_param_spec_uint ("ring-size",
+          "Size of the rings",
+          "Number of buffers in the ring of each new client "
+          "(0 = send each buffer over the control socket)",
+          0, 65536, DEFAULT_RING_SIZE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstShmSink:use-memfd:
+   *
+   * Create the shared memory areas with memfd_create() and pass them to
+   * the clients over the control socket, instead of giving them a name in
+   * the shm namespace. The areas are sealed so that they can not shrink,
+   * and where the kernel supports it, so that only the sink can write to
+   * them. shmsrc then outputs fd memory that can be imported without a
+   * copy. Only supported on Linux, and by new enough clients. This may be
+   * modified during the NULL->READY transition.
+   *
+   * Since: 1.14
+   */
+  g_object_class_install_property (gobject_class, PROP_USE_MEMFD,
+      g_param_spec_boolean ("use-memfd",
+          "Use memfd",
+          "Pass the shared memory to the clients as sealed memfds",
+          DEFAULT_USE_MEMFD, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   signals[SIGNAL_CLIENT_CONNECTED] = g_signal_new ("client-connected",
       GST_TYPE_SHM_SINK, G_SIGNAL_RUN_LAST, 0, NULL, NULL,
       g_cclosure_marshal_VOID__INT, G_TYPE_NONE, 1, G_TYPE_INT);
@@ -465,8 +521,10 @@ gst_shm_sink_set_property (GObject * object, guint prop_id,
     case PROP_PERMS:
       GST_OBJECT_LOCK (object);
       self->perms = g_value_get_uint (value);
-      if (self->pipe)
+      if (self->pipe) {
         ret = sp_writer_setperms_shm (self->pipe, self->perms);
+        gst_shm_sink_check_ring_perms (self);
+      }
       GST_OBJECT_UNLOCK (object);
       if (ret < 0)
         GST_WARNING_OBJECT (object, "Could not set permissions on pipe: %s",
@@ -503,6 +561,20 @@ gst_shm_sink_set_property (GObject * object, guint prop_id,
       GST_OBJECT_UNLOCK (object);
       g_cond_broadcast (&self->cond);
       break;
+    case PROP_RING_SIZE:
+      GST_OBJECT_LOCK (object);
+      self->ring_size = g_value_get_uint (value);
+      if (self->pipe) {
+        sp_writer_set_ring_size (self->pipe, self->ring_size);
+        gst_shm_sink_check_ring_perms (self);
+      }
+      GST_OBJECT_UNLOCK (object);
+      break;
+    case PROP_USE_MEMFD:
+      GST_OBJECT_LOCK (object);
+      self->use_memfd = g_value_get_boolean (value);
+      GST_OBJECT_UNLOCK (object);
+      break;
     default:
       break;
   }
@@ -532,6 +604,12 @@ gst_shm_sink_get_property (GObject * object, guint prop_id,
     case PROP_BUFFER_TIME:
       g_value_set_int64 (value, self->buffer_time);
       break;
+    case PROP_RING_SIZE:
+      g_value_set_uint (value, self->ring_size);
+      break;
+    case PROP_USE_MEMFD:
+      g_value_set_boolean (value, self->use_memfd);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -542,6 +620,21 @@ gst_shm_sink_get_property (GObject * object, guint prop_id,
 
 
 
+/* WITH OBJECT LOCK */
+static void
+gst_shm_sink_check_ring_perms (GstShmSink * self)
+{
+  /* memfds are passed with their access mode, only shm paths are opened
+   * with the permissions */
+  if (self->ring_size == 0 || self->use_memfd)
+    return;
+
+  if (((self->perms & S_IRGRP) && !(self->perms & S_IWGRP)) ||
+      ((self->perms & S_IROTH) && !(self->perms & S_IWOTH)))
+    GST_WARNING_OBJECT (self, "Permissions 0%o give some clients read but "
+        "not write access, they will fail to open the rings", self->perms);
+}
+
 static gboolean
 gst_shm_sink_start (GstBaseSink * bsink)
 {
@@ -559,7 +652,8 @@ gst_shm_sink_start (GstBaseSink * bsink)
   GST_DEBUG_OBJECT (self, "Creating new socket at %s"
       " with shared memory of %d bytes", self->socket_path, self->size);
 
-  self->pipe = sp_writer_create (self->socket_path, self->size, self->perms);
+  self->pipe = sp_writer_create (self->socket_path, self->size, self->perms,
+      self->use_memfd);
 
   if (!self->pipe) {
     GST_ELEMENT_ERROR (self, RESOURCE, OPEN_READ_WRITE,
@@ -567,7 +661,15 @@ gst_shm_sink_start (GstBaseSink * bsink)
     return FALSE;
   }
 
+  if (self->use_memfd && !sp_writer_is_write_sealed (self->pipe))
+    GST_WARNING_OBJECT (self, "The kernel can not seal the memory against "
+        "writing by the clients (F_SEAL_FUTURE_WRITE needs Linux 5.1)");
+
   sp_set_data (self->pipe, self);
+  sp_writer_set_ring_size (self->pipe, self->ring_size);
+  GST_OBJECT_LOCK (self);
+  gst_shm_sink_check_ring_perms (self);
+  GST_OBJECT_UNLOCK (self);
   g_free (self->socket_path);
   self->socket_path = g_strdup (sp_writer_get_path (self->pipe));
 
@@ -656,6 +758,17 @@ gst_shm_sink_can_render (GstShmSink * self, GstClockTime time)
   return TRUE;
 }
 
+/* WITH OBJECT LOCK. Waits for the poll thread to see activity from the
+ * clients, clients with a ring only tell it about releases while we wait */
+static void
+gst_shm_sink_wait_releases (GstShmSink * self)
+{
+  sp_writer_set_waiting (self->pipe, 1);
+  if (!gst_shm_sink_recv_releases (self))
+    g_cond_wait (&self->cond, GST_OBJECT_GET_LOCK (self));
+  sp_writer_set_waiting (self->pipe, 0);
+}
+
 static GstFlowReturn
 gst_shm_sink_render (GstBaseSink * bsink, GstBuffer * buf)
 {
@@ -681,8 +794,10 @@ gst_shm_sink_render (GstBaseSink * bsink, GstBuffer * buf)
     }
   }
 
+  gst_shm_sink_recv_releases (self);
+
   while (!gst_shm_sink_can_render (self, GST_BUFFER_TIMESTAMP (buf))) {
-    g_cond_wait (&self->cond, GST_OBJECT_GET_LOCK (self));
+    gst_shm_sink_wait_releases (self);
     if (self->unlock) {
       GST_OBJECT_UNLOCK (self);
       ret = gst_base_sink_wait_preroll (bsink);
@@ -721,7 +836,7 @@ gst_shm_sink_render (GstBaseSink * bsink, GstBuffer * buf)
     while ((memory =
             gst_shm_sink_allocator_alloc_locked (self->allocator,
                 gst_buffer_get_size (buf), &self->params)) == NULL) {
-      g_cond_wait (&self->cond, GST_OBJECT_GET_LOCK (self));
+      gst_shm_sink_wait_releases (self);
       if (self->unlock) {
         GST_OBJECT_UNLOCK (self);
         ret = gst_base_sink_wait_preroll (bsink);
@@ -815,6 +930,26 @@ free_buffer_locked (GstBuffer * buffer, void *data)
   *list = g_slist_prepend (*list, buffer);
 }
 
+/* WITH OBJECT LOCK, which is released while the buffers are unreffed.
+ * Frees the buffers that clients released through their rings, returns
+ * whether there were any. */
+static gboolean
+gst_shm_sink_recv_releases (GstShmSink * self)
+{
+  GSList *list = NULL;
+
+  sp_writer_recv_releases (self->pipe,
+      (sp_buffer_free_callback) free_buffer_locked, &list);
+  if (!list)
+    return FALSE;
+
+  GST_OBJECT_UNLOCK (self);
+  g_slist_free_full (list, (GDestroyNotify) gst_buffer_unref);
+  GST_OBJECT_LOCK (self);
+
+  return TRUE;
+}
+
 static gpointer
 pollthread_func (gpointer data)
 {
@@ -939,6 +1074,10 @@ pollthread_func (gpointer data)
       goto again;
     }
 
+    GST_OBJECT_LOCK (self);
+    gst_shm_sink_recv_releases (self);
+    GST_OBJECT_UNLOCK (self);
+
     g_cond_broadcast (&self->cond);
   }
 
@@ -953,9 +1092,10 @@ gst_shm_sink_event (GstBaseSink * bsink, GstEvent * event)
   switch (GST_EVENT_TYPE (event)) {
     case GST_EVENT_EOS:
       GST_OBJECT_LOCK (self);
+      gst_shm_sink_recv_releases (self);
       while (self->wait_for_connection && sp_writer_pending_writes (self->pipe)
           && !self->unlock)
-        g_cond_wait (&self->cond, GST_OBJECT_GET_LOCK (self));
+        gst_shm_sink_wait_releases (self);
       GST_OBJECT_UNLOCK (self);
       break;
     default:
@@ -32,6 +32,9 @@
  * ! queue ! videoconvert ! autovideosink
  * ]| Render video from shm buffers.
  *
+ * If the shmsink passes its memory as fds (see #GstShmSink:use-memfd), the
+ * buffers are made of fd memory, which downstream elements can import
+ * without copying.
  */
 
 #ifdef HAVE_CONFIG_H
@@ -41,6 +44,7 @@
 #include "gstshmsrc.h"
 
 #include <gst/gst.h>
+#include <gst/allocators/allocators.h>
 
 #include <string.h>
 
@@ -96,6 +100,8 @@ static void gst_shm_pipe_dec (GstShmPipe * pipe);
 
 // static guint gst_shm_src_signals[LAST_SIGNAL] = { 0 };
 
+G_DEFINE_QUARK (GstShmSrcBuffer, gst_shm_src_buffer);
+
 static void
 gst_shm_src_class_init (GstShmSrcClass * klass)
 {
@@ -155,6 +161,7 @@ gst_shm_src_init (GstShmSrc * self)
 {
   self->poll = gst_poll_new (TRUE);
   gst_poll_fd_init (&self->pollfd);
+  self->fd_allocator = gst_fd_allocator_new ();
 }
 
 static void
@@ -164,6 +171,7 @@ gst_shm_src_finalize (GObject * object)
 
   gst_poll_free (self->poll);
   g_free (self->socket_path);
+  gst_object_unref (self->fd_allocator);
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
@@ -325,8 +333,23 @@ gst_shm_src_create (GstPushSrc * psrc, GstBuffer ** outbuf)
   gchar *buf = NULL;
   int rv = 0;
   struct GstShmBuffer *gsb;
+  gsize area_size;
+  gulong offset;
+  gint fd;
 
   do {
+    /* Buffers in the ring of the sink need no wake up from the socket */
+    GST_OBJECT_LOCK (self);
+    rv = sp_client_recv_ring (self->pipe->pipe, &buf);
+    GST_OBJECT_UNLOCK (self);
+    if (rv < 0) {
+      GST_ELEMENT_ERROR (self, RESOURCE, READ, ("Failed to read from shmsrc"),
+          ("Error reading from ring: %d", rv));
+      return GST_FLOW_ERROR;
+    }
+    if (buf)
+      break;
+
     if (gst_poll_wait (self->poll, GST_CLOCK_TIME_NONE) < 0) {
       if (errno == EBUSY)
         return GST_FLOW_FLUSHING;
@@ -356,6 +379,13 @@ gst_shm_src_create (GstPushSrc * psrc, GstBuffer ** outbuf)
       GST_OBJECT_LOCK (self);
       rv = sp_client_recv (self->pipe->pipe, &buf);
       GST_OBJECT_UNLOCK (self);
+      if (rv == -6) {
+        GST_ELEMENT_ERROR (self, RESOURCE, OPEN_READ_WRITE,
+            ("Failed to open the rings of shmsink"),
+            ("Clients need write access to the rings, see the perms and "
+                "ring-size properties of shmsink"));
+        return GST_FLOW_ERROR;
+      }
       if (rv < 0) {
         GST_ELEMENT_ERROR (self, RESOURCE, READ, ("Failed to read from shmsrc"),
             ("Error reading control data: %d", rv));
@@ -371,8 +401,28 @@ gst_shm_src_create (GstPushSrc * psrc, GstBuffer ** outbuf)
   gsb->pipe = self->pipe;
   gst_shm_pipe_inc (self->pipe);
 
-  *outbuf = gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY,
-      buf, rv, 0, rv, gsb, free_buffer);
+  GST_OBJECT_LOCK (self);
+  fd = sp_client_buf_get_fd (self->pipe->pipe, buf, &area_size, &offset);
+  GST_OBJECT_UNLOCK (self);
+
+  if (fd >= 0) {
+    GstMemory *mem;
+
+    /* The area and its fd stay open until the buffer is released, which
+     * happens when the memory and everything shared from it are gone */
+    mem = gst_fd_allocator_alloc (self->fd_allocator, fd, area_size,
+        GST_FD_MEMORY_FLAG_DONT_CLOSE | GST_FD_MEMORY_FLAG_KEEP_MAPPED);
+    gst_memory_resize (mem, offset, rv);
+    GST_MINI_OBJECT_FLAG_SET (mem, GST_MEMORY_FLAG_READONLY);
+    gst_mini_object_set_qdata (GST_MINI_OBJECT_CAST (mem),
+        gst_shm_src_buffer_quark (), gsb, free_buffer);
+
+    *outbuf = gst_buffer_new ();
+    gst_buffer_append_memory (*outbuf, mem);
+  } else {
+    *outbuf = gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY,
+        buf, rv, 0, rv, gsb, free_buffer);
+  }
 
   return GST_FLOW_OK;
 }
@@ -53,6 +53,9 @@ struct _GstShmSrc
   GstPoll *poll;
   GstPollFD pollfd;
 
+  /* for the buffers in areas passed as fds */
+  GstAllocator *fd_allocator;
+
 
   GstFlowReturn flow_return;
   gboolean unlocked;
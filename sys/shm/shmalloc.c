@@ -33,19 +33,35 @@
 #include <string.h>
 #include <assert.h>
 
+/* Free blocks are kept in lists by size class, class n holding the blocks
+ * of 2^n to 2^(n+1)-1 bytes, so that finding a free block takes constant
+ * time whatever the number of blocks */
+#define SHM_ALLOC_N_CLASSES (sizeof (unsigned long) * 8)
+
 /* This is the allocated space to hold multiple blocks */
 struct _ShmAllocSpace
 {
   /* The total size of this space */
   size_t size;
 
-  /* chained list of the blocks contained in this space */
+  /* chained list of all the blocks, allocated or free, by offset */
   ShmAllocBlock *blocks;
+
+  /* the free blocks of each size class, and a bit for each class that
+   * has some */
+  ShmAllocBlock *free_blocks[SHM_ALLOC_N_CLASSES];
+  unsigned long free_classes;
+
+  /* the last allocated block, most likely to be looked up */
+  ShmAllocBlock *last_block;
+
+  ShmAllocStats stats;
 };
 
 /* A single block of data */
 struct _ShmAllocBlock
 {
+  /* 0 if the block is free */
   int use_count;
 
   /* Pointer back to the AllocSpace where this block is */
@@ -56,10 +72,125 @@ struct _ShmAllocBlock
   /* The size of the block */
   unsigned long size;
 
-  /* Pointer to the next block in the chain */
+  /* The blocks before and after this one in the space */
+  ShmAllocBlock *prev;
   ShmAllocBlock *next;
+
+  /* The neighbours in the list of free blocks of the same size class */
+  ShmAllocBlock *prev_free;
+  ShmAllocBlock *next_free;
 };
 
+/* Index of the highest bit set in @val, which must not be 0 */
+static unsigned int
+highest_bit (unsigned long val)
+{
+#ifdef __GNUC__
+  return SHM_ALLOC_N_CLASSES - 1 - __builtin_clzl (val);
+#else
+  unsigned int bit = 0;
+
+  while (val >>= 1)
+    bit++;
+
+  return bit;
+#endif
+}
+
+/* Index of the lowest bit set in @val, which must not be 0 */
+static unsigned int
+lowest_bit (unsigned long val)
+{
+#ifdef __GNUC__
+  return __builtin_ctzl (val);
+#else
+  unsigned int bit = 0;
+
+  while (!(val & 1)) {
+    val >>= 1;
+    bit++;
+  }
+
+  return bit;
+#endif
+}
+
+static ShmAllocBlock *
+shm_alloc_space_new_free_block (ShmAllocSpace * self, unsigned long offset,
+    unsigned long size)
+{
+  ShmAllocBlock *block = spalloc_new (ShmAllocBlock);
+
+  memset (block, 0, sizeof (ShmAllocBlock));
+  block->space = self;
+  block->offset = offset;
+  block->size = size;
+
+  return block;
+}
+
+static void
+shm_alloc_space_add_free (ShmAllocSpace * self, ShmAllocBlock * block)
+{
+  unsigned int size_class = highest_bit (block->size);
+
+  block->prev_free = NULL;
+  block->next_free = self->free_blocks[size_class];
+  if (block->next_free)
+    block->next_free->prev_free = block;
+  self->free_blocks[size_class] = block;
+  self->free_classes |= 1UL << size_class;
+
+  self->stats.free_size += block->size;
+  self->stats.n_free_blocks++;
+}
+
+static void
+shm_alloc_space_remove_free (ShmAllocSpace * self, ShmAllocBlock * block)
+{
+  unsigned int size_class = highest_bit (block->size);
+
+  if (block->prev_free)
+    block->prev_free->next_free = block->next_free;
+  else
+    self->free_blocks[size_class] = block->next_free;
+  if (block->next_free)
+    block->next_free->prev_free = block->prev_free;
+  if (!self->free_blocks[size_class])
+    self->free_classes &= ~(1UL << size_class);
+
+  self->stats.free_size -= block->size;
+  self->stats.n_free_blocks--;
+}
+
+/* Finds a free block of at least @size bytes */
+static ShmAllocBlock *
+shm_alloc_space_find_free (ShmAllocSpace * self, unsigned long size)
+{
+  unsigned int size_class = highest_bit (size);
+  unsigned long classes;
+  ShmAllocBlock *item;
+
+  /* any block of a higher class is big enough, and so are those of the
+   * class of @size if it is a power of 2 */
+  if (size == 1UL << size_class)
+    classes = self->free_classes >> size_class << size_class;
+  else if (size_class + 1 < SHM_ALLOC_N_CLASSES)
+    classes = self->free_classes >> (size_class + 1) << (size_class + 1);
+  else
+    classes = 0;
+
+  if (classes)
+    return self->free_blocks[lowest_bit (classes)];
+
+  /* else only some of the class of @size may be */
+  for (item = self->free_blocks[size_class]; item; item = item->next_free) {
+    if (item->size >= size)
+      return item;
+  }
+
+  return NULL;
+}
 
 ShmAllocSpace *
 shm_alloc_space_new (size_t size)
@@ -70,13 +201,23 @@ shm_alloc_space_new (size_t size)
 
   self->size = size;
 
+  if (size > 0) {
+    self->blocks = shm_alloc_space_new_free_block (self, 0, size);
+    shm_alloc_space_add_free (self, self->blocks);
+  }
+
   return self;
 }
 
 void
 shm_alloc_space_free (ShmAllocSpace * self)
 {
-  assert (self && self->blocks == NULL);
+  assert (self && self->stats.n_blocks == 0);
+
+  if (self->blocks) {
+    assert (self->blocks->next == NULL);
+    spalloc_free (ShmAllocBlock, self->blocks);
+  }
   spalloc_free (ShmAllocSpace, self);
 }
 
@@ -85,42 +226,40 @@ ShmAllocBlock *
 shm_alloc_space_alloc_block (ShmAllocSpace * self, unsigned long size)
 {
   ShmAllocBlock *block;
-  ShmAllocBlock *item = NULL;
-  ShmAllocBlock *prev_item = NULL;
-  unsigned long prev_end_offset = 0;
 
+  /* Empty blocks still need an offset of their own */
+  if (size == 0)
+    size = 1;
 
-  for (item = self->blocks; item; item = item->next) {
-    unsigned long max_size = 0;
+  block = shm_alloc_space_find_free (self, size);
 
-    max_size = item->offset - prev_end_offset;
+  /* Return NULL if there is no big enough space */
+  if (!block) {
+    self->stats.n_failed++;
+    return NULL;
+  }
 
-    if (max_size >= size)
-      break;
+  shm_alloc_space_remove_free (self, block);
 
-    prev_end_offset = item->offset + item->size;
-    prev_item = item;
-  }
+  /* Give back what is left after the block */
+  if (block->size > size) {
+    ShmAllocBlock *rest = shm_alloc_space_new_free_block (self,
+        block->offset + size, block->size - size);
 
-  /* Return NULL if there is no big enough space, otherwise, there is space
-   * at the end */
-  assert (prev_end_offset <= self->size);
-  if (!item && self->size - prev_end_offset < size)
-    return NULL;
+    rest->prev = block;
+    rest->next = block->next;
+    if (rest->next)
+      rest->next->prev = rest;
+    block->next = rest;
+    block->size = size;
+    shm_alloc_space_add_free (self, rest);
+  }
 
-  block = spalloc_new (ShmAllocBlock);
-  memset (block, 0, sizeof (ShmAllocBlock));
-  block->offset = prev_end_offset;
-  block->size = size;
   block->use_count = 1;
-  block->space = self;
-
-  if (prev_item)
-    prev_item->next = block;
-  else
-    self->blocks = block;
+  self->last_block = block;
 
-  block->next = item;
+  self->stats.allocated_size += size;
+  self->stats.n_blocks++;
 
   return block;
 }
@@ -131,35 +270,60 @@ shm_alloc_space_alloc_block_get_offset (ShmAllocBlock * block)
   return block->offset;
 }
 
+/* Merges the block that follows @block into it, after it was taken out of
+ * the free lists */
+static void
+shm_alloc_space_merge_next (ShmAllocBlock * block)
+{
+  ShmAllocBlock *next = block->next;
+
+  block->size += next->size;
+  block->next = next->next;
+  if (block->next)
+    block->next->prev = block;
+
+  spalloc_free (ShmAllocBlock, next);
+}
+
 static void
 shm_alloc_space_free_block (ShmAllocBlock * block)
 {
-  ShmAllocBlock *item = NULL;
-  ShmAllocBlock *prev_item = NULL;
   ShmAllocSpace *self = block->space;
-
-  for (item = self->blocks; item; item = item->next) {
-    if (item == block) {
-      if (prev_item)
-        prev_item->next = item->next;
-      else
-        self->blocks = item->next;
-      break;
-    }
-    prev_item = item;
+  ShmAllocBlock *prev = block->prev;
+
+  block->use_count = 0;
+  self->stats.allocated_size -= block->size;
+  self->stats.n_blocks--;
+  if (self->last_block == block)
+    self->last_block = NULL;
+
+  /* Merge with the free neighbours, so that free space is never split */
+  if (block->next && block->next->use_count == 0) {
+    shm_alloc_space_remove_free (self, block->next);
+    shm_alloc_space_merge_next (block);
+  }
+  if (prev && prev->use_count == 0) {
+    shm_alloc_space_remove_free (self, prev);
+    shm_alloc_space_merge_next (prev);
+    block = prev;
   }
 
-  spalloc_free (ShmAllocBlock, block);
+  shm_alloc_space_add_free (self, block);
 }
 
 ShmAllocBlock *
 shm_alloc_space_block_get (ShmAllocSpace * self, unsigned long offset)
 {
-  ShmAllocBlock *block = NULL;
+  ShmAllocBlock *block = self->last_block;
+
+  /* usually the block that was just allocated is sent right away */
+  if (block && block->offset <= offset && (block->offset + block->size) >
+      offset)
+    return block;
 
   for (block = self->blocks; block; block = block->next) {
     if (block->offset <= offset && (block->offset + block->size) > offset)
-      return block;
+      return block->use_count > 0 ? block : NULL;
   }
 
   return NULL;
@@ -180,3 +344,20 @@ shm_alloc_space_block_dec (ShmAllocBlock * block)
   if (block->use_count <= 0)
     shm_alloc_space_free_block (block);
 }
+
+void
+shm_alloc_space_get_stats (ShmAllocSpace * self, ShmAllocStats * stats)
+{
+  *stats = self->stats;
+
+  /* the largest free block is in the highest class that has some */
+  stats->largest_free_size = 0;
+  if (self->free_classes) {
+    unsigned int size_class = highest_bit (self->free_classes);
+    ShmAllocBlock *item;
+
+    for (item = self->free_blocks[size_class]; item; item = item->next_free)
+      if (item->size > stats->largest_free_size)
+        stats->largest_free_size = item->size;
+  }
+}
@@ -52,6 +52,23 @@ extern "C" {
 
 typedef struct _ShmAllocSpace ShmAllocSpace;
 typedef struct _ShmAllocBlock ShmAllocBlock;
+typedef struct _ShmAllocStats ShmAllocStats;
+
+/* The use of a space, more free blocks for the same free size mean more
+ * fragmentation */
+struct _ShmAllocStats
+{
+  /* size and number of the allocated blocks */
+  unsigned long allocated_size;
+  unsigned long n_blocks;
+  /* size and number of the free blocks */
+  unsigned long free_size;
+  unsigned long n_free_blocks;
+  /* the largest block that can be allocated */
+  unsigned long largest_free_size;
+  /* the number of allocations that did not find enough space */
+  unsigned long n_failed;
+};
 
 ShmAllocSpace *shm_alloc_space_new (size_t size);
 void shm_alloc_space_free (ShmAllocSpace * self);
@@ -66,6 +83,7 @@ void shm_alloc_space_block_dec (ShmAllocBlock * block);
 ShmAllocBlock * shm_alloc_space_block_get (ShmAllocSpace * space,
     unsigned long offset);
 
+void shm_alloc_space_get_stats (ShmAllocSpace * self, ShmAllocStats * stats);
 
 #ifdef __cplusplus
 }
@@ -27,6 +27,11 @@
 #include "config.h"
 #endif
 
+#ifdef HAVE_MEMFD_CREATE
+/* For memfd_create() and the file seals */
+#define _GNU_SOURCE
+#endif
+
 #ifdef HAVE_OSX
 #ifndef MSG_NOSIGNAL
 #define MSG_NOSIGNAL SO_NOSIGPIPE
@@ -49,13 +54,21 @@
 
 #include "shmalloc.h"
 
+#if defined (HAVE_MEMFD_CREATE) && defined (F_ADD_SEALS)
+#define SHM_HAVE_MEMFD
+#ifndef F_SEAL_FUTURE_WRITE
+#define F_SEAL_FUTURE_WRITE 0x0010
+#endif
+#endif
+
 /*
  * The protocol over the pipe is in packets
  *
  * The defined types are:
  * type 1: new shm area
  * Area length
- * Size of path (followed by path)
+ * Size of path (followed by path), or 0 if the fd of the area is passed
+ * with the packet
  *
  * type 2: Close shm area:
  * No payload
@@ -67,9 +80,32 @@
  * type 4: ack buffer
  * offset
  *
- * Type 4 goes from the client to the server
+ * type 5: new ring
+ * Number of entries
+ * Size of path (followed by path), or 0 if the fd of the area is passed
+ * with the packet
+ *
+ * type 6: wake up
+ * No payload
+ *
+ * Type 4 goes from the client to the server, type 6 goes both ways
  * The rest are from the server to the client
  * The client should never write in the SHM
+ *
+ * If the writer has a ring size, it creates a separate ring area for each
+ * client, which both sides map read-write, and announces it with type 5
+ * right after the first shm area. From then on, the writer sends the
+ * buffers (and the closing of shm areas) to that client through one single
+ * producer single consumer ring, and the client releases them through
+ * another one, instead of using types 2, 3 and 4. A side that finds a ring
+ * empty marks itself as waiting before it polls the socket, and only then
+ * does the other side send it a type 6 after adding to the ring. New shm
+ * areas are still announced on the socket, a client that finds a buffer of
+ * an area it does not know yet reads the socket first.
+ *
+ * If the writer uses memfd, its areas have no path. It passes their fds
+ * with SCM_RIGHTS instead, sealed so that they can not shrink (and on
+ * recent kernels, so that nobody else can map them writable).
  */
 
 
@@ -80,7 +116,58 @@ enum
   COMMAND_NEW_SHM_AREA = 1,
   COMMAND_CLOSE_SHM_AREA = 2,
   COMMAND_NEW_BUFFER = 3,
-  COMMAND_ACK_BUFFER = 4
+  COMMAND_ACK_BUFFER = 4,
+  COMMAND_NEW_RING = 5,
+  COMMAND_WAKEUP = 6
+};
+
+enum
+{
+  AREA_FLAG_RING = (1 << 0),
+  AREA_FLAG_MEMFD = (1 << 1)
+};
+
+/* Keeps the fields written by each side of a ring on separate cache lines */
+#define RING_ALIGN 64
+#define MAX_RING_SIZE 65536
+
+/* Orders the accesses to a ring against the other process */
+#define ring_barrier() __sync_synchronize ()
+
+/* The size of an entry that closes area_id instead of carrying a buffer */
+#define RING_CLOSE_SHM_AREA ((unsigned long) -1)
+
+typedef struct
+{
+  int area_id;
+  unsigned long offset;
+  unsigned long size;
+} ShmRingEntry;
+
+typedef struct
+{
+  /* Written by the producer only */
+  volatile unsigned int head;
+  /* Set by the producer while it has entries that did not fit */
+  volatile int overflow;
+  char pad1[RING_ALIGN - 2 * sizeof (int)];
+
+  /* Written by the consumer only */
+  volatile unsigned int tail;
+  /* Set by the consumer before it polls the socket for a wake up */
+  volatile int waiting;
+  char pad2[RING_ALIGN - 2 * sizeof (int)];
+
+  ShmRingEntry entries[0];
+} ShmRing;
+
+typedef struct _ShmRingPending ShmRingPending;
+
+struct _ShmRingPending
+{
+  ShmRingEntry entry;
+
+  ShmRingPending *next;
 };
 
 typedef struct _ShmArea ShmArea;
@@ -91,6 +178,10 @@ struct _ShmArea
 
   int use_count;
   int is_writer;
+  /* Passed as an fd instead of a path */
+  int is_memfd;
+  /* Writer: nobody else can map the memfd writable */
+  int is_write_sealed;
 
   int shm_fd;
 
@@ -141,12 +232,34 @@ struct _ShmPipe
   ShmClient *clients;
 
   mode_t perms;
+  /* Writer: creates its areas with memfd */
+  int use_memfd;
+
+  /* Writer: number of entries of the rings of new clients, 0 for none */
+  unsigned int ring_size;
+
+  /* Client: the rings shared with the writer, if it offered them */
+  ShmArea *ring_area;
+  ShmRing *buffer_ring;
+  ShmRing *release_ring;
 };
 
 struct _ShmClient
 {
   int fd;
 
+  /* The rings of the client, if the writer has a ring size */
+  ShmArea *ring_area;
+  unsigned int ring_size;
+  ShmRing *buffer_ring;
+  ShmRing *release_ring;
+
+  /* Entries that did not fit in buffer_ring yet, oldest first, at most
+   * ring_size of them */
+  ShmRingPending *pending;
+  ShmRingPending **pending_tail;
+  unsigned int n_pending;
+
   ShmClient *next;
 };
 
@@ -182,7 +295,8 @@ struct CommandBuffer
   } payload;
 };
 
-static ShmArea *sp_open_shm (char *path, int id, mode_t perms, size_t size);
+static ShmArea *sp_open_shm (char *path, int id, mode_t perms, size_t size,
+    int flags);
 static void sp_close_shm (ShmArea * area);
 static int sp_shmbuf_dec (ShmPipe * self, ShmBuffer * buf,
     ShmBuffer * prev_buf, ShmClient * client, void **tag);
@@ -197,7 +311,7 @@ static void sp_shm_area_dec (ShmPipe * self, ShmArea * area);
   } while (0)
 
 ShmPipe *
-sp_writer_create (const char *path, size_t size, mode_t perms)
+sp_writer_create (const char *path, size_t size, mode_t perms, int use_memfd)
 {
   ShmPipe *self = spalloc_new (ShmPipe);
   int flags;
@@ -244,7 +358,9 @@ sp_writer_create (const char *path, size_t size, mode_t perms)
   if (listen (self->main_socket, LISTEN_BACKLOG) < 0)
     RETURN_ERROR ("listen() failed (%d): %s\n", errno, strerror (errno));
 
-  self->shm_area = sp_open_shm (NULL, ++self->next_area_id, perms, size);
+  self->use_memfd = use_memfd;
+  self->shm_area = sp_open_shm (NULL, ++self->next_area_id, perms, size,
+      use_memfd ? AREA_FLAG_MEMFD : 0);
 
   self->perms = perms;
 
@@ -267,16 +383,19 @@ sp_writer_create (const char *path, size_t size, mode_t perms)
  * sp_open_shm:
  * @path: Path of the shm area for a reader,
  *  NULL if this is a writer (then it will allocate its own path)
+ * @flags: #AREA_FLAG_RING if this is the ring area of a client, which the
+ *  reader maps read-write too and which needs no allocation space,
+ *  #AREA_FLAG_MEMFD if a writer creates it without a path, to pass its fd
  *
  * Opens a ShmArea
  */
 
 static ShmArea *
-sp_open_shm (char *path, int id, mode_t perms, size_t size)
+sp_open_shm (char *path, int id, mode_t perms, size_t size, int flags)
 {
   ShmArea *area = spalloc_new (ShmArea);
   char tmppath[32];
-  int flags;
+  int oflags;
   int prot;
   int i = 0;
 
@@ -291,22 +410,30 @@ sp_open_shm (char *path, int id, mode_t perms, size_t size)
 
 
   if (path)
-    flags = O_RDONLY;
+    oflags = (flags & AREA_FLAG_RING) ? O_RDWR : O_RDONLY;
   else
 #ifdef HAVE_OSX
-    flags = O_RDWR | O_CREAT | O_EXCL;
+    oflags = O_RDWR | O_CREAT | O_EXCL;
 #else
-    flags = O_RDWR | O_CREAT | O_TRUNC | O_EXCL;
+    oflags = O_RDWR | O_CREAT | O_TRUNC | O_EXCL;
 #endif
 
   area->shm_fd = -1;
 
   if (path) {
-    area->shm_fd = shm_open (path, flags, perms);
+    area->shm_fd = shm_open (path, oflags, perms);
+  } else if (flags & AREA_FLAG_MEMFD) {
+#ifdef SHM_HAVE_MEMFD
+    area->shm_fd = memfd_create ("shmpipe", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    area->is_memfd = 1;
+#else
+    errno = ENOSYS;
+#endif
+    snprintf (tmppath, sizeof (tmppath), "memfd");
   } else {
     do {
       snprintf (tmppath, sizeof (tmppath), "/shmpipe.%5d.%5d", getpid (), i++);
-      area->shm_fd = shm_open (tmppath, flags, perms);
+      area->shm_fd = shm_open (tmppath, oflags, perms);
     } while (area->shm_fd < 0 && errno == EEXIST);
   }
 
@@ -315,7 +442,8 @@ sp_open_shm (char *path, int id, mode_t perms, size_t size)
         path ? path : tmppath, errno, strerror (errno));
 
   if (!path) {
-    area->shm_area_name = strdup (tmppath);
+    if (!area->is_memfd)
+      area->shm_area_name = strdup (tmppath);
 
     if (ftruncate (area->shm_fd, size))
       RETURN_ERROR ("Could not resize memory area to header size,"
@@ -324,7 +452,7 @@ sp_open_shm (char *path, int id, mode_t perms, size_t size)
     prot = PROT_READ | PROT_WRITE;
   } else {
     area->shm_area_name = strdup (path);
-    prot = PROT_READ;
+    prot = (flags & AREA_FLAG_RING) ? PROT_READ | PROT_WRITE : PROT_READ;
   }
 
   area->shm_area_buf = mmap (NULL, size, prot, MAP_SHARED, area->shm_fd, 0);
@@ -332,14 +460,80 @@ sp_open_shm (char *path, int id, mode_t perms, size_t size)
   if (area->shm_area_buf == MAP_FAILED)
     RETURN_ERROR ("mmap failed (%d): %s\n", errno, strerror (errno));
 
+#ifdef SHM_HAVE_MEMFD
+  if (area->is_memfd) {
+    int seals = F_SEAL_SHRINK | F_SEAL_GROW;
+
+    /* Only our own mapping stays writable, on kernels that know how. The
+     * readers can not write to a ring they can not map writable. */
+    if (!(flags & AREA_FLAG_RING) &&
+        fcntl (area->shm_fd, F_ADD_SEALS, seals | F_SEAL_FUTURE_WRITE) == 0) {
+      area->is_write_sealed = 1;
+      seals = 0;
+    }
+
+    if (seals && fcntl (area->shm_fd, F_ADD_SEALS, seals) < 0)
+      RETURN_ERROR ("Could not seal memory area (%d): %s\n", errno,
+          strerror (errno));
+
+    if (fcntl (area->shm_fd, F_ADD_SEALS, F_SEAL_SEAL) < 0)
+      RETURN_ERROR ("Could not seal memory area (%d): %s\n", errno,
+          strerror (errno));
+  }
+#endif
+
   area->id = id;
 
-  if (!path)
+  if (!path && !(flags & AREA_FLAG_RING))
     area->allocspace = shm_alloc_space_new (area->shm_area_len);
 
   return area;
 }
 
+/**
+ * sp_open_shm_fd:
+ * @fd: The fd of the area, which the area owns from now on
+ *
+ * Opens the ShmArea of a reader from the fd passed by the writer
+ */
+
+static ShmArea *
+sp_open_shm_fd (int fd, int id, size_t size, int flags)
+{
+  ShmArea *area = spalloc_new (ShmArea);
+  struct stat st;
+  int prot;
+
+  memset (area, 0, sizeof (ShmArea));
+
+  area->shm_area_buf = MAP_FAILED;
+  area->use_count = 1;
+  area->shm_area_len = size;
+  area->shm_fd = fd;
+  area->is_memfd = 1;
+
+#ifdef SHM_HAVE_MEMFD
+  /* A writer that can shrink the area under us could make us crash */
+  if (!(fcntl (fd, F_GET_SEALS) & F_SEAL_SHRINK))
+    RETURN_ERROR ("Memory area is not sealed (%d): %s\n", errno,
+        strerror (errno));
+#endif
+
+  if (fstat (fd, &st) < 0 || (size_t) st.st_size < size)
+    RETURN_ERROR ("Memory area is smaller than %lu bytes (%d): %s\n",
+        (unsigned long) size, errno, strerror (errno));
+
+  prot = (flags & AREA_FLAG_RING) ? PROT_READ | PROT_WRITE : PROT_READ;
+  area->shm_area_buf = mmap (NULL, size, prot, MAP_SHARED, fd, 0);
+
+  if (area->shm_area_buf == MAP_FAILED)
+    RETURN_ERROR ("mmap failed (%d): %s\n", errno, strerror (errno));
+
+  area->id = id;
+
+  return area;
+}
+
 #undef RETURN_ERROR
 
 static void
@@ -397,6 +591,76 @@ sp_shm_area_dec (ShmPipe * self, ShmArea * area)
   }
 }
 
+/* Size of one ring, the release ring follows the buffer ring in the area */
+static size_t
+sp_ring_get_size (unsigned int ring_size)
+{
+  size_t size = sizeof (ShmRing) + ring_size * sizeof (ShmRingEntry);
+
+  return (size + RING_ALIGN - 1) & ~((size_t) RING_ALIGN - 1);
+}
+
+/* Returns 0 if @ring is full. Sets @wake if the consumer waits on the
+ * socket for it. */
+static int
+sp_ring_push (ShmRing * ring, unsigned int ring_size,
+    const ShmRingEntry * entry, int *wake)
+{
+  unsigned int head = ring->head;
+
+  if (head - ring->tail >= ring_size)
+    return 0;
+
+  ring->entries[head & (ring_size - 1)] = *entry;
+  /* The entry must be visible before the head that covers it, and the head
+   * before we look at whether the consumer went to sleep */
+  ring_barrier ();
+  ring->head = head + 1;
+  ring_barrier ();
+  *wake = ring->waiting;
+
+  return 1;
+}
+
+/* Copies the oldest entry of @ring, returns 0 if it is empty */
+static int
+sp_ring_peek (ShmRing * ring, unsigned int ring_size, ShmRingEntry * entry)
+{
+  unsigned int tail = ring->tail;
+
+  if (ring->head == tail)
+    return 0;
+
+  ring_barrier ();
+  *entry = ring->entries[tail & (ring_size - 1)];
+
+  return 1;
+}
+
+static void
+sp_ring_pop (ShmRing * ring)
+{
+  /* Done reading the entry before the producer may overwrite it */
+  ring_barrier ();
+  ring->tail++;
+}
+
+/* Marks the consumer as waiting if @ring is empty, returns 0 if it is not
+ * empty anymore */
+static int
+sp_ring_wait (ShmRing * ring)
+{
+  ring->waiting = 1;
+  ring_barrier ();
+
+  if (ring->head != ring->tail) {
+    ring->waiting = 0;
+    return 0;
+  }
+
+  return 1;
+}
+
 void *
 sp_get_data (ShmPipe * self)
 {
@@ -446,6 +710,14 @@ sp_writer_close (ShmPipe * self, sp_buffer_free_callback callback,
   while (self->clients)
     sp_writer_close_client (self, self->clients, callback, user_data);
 
+  if (self->ring_area) {
+    self->ring_area->use_count--;
+    sp_close_shm (self->ring_area);
+    self->ring_area = NULL;
+    self->buffer_ring = NULL;
+    self->release_ring = NULL;
+  }
+
   sp_dec (self);
 }
 
@@ -485,6 +757,226 @@ send_command (int fd, struct CommandBuffer *cb, unsigned short int type,
   return 1;
 }
 
+static int
+send_command_fd (int fd, struct CommandBuffer *cb, unsigned short int type,
+    int area_id, int passed_fd)
+{
+  struct msghdr msg = { 0 };
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  union
+  {
+    struct cmsghdr hdr;
+    char buf[CMSG_SPACE (sizeof (int))];
+  } control;
+
+  cb->type = type;
+  cb->area_id = area_id;
+
+  iov.iov_base = cb;
+  iov.iov_len = sizeof (struct CommandBuffer);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof (control.buf);
+
+  cmsg = CMSG_FIRSTHDR (&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN (sizeof (int));
+  memcpy (CMSG_DATA (cmsg), &passed_fd, sizeof (int));
+
+  if (sendmsg (fd, &msg, MSG_NOSIGNAL) != sizeof (struct CommandBuffer))
+    return 0;
+
+  return 1;
+}
+
+/* Announces @area to the client on @fd, with its path or with its fd. The
+ * caller sets the size in @cb. */
+static int
+send_area (int fd, struct CommandBuffer *cb, unsigned short int type,
+    int area_id, ShmArea * area)
+{
+  int pathlen;
+
+  if (area->is_memfd) {
+    cb->payload.new_shm_area.path_size = 0;
+    return send_command_fd (fd, cb, type, area_id, area->shm_fd);
+  }
+
+  pathlen = strlen (area->shm_area_name) + 1;
+  cb->payload.new_shm_area.path_size = pathlen;
+  if (!send_command (fd, cb, type, area_id))
+    return 0;
+
+  if (send (fd, area->shm_area_name, pathlen, MSG_NOSIGNAL) != pathlen)
+    return 0;
+
+  return 1;
+}
+
+static int
+sp_writer_ring_wake (ShmClient * client, int wake)
+{
+  struct CommandBuffer cb = { 0 };
+
+  if (!wake)
+    return 1;
+
+  return send_command (client->fd, &cb, COMMAND_WAKEUP, 0);
+}
+
+/* Moves the entries that did not fit before into the buffer ring of
+ * @client, as far as they fit now */
+static int
+sp_writer_ring_flush (ShmClient * client)
+{
+  int wake = 0;
+
+  while (client->pending) {
+    ShmRingPending *pending = client->pending;
+    int pending_wake = 0;
+
+    if (!sp_ring_push (client->buffer_ring, client->ring_size,
+            &pending->entry, &pending_wake))
+      break;
+    wake |= pending_wake;
+
+    client->pending = pending->next;
+    client->n_pending--;
+    spalloc_free (ShmRingPending, pending);
+  }
+
+  if (!client->pending) {
+    client->pending_tail = &client->pending;
+    client->buffer_ring->overflow = 0;
+  }
+
+  return sp_writer_ring_wake (client, wake);
+}
+
+/* Sends @entry through the buffer ring of @client. If the ring is full, it
+ * is kept behind the entries that did not fit before, so that the client
+ * gets them in order, and the client asks for them once it has emptied the
+ * ring. A client that is another ring behind has stopped reading it, its
+ * socket is shut down so that the writer closes it like a client that left,
+ * and 0 is returned. */
+static int
+sp_writer_ring_queue (ShmClient * client, const ShmRingEntry * entry)
+{
+  ShmRingPending *pending;
+  int wake = 0;
+
+  if (!client->pending &&
+      sp_ring_push (client->buffer_ring, client->ring_size, entry, &wake))
+    return sp_writer_ring_wake (client, wake);
+
+  if (client->n_pending >= client->ring_size) {
+    shutdown (client->fd, SHUT_RDWR);
+    return 0;
+  }
+
+  pending = spalloc_new (ShmRingPending);
+  pending->entry = *entry;
+  pending->next = NULL;
+  *client->pending_tail = pending;
+  client->pending_tail = &pending->next;
+  client->n_pending++;
+
+  /* The client may have emptied the ring before it could see the flag */
+  client->buffer_ring->overflow = 1;
+  ring_barrier ();
+
+  return sp_writer_ring_flush (client);
+}
+
+static void
+sp_writer_ring_close (ShmClient * client)
+{
+  while (client->pending) {
+    ShmRingPending *pending = client->pending;
+
+    client->pending = pending->next;
+    spalloc_free (ShmRingPending, pending);
+  }
+  client->pending_tail = &client->pending;
+  client->n_pending = 0;
+
+  if (client->ring_area) {
+    client->ring_area->use_count--;
+    sp_close_shm (client->ring_area);
+  }
+  client->ring_area = NULL;
+  client->buffer_ring = NULL;
+  client->release_ring = NULL;
+}
+
+/* Returns 0 if the socket of @client failed, the client then keeps using
+ * the socket if the ring area could not be created */
+static int
+sp_writer_ring_open (ShmPipe * self, ShmClient * client)
+{
+  struct CommandBuffer cb = { 0 };
+  size_t ring_len = sp_ring_get_size (self->ring_size);
+  int flags = AREA_FLAG_RING;
+
+  if (self->use_memfd)
+    flags |= AREA_FLAG_MEMFD;
+
+  client->ring_area = sp_open_shm (NULL, 0, self->perms, 2 * ring_len, flags);
+  if (!client->ring_area)
+    return 1;
+
+  client->ring_size = self->ring_size;
+  client->buffer_ring = (ShmRing *) client->ring_area->shm_area_buf;
+  client->release_ring =
+      (ShmRing *) (client->ring_area->shm_area_buf + ring_len);
+
+  cb.payload.new_shm_area.size = client->ring_size;
+  return send_area (client->fd, &cb, COMMAND_NEW_RING, 0, client->ring_area);
+}
+
+/* Whether the clients can only map the current area read-only. It is always
+ * 0 without memfd, and with memfd on kernels older than 5.1, which don't
+ * know F_SEAL_FUTURE_WRITE. */
+int
+sp_writer_is_write_sealed (ShmPipe * self)
+{
+  return self->shm_area->is_write_sealed;
+}
+
+void
+sp_writer_set_ring_size (ShmPipe * self, unsigned int ring_size)
+{
+  unsigned int size = 1;
+
+  if (ring_size == 0) {
+    self->ring_size = 0;
+    return;
+  }
+
+  if (ring_size > MAX_RING_SIZE)
+    ring_size = MAX_RING_SIZE;
+  while (size < ring_size)
+    size <<= 1;
+
+  self->ring_size = size;
+}
+
+void
+sp_writer_set_waiting (ShmPipe * self, int waiting)
+{
+  ShmClient *client;
+
+  for (client = self->clients; client; client = client->next) {
+    if (client->release_ring)
+      client->release_ring->waiting = waiting;
+  }
+
+  ring_barrier ();
+}
+
 int
 sp_writer_resize (ShmPipe * self, size_t size)
 {
@@ -492,12 +984,12 @@ sp_writer_resize (ShmPipe * self, size_t size)
   ShmArea *old_current;
   ShmClient *client;
   int c = 0;
-  int pathlen;
 
   if (self->shm_area->shm_area_len == size)
     return 0;
 
-  newarea = sp_open_shm (NULL, ++self->next_area_id, self->perms, size);
+  newarea = sp_open_shm (NULL, ++self->next_area_id, self->perms, size,
+      self->use_memfd ? AREA_FLAG_MEMFD : 0);
 
   if (!newarea)
     return -1;
@@ -506,22 +998,23 @@ sp_writer_resize (ShmPipe * self, size_t size)
   newarea->next = self->shm_area;
   self->shm_area = newarea;
 
-  pathlen = strlen (newarea->shm_area_name) + 1;
-
   for (client = self->clients; client; client = client->next) {
     struct CommandBuffer cb = { 0 };
 
-    if (!send_command (client->fd, &cb, COMMAND_CLOSE_SHM_AREA,
-            old_current->id))
-      continue;
+    if (client->buffer_ring) {
+      ShmRingEntry entry = { old_current->id, 0, RING_CLOSE_SHM_AREA };
 
-    cb.payload.new_shm_area.size = newarea->shm_area_len;
-    cb.payload.new_shm_area.path_size = pathlen;
-    if (!send_command (client->fd, &cb, COMMAND_NEW_SHM_AREA, newarea->id))
+      /* Behind the buffers of the old area that are still in the ring */
+      if (!sp_writer_ring_queue (client, &entry))
+        continue;
+    } else if (!send_command (client->fd, &cb, COMMAND_CLOSE_SHM_AREA,
+            old_current->id)) {
       continue;
+    }
 
-    if (send (client->fd, newarea->shm_area_name, pathlen, MSG_NOSIGNAL) !=
-        pathlen)
+    cb.payload.new_shm_area.size = newarea->shm_area_len;
+    if (!send_area (client->fd, &cb, COMMAND_NEW_SHM_AREA, newarea->id,
+            newarea))
       continue;
     c++;
   }
@@ -615,10 +1108,19 @@ sp_writer_send_buf (ShmPipe * self, char *buf, size_t size, void *tag)
 
   for (client = self->clients; client; client = client->next) {
     struct CommandBuffer cb = { 0 };
-    cb.payload.buffer.offset = offset;
-    cb.payload.buffer.size = bsize;
-    if (!send_command (client->fd, &cb, COMMAND_NEW_BUFFER, self->shm_area->id))
-      continue;
+
+    if (client->buffer_ring) {
+      ShmRingEntry entry = { area->id, offset, bsize };
+
+      if (!sp_writer_ring_queue (client, &entry))
+        continue;
+    } else {
+      cb.payload.buffer.offset = offset;
+      cb.payload.buffer.size = bsize;
+      if (!send_command (client->fd, &cb, COMMAND_NEW_BUFFER,
+              self->shm_area->id))
+        continue;
+    }
     sb->clients[i++] = client->fd;
     c++;
   }
@@ -640,11 +1142,46 @@ sp_writer_send_buf (ShmPipe * self, char *buf, size_t size, void *tag)
 }
 
 static int
-recv_command (int fd, struct CommandBuffer *cb)
+recv_command (int fd, struct CommandBuffer *cb, int *passed_fd)
 {
+  struct msghdr msg = { 0 };
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  union
+  {
+    struct cmsghdr hdr;
+    char buf[CMSG_SPACE (sizeof (int))];
+  } control;
+  int received_fd = -1;
   int retval;
 
-  retval = recv (fd, cb, sizeof (struct CommandBuffer), MSG_DONTWAIT);
+  iov.iov_base = cb;
+  iov.iov_len = sizeof (struct CommandBuffer);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof (control.buf);
+
+  retval = recvmsg (fd, &msg, MSG_DONTWAIT);
+
+  if (retval > 0) {
+    for (cmsg = CMSG_FIRSTHDR (&msg); cmsg; cmsg = CMSG_NXTHDR (&msg, cmsg)) {
+      if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+          cmsg->cmsg_len == CMSG_LEN (sizeof (int)) && received_fd < 0) {
+        memcpy (&received_fd, CMSG_DATA (cmsg), sizeof (int));
+        fcntl (received_fd, F_SETFD, FD_CLOEXEC);
+      }
+    }
+  }
+
+  /* Only the client expects fds */
+  if (received_fd >= 0 && (!passed_fd || retval != sizeof (*cb))) {
+    close (received_fd);
+    received_fd = -1;
+  }
+  if (passed_fd)
+    *passed_fd = received_fd;
+
   if (retval == sizeof (struct CommandBuffer)) {
     return 1;
   } else {
@@ -652,36 +1189,76 @@ recv_command (int fd, struct CommandBuffer *cb)
   }
 }
 
+static char *
+recv_path (int fd, unsigned int path_size)
+{
+  char *path = malloc (path_size + 1);
+  ssize_t retval;
+
+  retval = recv (fd, path, path_size, 0);
+  if (retval != (ssize_t) path_size) {
+    free (path);
+    return NULL;
+  }
+  /* Ensure path is NULL terminated */
+  path[retval] = 0;
+
+  return path;
+}
+
+/* Opens the area announced by @cb, by the path that follows it on the
+ * socket or by @passed_fd, which it takes */
+static ShmArea *
+sp_client_open_area (ShmPipe * self, struct CommandBuffer *cb, int passed_fd,
+    size_t size, int flags)
+{
+  ShmArea *area;
+  char *area_name;
+
+  if (cb->payload.new_shm_area.path_size == 0) {
+    if (passed_fd < 0)
+      return NULL;
+    return sp_open_shm_fd (passed_fd, cb->area_id, size, flags);
+  }
+
+  if (passed_fd >= 0)
+    close (passed_fd);
+
+  area_name = recv_path (self->main_socket, cb->payload.new_shm_area.path_size);
+  if (!area_name)
+    return NULL;
+
+  area = sp_open_shm (area_name, cb->area_id, 0, size, flags);
+  free (area_name);
+
+  return area;
+}
+
 long int
 sp_client_recv (ShmPipe * self, char **buf)
 {
-  char *area_name = NULL;
   ShmArea *newarea;
   ShmArea *area;
   struct CommandBuffer cb;
-  int retval;
+  unsigned int ring_size;
+  size_t ring_len;
+  int passed_fd = -1;
 
-  if (!recv_command (self->main_socket, &cb))
+  if (!recv_command (self->main_socket, &cb, &passed_fd))
     return -1;
 
+  if (passed_fd >= 0 && cb.type != COMMAND_NEW_SHM_AREA &&
+      cb.type != COMMAND_NEW_RING) {
+    close (passed_fd);
+    passed_fd = -1;
+  }
+
   switch (cb.type) {
     case COMMAND_NEW_SHM_AREA:
-      assert (cb.payload.new_shm_area.path_size > 0);
       assert (cb.payload.new_shm_area.size > 0);
 
-      area_name = malloc (cb.payload.new_shm_area.path_size + 1);
-      retval = recv (self->main_socket, area_name,
-          cb.payload.new_shm_area.path_size, 0);
-      if (retval != cb.payload.new_shm_area.path_size) {
-        free (area_name);
-        return -3;
-      }
-      /* Ensure area_name is NULL terminated */
-      area_name[retval] = 0;
-
-      newarea = sp_open_shm (area_name, cb.area_id, 0,
-          cb.payload.new_shm_area.size);
-      free (area_name);
+      newarea = sp_client_open_area (self, &cb, passed_fd,
+          cb.payload.new_shm_area.size, 0);
       if (!newarea)
         return -4;
 
@@ -689,6 +1266,32 @@ sp_client_recv (ShmPipe * self, char **buf)
       self->shm_area = newarea;
       break;
 
+    case COMMAND_NEW_RING:
+      ring_size = cb.payload.new_shm_area.size;
+      if (ring_size == 0 || ring_size > MAX_RING_SIZE ||
+          (ring_size & (ring_size - 1)) != 0 || self->ring_area) {
+        if (passed_fd >= 0)
+          close (passed_fd);
+        return -5;
+      }
+
+      ring_len = sp_ring_get_size (ring_size);
+      self->ring_area = sp_client_open_area (self, &cb, passed_fd,
+          2 * ring_len, AREA_FLAG_RING);
+      /* Most likely the writer does not give us write access to it */
+      if (!self->ring_area)
+        return -6;
+
+      self->ring_size = ring_size;
+      self->buffer_ring = (ShmRing *) self->ring_area->shm_area_buf;
+      self->release_ring =
+          (ShmRing *) (self->ring_area->shm_area_buf + ring_len);
+      break;
+
+    case COMMAND_WAKEUP:
+      /* The buffers are in the ring, see sp_client_recv_ring() */
+      break;
+
     case COMMAND_CLOSE_SHM_AREA:
       for (area = self->shm_area; area; area = area->next) {
         if (area->id == cb.area_id) {
@@ -716,13 +1319,63 @@ sp_client_recv (ShmPipe * self, char **buf)
   return 0;
 }
 
+long int
+sp_client_recv_ring (ShmPipe * self, char **buf)
+{
+  struct CommandBuffer cb = { 0 };
+  ShmRingEntry entry;
+  ShmArea *area;
+
+  if (!self->buffer_ring)
+    return 0;
+
+  for (;;) {
+    if (!sp_ring_peek (self->buffer_ring, self->ring_size, &entry)) {
+      if (!sp_ring_wait (self->buffer_ring))
+        continue;
+
+      /* The writer has more for us than fitted in the ring */
+      if (self->buffer_ring->overflow &&
+          !send_command (self->main_socket, &cb, COMMAND_WAKEUP, 0))
+        return -1;
+
+      return 0;
+    }
+    self->buffer_ring->waiting = 0;
+
+    for (area = self->shm_area; area; area = area->next) {
+      if (area->id == entry.area_id)
+        break;
+    }
+
+    /* The new area is still waiting on the socket */
+    if (!area)
+      return 0;
+
+    sp_ring_pop (self->buffer_ring);
+
+    if (entry.size == RING_CLOSE_SHM_AREA) {
+      sp_shm_area_dec (self, area);
+      continue;
+    }
+
+    if (entry.offset > area->shm_area_len ||
+        entry.size > area->shm_area_len - entry.offset)
+      return -23;
+
+    *buf = area->shm_area_buf + entry.offset;
+    sp_shm_area_inc (area);
+    return entry.size;
+  }
+}
+
 int
 sp_writer_recv (ShmPipe * self, ShmClient * client, void **tag)
 {
   ShmBuffer *buf = NULL, *prev_buf = NULL;
   struct CommandBuffer cb;
 
-  if (!recv_command (client->fd, &cb))
+  if (!recv_command (client->fd, &cb, NULL))
     return -1;
 
   switch (cb.type) {
@@ -737,6 +1390,13 @@ sp_writer_recv (ShmPipe * self, ShmClient * client, void **tag)
       }
 
       return -2;
+
+    case COMMAND_WAKEUP:
+      /* The client emptied its ring while we had more for it */
+      if (client->buffer_ring && !sp_writer_ring_flush (client))
+        return -3;
+      return 1;
+
     default:
       return -99;
   }
@@ -744,11 +1404,70 @@ sp_writer_recv (ShmPipe * self, ShmClient * client, void **tag)
   return 0;
 }
 
+/* Whether @buf was sent to @client and not released by it yet */
+static int
+sp_shmbuf_has_client (ShmBuffer * buf, ShmClient * client)
+{
+  int i;
+
+  for (i = 0; i < buf->num_clients; i++) {
+    if (buf->clients[i] == client->fd)
+      return 1;
+  }
+
+  return 0;
+}
+
+int
+sp_writer_recv_releases (ShmPipe * self, sp_buffer_free_callback callback,
+    void *user_data)
+{
+  ShmClient *client;
+  int freed = 0;
+
+  for (client = self->clients; client; client = client->next) {
+    ShmRingEntry entry;
+    unsigned int i;
+
+    if (!client->release_ring)
+      continue;
+
+    /* The client writes the ring, so never trust it to be sane */
+    for (i = 0; i < client->ring_size &&
+        sp_ring_peek (client->release_ring, client->ring_size, &entry); i++) {
+      ShmBuffer *buf = NULL, *prev_buf = NULL;
+      void *tag = NULL;
+
+      sp_ring_pop (client->release_ring);
+
+      for (buf = self->buffers; buf; buf = buf->next) {
+        if (buf->shm_area->id == entry.area_id &&
+            buf->offset == entry.offset && sp_shmbuf_has_client (buf, client))
+          break;
+        prev_buf = buf;
+      }
+
+      if (buf && sp_shmbuf_dec (self, buf, prev_buf, client, &tag) == 0) {
+        if (callback)
+          callback (tag, user_data);
+        freed++;
+      }
+    }
+
+    /* Releases mean the client has been reading the buffer ring too */
+    if (client->pending)
+      sp_writer_ring_flush (client);
+  }
+
+  return freed;
+}
+
 int
 sp_client_recv_finish (ShmPipe * self, char *buf)
 {
   ShmArea *shm_area = NULL;
   unsigned long offset;
+  int area_id;
   struct CommandBuffer cb = { 0 };
 
   for (shm_area = self->shm_area; shm_area; shm_area = shm_area->next) {
@@ -760,12 +1479,47 @@ sp_client_recv_finish (ShmPipe * self, char *buf)
   assert (shm_area);
 
   offset = buf - shm_area->shm_area_buf;
+  area_id = shm_area->id;
 
   sp_shm_area_dec (self, shm_area);
 
+  if (self->release_ring) {
+    ShmRingEntry entry = { area_id, offset, 0 };
+    int wake = 0;
+
+    /* If it is full, the writer is busy and may as well read the socket */
+    if (sp_ring_push (self->release_ring, self->ring_size, &entry, &wake)) {
+      if (!wake)
+        return 1;
+      return send_command (self->main_socket, &cb, COMMAND_WAKEUP, 0);
+    }
+  } else {
+    area_id = self->shm_area->id;
+  }
+
   cb.payload.ack_buffer.offset = offset;
-  return send_command (self->main_socket, &cb, COMMAND_ACK_BUFFER,
-      self->shm_area->id);
+  return send_command (self->main_socket, &cb, COMMAND_ACK_BUFFER, area_id);
+}
+
+int
+sp_client_buf_get_fd (ShmPipe * self, char *buf, size_t * area_size,
+    unsigned long *offset)
+{
+  ShmArea *area;
+
+  for (area = self->shm_area; area; area = area->next) {
+    if (buf >= area->shm_area_buf &&
+        buf < area->shm_area_buf + area->shm_area_len)
+      break;
+  }
+
+  if (!area || !area->is_memfd)
+    return -1;
+
+  *area_size = area->shm_area_len;
+  *offset = buf - area->shm_area_buf;
+
+  return area->shm_fd;
 }
 
 ShmPipe *
@@ -811,7 +1565,6 @@ sp_writer_accept_client (ShmPipe * self)
   ShmClient *client = NULL;
   int fd;
   struct CommandBuffer cb = { 0 };
-  int pathlen = strlen (self->shm_area->shm_area_name) + 1;
 
 
   fd = accept (self->main_socket, NULL, NULL);
@@ -822,20 +1575,23 @@ sp_writer_accept_client (ShmPipe * self)
   }
 
   cb.payload.new_shm_area.size = self->shm_area->shm_area_len;
-  cb.payload.new_shm_area.path_size = pathlen;
-  if (!send_command (fd, &cb, COMMAND_NEW_SHM_AREA, self->shm_area->id)) {
+  if (!send_area (fd, &cb, COMMAND_NEW_SHM_AREA, self->shm_area->id,
+          self->shm_area)) {
     fprintf (stderr, "Sending new shm area failed: %s", strerror (errno));
     goto error;
   }
 
-  if (send (fd, self->shm_area->shm_area_name, pathlen, MSG_NOSIGNAL) !=
-      pathlen) {
-    fprintf (stderr, "Sending new shm area path failed: %s", strerror (errno));
-    goto error;
-  }
-
   client = spalloc_new (ShmClient);
+  memset (client, 0, sizeof (ShmClient));
   client->fd = fd;
+  client->pending_tail = &client->pending;
+
+  if (self->ring_size && !sp_writer_ring_open (self, client)) {
+    fprintf (stderr, "Sending new ring failed: %s", strerror (errno));
+    sp_writer_ring_close (client);
+    spalloc_free (ShmClient, client);
+    goto error;
+  }
 
   /* Prepend ot linked list */
   client->next = self->clients;
@@ -933,6 +1689,7 @@ again:
 
   self->num_clients--;
 
+  sp_writer_ring_close (client);
   spalloc_free (ShmClient, client);
 }
 
@@ -995,3 +1752,14 @@ sp_writer_get_max_buf_size (ShmPipe * self)
 
   return self->shm_area->shm_area_len;
 }
+
+void
+sp_writer_get_alloc_stats (ShmPipe * self, ShmAllocStats * stats)
+{
+  if (self->shm_area == NULL) {
+    memset (stats, 0, sizeof (ShmAllocStats));
+    return;
+  }
+
+  shm_alloc_space_get_stats (self->shm_area->allocspace, stats);
+}
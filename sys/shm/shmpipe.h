@@ -56,6 +56,24 @@
  * buffers are no longer valid. If was valid buffer was received, the
  * client must release it with sp_client_recv_finish() when it is done
  * reading from it.
+ *
+ * If the writer was given a ring size with sp_writer_set_ring_size(), it
+ * sends the buffers to new clients through a ring in shared memory instead
+ * of the socket, and they release them through another one. The client
+ * then calls sp_client_recv_ring() before each select(), which returns the
+ * buffers in the ring, and only select()s if it returns 0. The writer calls
+ * sp_writer_recv_releases() to free the buffers released through the rings,
+ * and if it has to wait for releases, it calls sp_writer_set_waiting()
+ * before calling sp_writer_recv_releases() one last time and waiting on the
+ * client fds, so that the clients wake it up. sp_client_recv() returns -6
+ * if the client could not open the rings, usually because it has no write
+ * access to them. The writer disconnects a client that falls behind by
+ * another full ring.
+ *
+ * A writer created with use_memfd passes its areas to the clients as fds
+ * instead of paths in the shm namespace. The client can then get the fd of
+ * a buffer with sp_client_buf_get_fd(), it stays valid until the buffer is
+ * released.
  */
 
 
@@ -68,6 +86,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 
+#include "shmalloc.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -80,7 +99,8 @@ typedef struct _ShmBuffer ShmBuffer;
 
 typedef void (*sp_buffer_free_callback) (void * tag, void * user_data);
 
-ShmPipe *sp_writer_create (const char *path, size_t size, mode_t perms);
+ShmPipe *sp_writer_create (const char *path, size_t size, mode_t perms,
+    int use_memfd);
 const char *sp_writer_get_path (ShmPipe *pipe);
 void sp_writer_close (ShmPipe * self, sp_buffer_free_callback callback,
     void * user_data);
@@ -89,6 +109,8 @@ void sp_set_data (ShmPipe * self, void *data);
 
 int sp_writer_setperms_shm (ShmPipe * self, mode_t perms);
 int sp_writer_resize (ShmPipe * self, size_t size);
+void sp_writer_set_ring_size (ShmPipe * self, unsigned int ring_size);
+int sp_writer_is_write_sealed (ShmPipe * self);
 
 int sp_get_fd (ShmPipe * self);
 const char *sp_get_shm_area_name (ShmPipe *self);
@@ -100,11 +122,15 @@ int sp_writer_send_buf (ShmPipe * self, char *buf, size_t size, void * tag);
 char *sp_writer_block_get_buf (ShmBlock *block);
 ShmPipe *sp_writer_block_get_pipe (ShmBlock *block);
 size_t sp_writer_get_max_buf_size (ShmPipe * self);
+void sp_writer_get_alloc_stats (ShmPipe * self, ShmAllocStats * stats);
 
 ShmClient * sp_writer_accept_client (ShmPipe * self);
 void sp_writer_close_client (ShmPipe *self, ShmClient * client,
     sp_buffer_free_callback callback, void * user_data);
 int sp_writer_recv (ShmPipe * self, ShmClient * client, void ** tag);
+int sp_writer_recv_releases (ShmPipe * self,
+    sp_buffer_free_callback callback, void * user_data);
+void sp_writer_set_waiting (ShmPipe * self, int waiting);
 
 int sp_writer_pending_writes (ShmPipe * self);
 
@@ -114,6 +140,9 @@ void *sp_writer_buf_get_tag (ShmBuffer * buffer);
 
 ShmPipe *sp_client_open (const char *path);
 long int sp_client_recv (ShmPipe * self, char **buf);
+long int sp_client_recv_ring (ShmPipe * self, char **buf);
+int sp_client_buf_get_fd (ShmPipe * self, char *buf, size_t * area_size,
+    unsigned long * offset);
 int sp_client_recv_finish (ShmPipe * self, char *buf);
 void sp_client_close (ShmPipe * self);
 
@@ -0,0 +1,388 @@
+/* GStreamer
+ *
+ * unit test for inter elements
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/check/gstharness.h>
+#include <gst/check/gstcheck.h>
+
+#define VIDEO_CAPS_4X4 \
+    "video/x-raw,format=GRAY8,width=4,height=4,framerate=30/1"
+#define VIDEO_CAPS_8X8 \
+    "video/x-raw,format=GRAY8,width=8,height=8,framerate=30/1"
+#define AUDIO_CAPS_8K \
+    "audio/x-raw,format=S16LE,layout=interleaved,channels=1,rate=8000"
+#define AUDIO_CAPS_16K \
+    "audio/x-raw,format=S16LE,layout=interleaved,channels=1,rate=16000"
+
+static GstBuffer *
+_create_frame (gsize size, guint8 value)
+{
+  GstBuffer *buffer = gst_buffer_new_allocate (NULL, size, NULL);
+
+  gst_buffer_memset (buffer, 0, value, size);
+
+  return buffer;
+}
+
+static guint8
+_get_frame_value (GstBuffer * buffer)
+{
+  guint8 value;
+
+  fail_unless_equals_int (gst_buffer_extract (buffer, 0, &value, 1), 1);
+
+  return value;
+}
+
+static GstHarness *
+_setup_video_sink (const gchar * caps)
+{
+  GstHarness *h = gst_harness_new ("intervideosink");
+
+  g_object_set (h->element, "sync", FALSE, NULL);
+  gst_harness_set_src_caps_str (h, caps);
+
+  return h;
+}
+
+static GstHarness *
+_setup_video_src (gboolean wait_for_frame, GstClockTime timeout)
+{
+  GstHarness *h = gst_harness_new ("intervideosrc");
+
+  g_object_set (h->element, "wait-for-frame", wait_for_frame, "timeout",
+      timeout, NULL);
+  gst_harness_use_systemclock (h);
+  gst_harness_play (h);
+
+  return h;
+}
+
+/* check that all frames still in the ring are output in order, and the
+ * ones replaced before are counted as dropped */
+GST_START_TEST (test_video_wait_for_frame)
+{
+  GstHarness *sink, *src;
+  GstBuffer *buffer;
+  guint64 dropped, duplicated;
+  guint n_frames = 0;
+  gint value, last = -1;
+  guint i;
+
+  sink = _setup_video_sink (VIDEO_CAPS_4X4);
+  src = _setup_video_src (TRUE, 10 * GST_SECOND);
+
+  for (i = 0; i < 6; i++)
+    fail_unless_equals_int (gst_harness_push (sink, _create_frame (16, i)),
+        GST_FLOW_OK);
+
+  do {
+    buffer = gst_harness_pull (src);
+    fail_unless (buffer != NULL);
+    fail_if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_GAP));
+    fail_unless_equals_int (gst_buffer_get_size (buffer), 16);
+    value = _get_frame_value (buffer);
+    fail_unless (value > last, "frame %d output after frame %d", value, last);
+    last = value;
+    n_frames++;
+    gst_buffer_unref (buffer);
+  } while (value < 5);
+
+  g_object_get (src->element, "drop", &dropped, "duplicate", &duplicated,
+      NULL);
+  fail_unless_equals_uint64 (dropped + n_frames, 6);
+  fail_unless_equals_uint64 (duplicated, 0);
+
+  gst_harness_teardown (src);
+  gst_harness_teardown (sink);
+}
+
+GST_END_TEST;
+
+/* check that a black frame is output when no frame comes in time, and
+ * that the next frame still comes out afterwards */
+GST_START_TEST (test_video_timeout)
+{
+  GstHarness *sink, *src;
+  GstBuffer *buffer;
+  guint i;
+
+  sink = _setup_video_sink (VIDEO_CAPS_4X4);
+  src = _setup_video_src (TRUE, 20 * GST_MSECOND);
+
+  buffer = gst_harness_pull (src);
+  fail_unless (buffer != NULL);
+  fail_unless (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_GAP));
+  fail_unless_equals_int (gst_buffer_get_size (buffer), 16);
+  gst_buffer_unref (buffer);
+
+  fail_unless_equals_int (gst_harness_push (sink, _create_frame (16, 200)),
+      GST_FLOW_OK);
+
+  /* skip the black frames output until then */
+  for (i = 0; i < 1000; i++) {
+    buffer = gst_harness_pull (src);
+    fail_unless (buffer != NULL);
+    if (!GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_GAP))
+      break;
+    gst_buffer_unref (buffer);
+  }
+  fail_unless (i < 1000);
+  fail_unless_equals_int (_get_frame_value (buffer), 200);
+  gst_buffer_unref (buffer);
+
+  gst_harness_teardown (src);
+  gst_harness_teardown (sink);
+}
+
+GST_END_TEST;
+
+/* check that without waiting, the last frame is repeated as a gap and
+ * counted as duplicated */
+GST_START_TEST (test_video_duplicate)
+{
+  GstHarness *sink, *src;
+  GstBuffer *buffer;
+  guint64 dropped, duplicated;
+  guint i;
+
+  sink = _setup_video_sink (VIDEO_CAPS_4X4);
+  fail_unless_equals_int (gst_harness_push (sink, _create_frame (16, 7)),
+      GST_FLOW_OK);
+
+  src = _setup_video_src (FALSE, GST_SECOND);
+
+  for (i = 0; i < 4; i++) {
+    buffer = gst_harness_pull (src);
+    fail_unless (buffer != NULL);
+    fail_unless_equals_int (_get_frame_value (buffer), 7);
+    fail_unless_equals_int (GST_BUFFER_FLAG_IS_SET (buffer,
+            GST_BUFFER_FLAG_GAP), i > 0);
+    gst_buffer_unref (buffer);
+  }
+
+  g_object_get (src->element, "drop", &dropped, "duplicate", &duplicated,
+      NULL);
+  fail_unless_equals_uint64 (dropped, 0);
+  fail_unless (duplicated >= 3);
+
+  gst_harness_teardown (src);
+  gst_harness_teardown (sink);
+}
+
+GST_END_TEST;
+
+/* check that the frames pushed before the caps changed are not output
+ * with the new caps */
+GST_START_TEST (test_video_renegotiate)
+{
+  GstHarness *sink, *src;
+  GstBuffer *buffer;
+  guint64 dropped;
+  guint i;
+
+  sink = _setup_video_sink (VIDEO_CAPS_4X4);
+  for (i = 1; i <= 3; i++)
+    fail_unless_equals_int (gst_harness_push (sink, _create_frame (16, i)),
+        GST_FLOW_OK);
+  gst_harness_set_src_caps_str (sink, VIDEO_CAPS_8X8);
+
+  /* starts with the last frame, which has the previous caps */
+  src = _setup_video_src (TRUE, 10 * GST_SECOND);
+
+  fail_unless_equals_int (gst_harness_push (sink, _create_frame (64, 4)),
+      GST_FLOW_OK);
+
+  buffer = gst_harness_pull (src);
+  fail_unless (buffer != NULL);
+  fail_if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_GAP));
+  fail_unless_equals_int (gst_buffer_get_size (buffer), 64);
+  fail_unless_equals_int (_get_frame_value (buffer), 4);
+  gst_buffer_unref (buffer);
+
+  g_object_get (src->element, "drop", &dropped, NULL);
+  fail_unless_equals_uint64 (dropped, 1);
+
+  gst_harness_teardown (src);
+  gst_harness_teardown (sink);
+}
+
+GST_END_TEST;
+
+static GstBuffer *
+_create_samples (guint n_samples, gint16 first)
+{
+  GstBuffer *buffer = gst_buffer_new_allocate (NULL, n_samples * 2, NULL);
+  GstMapInfo map;
+  guint i;
+
+  gst_buffer_map (buffer, &map, GST_MAP_WRITE);
+  for (i = 0; i < n_samples; i++)
+    GST_WRITE_UINT16_LE (map.data + i * 2, first + i);
+  gst_buffer_unmap (buffer, &map);
+
+  return buffer;
+}
+
+static void
+_check_samples (GstBuffer * buffer, guint n_samples, gint16 first)
+{
+  GstMapInfo map;
+  guint i;
+
+  fail_if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_GAP));
+  gst_buffer_map (buffer, &map, GST_MAP_READ);
+  fail_unless_equals_int (map.size, n_samples * 2);
+  for (i = 0; i < n_samples; i++)
+    fail_unless_equals_int ((gint16) GST_READ_UINT16_LE (map.data + i * 2),
+        first + i);
+  gst_buffer_unmap (buffer, &map);
+}
+
+static GstHarness *
+_setup_audio_sink (const gchar * caps)
+{
+  GstHarness *h = gst_harness_new ("interaudiosink");
+
+  g_object_set (h->element, "sync", FALSE, NULL);
+  gst_harness_set_src_caps_str (h, caps);
+
+  return h;
+}
+
+/* outputs one period of 10 ms per clock wait, and starts with 10 ms of
+ * what was queued */
+static GstHarness *
+_setup_audio_src (void)
+{
+  GstHarness *h = gst_harness_new ("interaudiosrc");
+
+  g_object_set (h->element, "buffer-time", 100 * GST_MSECOND,
+      "latency-time", 10 * GST_MSECOND, "period-time", 10 * GST_MSECOND,
+      NULL);
+  gst_harness_use_testclock (h);
+  gst_harness_play (h);
+
+  return h;
+}
+
+/* check that the source skips to latency-time of audio when the ring is
+ * replaced, then outputs the samples in order, and reports the fill level
+ * after each period */
+GST_START_TEST (test_audio_ring)
+{
+  GstHarness *sink, *src;
+  GstBuffer *buffer;
+  guint64 fill_level;
+  gdouble ratio;
+
+  sink = _setup_audio_sink (AUDIO_CAPS_8K);
+  src = _setup_audio_src ();
+
+  /* the first period is silence, as nothing was queued yet */
+  fail_unless (gst_harness_wait_for_clock_id_waits (src, 1, 60));
+
+  /* replaces the ring, the source only keeps the last 160 samples */
+  gst_harness_set_src_caps_str (sink, AUDIO_CAPS_16K);
+  fail_unless_equals_int (gst_harness_push (sink, _create_samples (800, 0)),
+      GST_FLOW_OK);
+
+  fail_unless (gst_harness_crank_single_clock_wait (src));
+  buffer = gst_harness_pull (src);
+  fail_unless (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_GAP));
+  fail_unless_equals_int (gst_buffer_get_size (buffer), 80 * 2);
+  gst_buffer_unref (buffer);
+
+  /* the second period was read, and emptied the ring */
+  fail_unless (gst_harness_wait_for_clock_id_waits (src, 1, 60));
+  g_object_get (src->element, "fill-level", &fill_level, "resample-ratio",
+      &ratio, NULL);
+  fail_unless_equals_uint64 (fill_level, 0);
+  fail_unless (ratio < 1.0);
+
+  fail_unless_equals_int (gst_harness_push (sink, _create_samples (480,
+              1000)), GST_FLOW_OK);
+
+  fail_unless (gst_harness_crank_single_clock_wait (src));
+  buffer = gst_harness_pull (src);
+  _check_samples (buffer, 160, 640);
+  gst_buffer_unref (buffer);
+
+  /* the third period leaves 320 samples in the ring */
+  fail_unless (gst_harness_wait_for_clock_id_waits (src, 1, 60));
+  g_object_get (src->element, "fill-level", &fill_level, NULL);
+  fail_unless_equals_uint64 (fill_level, 20 * GST_MSECOND);
+
+  fail_unless (gst_harness_crank_single_clock_wait (src));
+  buffer = gst_harness_pull (src);
+  _check_samples (buffer, 160, 1000);
+  gst_buffer_unref (buffer);
+
+  gst_harness_teardown (src);
+  gst_harness_teardown (sink);
+}
+
+GST_END_TEST;
+
+/* check that a second source can't read the ring of a channel until the
+ * first one stopped */
+GST_START_TEST (test_audio_second_src)
+{
+  GstHarness *src;
+  GstElement *element;
+
+  src = _setup_audio_src ();
+
+  element = gst_element_factory_make ("interaudiosrc", NULL);
+  fail_unless_equals_int (gst_element_set_state (element, GST_STATE_PAUSED),
+      GST_STATE_CHANGE_FAILURE);
+  gst_element_set_state (element, GST_STATE_NULL);
+
+  gst_harness_teardown (src);
+
+  fail_unless_equals_int (gst_element_set_state (element, GST_STATE_PAUSED),
+      GST_STATE_CHANGE_NO_PREROLL);
+  gst_element_set_state (element, GST_STATE_NULL);
+  gst_object_unref (element);
+}
+
+GST_END_TEST;
+
+static Suite *
+inter_suite (void)
+{
+  Suite *s = suite_create ("inter");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_video_wait_for_frame);
+  tcase_add_test (tc_chain, test_video_timeout);
+  tcase_add_test (tc_chain, test_video_duplicate);
+  tcase_add_test (tc_chain, test_video_renegotiate);
+  tcase_add_test (tc_chain, test_audio_ring);
+  tcase_add_test (tc_chain, test_audio_second_src);
+
+  return s;
+}
+
+GST_CHECK_MAIN (inter)
@@ -803,6 +803,195 @@ GST_START_TEST (test_keyframe_flag_propagation)
 
 GST_END_TEST;
 
+#define CBR_BITRATE 2000000
+
+/* allowed deviation of a PCR from the departure time of its packet,
+ * 500 ns in 27 MHz ticks */
+#define CBR_MAX_PCR_JITTER 13
+
+static gint64
+read_pcr (const guint8 * data)
+{
+  guint64 pcr_base;
+  guint pcr_ext;
+
+  pcr_base = ((guint64) GST_READ_UINT32_BE (data) << 1) | (data[4] >> 7);
+  pcr_ext = ((data[4] & 0x01) << 8) | data[5];
+
+  return pcr_base * 300 + pcr_ext;
+}
+
+GST_START_TEST (test_cbr)
+{
+  GstElement *mux;
+  GstCaps *caps;
+  GstClockTime ts, last_pts = 0;
+  gint64 last_pcr = -1;
+  guint64 offset = 0, last_pcr_offset = 0;
+  guint n_null = 0, n_pcr = 0;
+  gchar *padname;
+  GList *l;
+  gint i;
+
+  mux = setup_tsmux (&video_src_template, "sink_%d", &padname);
+  g_object_set (mux, "bitrate", (guint64) CBR_BITRATE, NULL);
+
+  fail_unless (gst_element_set_state (mux,
+          GST_STATE_PLAYING) == GST_STATE_CHANGE_SUCCESS,
+      "could not set to playing");
+
+  caps = gst_caps_from_string (VIDEO_CAPS_STRING);
+  gst_check_setup_events (mysrcpad, mux, caps, GST_FORMAT_TIME);
+  gst_caps_unref (caps);
+
+  /* feed much less than the target bitrate */
+  ts = 0;
+  for (i = 0; i < 25; ++i) {
+    GstBuffer *inbuffer = gst_buffer_new_and_alloc (1000);
+
+    GST_BUFFER_TIMESTAMP (inbuffer) = ts;
+    if (i % KEYFRAME_DISTANCE != 0)
+      GST_BUFFER_FLAG_SET (inbuffer, GST_BUFFER_FLAG_DELTA_UNIT);
+    fail_unless_equals_int (gst_pad_push (mysrcpad, inbuffer), GST_FLOW_OK);
+    ts += 40 * GST_MSECOND;
+  }
+
+  fail_unless (buffers != NULL);
+
+  /* check that every PCR matches the position of its packet in the
+   * constant bitrate output */
+  for (l = buffers; l; l = l->next) {
+    GstBuffer *outbuffer = GST_BUFFER (l->data);
+    GstMapInfo map;
+    gsize pos;
+
+    fail_unless (GST_BUFFER_PTS_IS_VALID (outbuffer));
+    fail_unless (GST_BUFFER_PTS (outbuffer) >= last_pts);
+    last_pts = GST_BUFFER_PTS (outbuffer);
+
+    gst_buffer_map (outbuffer, &map, GST_MAP_READ);
+    fail_unless (map.size % 188 == 0);
+
+    for (pos = 0; pos < map.size; pos += 188, offset += 188) {
+      const guint8 *data = map.data + pos;
+      guint pid;
+
+      fail_unless (data[0] == 0x47);
+      pid = GST_READ_UINT16_BE (data + 1) & 0x1FFF;
+
+      if (pid == 0x1FFF) {
+        n_null++;
+        continue;
+      }
+
+      /* adaptation field with PCR flag */
+      if ((data[3] & 0x20) && data[4] > 0 && (data[5] & 0x10)) {
+        gint64 pcr = read_pcr (data + 6);
+
+        if (last_pcr != -1) {
+          gint64 expected;
+
+          expected = gst_util_uint64_scale ((offset - last_pcr_offset) * 8,
+              27000000, CBR_BITRATE);
+          GST_LOG ("PCR %" G_GINT64_FORMAT " at offset %" G_GUINT64_FORMAT
+              ", deviation %" G_GINT64_FORMAT, pcr, offset,
+              pcr - last_pcr - expected);
+          fail_unless (ABS (pcr - last_pcr - expected) <= CBR_MAX_PCR_JITTER);
+          /* at most 100 ms between PCRs */
+          fail_unless (pcr - last_pcr <= 2700000);
+        }
+        last_pcr = pcr;
+        last_pcr_offset = offset;
+        n_pcr++;
+      }
+    }
+    gst_buffer_unmap (outbuffer, &map);
+  }
+
+  fail_unless (n_null > 0);
+  fail_unless (n_pcr > 1);
+  /* output spans the input duration at the target rate */
+  fail_unless (offset * 8 >= gst_util_uint64_scale (CBR_BITRATE,
+          24 * 40 * GST_MSECOND, GST_SECOND));
+
+  gst_check_drop_buffers ();
+  cleanup_tsmux (mux, padname);
+  g_free (padname);
+}
+
+GST_END_TEST;
+
+/* check that a long gap in the input is not entirely padded with null
+ * packets, and that the jump of the PCR is signalled */
+GST_START_TEST (test_cbr_gap)
+{
+  static const GstClockTime timestamps[] = {
+    0, 40 * GST_MSECOND, 10 * GST_SECOND, 10 * GST_SECOND + 40 * GST_MSECOND
+  };
+  GstElement *mux;
+  GstCaps *caps;
+  gsize size = 0;
+  gint64 last_pcr = -1;
+  guint n_jumps = 0;
+  gchar *padname;
+  GList *l;
+  guint i;
+
+  mux = setup_tsmux (&video_src_template, "sink_%d", &padname);
+  g_object_set (mux, "bitrate", (guint64) CBR_BITRATE, NULL);
+
+  fail_unless (gst_element_set_state (mux,
+          GST_STATE_PLAYING) == GST_STATE_CHANGE_SUCCESS,
+      "could not set to playing");
+
+  caps = gst_caps_from_string (VIDEO_CAPS_STRING);
+  gst_check_setup_events (mysrcpad, mux, caps, GST_FORMAT_TIME);
+  gst_caps_unref (caps);
+
+  for (i = 0; i < G_N_ELEMENTS (timestamps); ++i) {
+    GstBuffer *inbuffer = gst_buffer_new_and_alloc (1000);
+
+    GST_BUFFER_TIMESTAMP (inbuffer) = timestamps[i];
+    fail_unless_equals_int (gst_pad_push (mysrcpad, inbuffer), GST_FLOW_OK);
+  }
+
+  for (l = buffers; l; l = l->next) {
+    GstBuffer *outbuffer = GST_BUFFER (l->data);
+    GstMapInfo map;
+    gsize pos;
+
+    gst_buffer_map (outbuffer, &map, GST_MAP_READ);
+    for (pos = 0; pos + 188 <= map.size; pos += 188) {
+      const guint8 *data = map.data + pos;
+
+      /* adaptation field with PCR flag */
+      if ((data[3] & 0x20) && data[4] > 0 && (data[5] & 0x10)) {
+        gint64 pcr = read_pcr (data + 6);
+        gboolean jump = last_pcr != -1 && pcr - last_pcr > 2700000;
+
+        /* only the first PCR after a jump has the discontinuity indicator */
+        fail_unless_equals_int (! !(data[5] & 0x80), jump);
+        if (jump)
+          n_jumps++;
+        last_pcr = pcr;
+      }
+    }
+    size += map.size;
+    gst_buffer_unmap (outbuffer, &map);
+  }
+
+  /* at most a second of padding, rather than the ten of the gap */
+  fail_unless (size > 0);
+  fail_unless (size * 8 < 2 * CBR_BITRATE);
+  fail_unless_equals_int (n_jumps, 1);
+
+  gst_check_drop_buffers ();
+  cleanup_tsmux (mux, padname);
+  g_free (padname);
+}
+
+GST_END_TEST;
+
 static Suite *
 mpegtsmux_suite (void)
 {
@@ -819,6 +1008,8 @@ mpegtsmux_suite (void)
   tcase_add_test (tc_chain, test_multiple_state_change);
   tcase_add_test (tc_chain, test_align);
   tcase_add_test (tc_chain, test_keyframe_flag_propagation);
+  tcase_add_test (tc_chain, test_cbr);
+  tcase_add_test (tc_chain, test_cbr_gap);
 
   return s;
 }
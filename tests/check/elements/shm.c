@@ -26,6 +26,15 @@
 
 #include <gst/gst.h>
 #include <gst/check/gstcheck.h>
+#include <gst/allocators/allocators.h>
+
+#ifdef HAVE_MEMFD_CREATE
+#include <fcntl.h>
+#include <sys/mman.h>
+#ifndef F_SEAL_FUTURE_WRITE
+#define F_SEAL_FUTURE_WRITE 0x0010
+#endif
+#endif
 
 
 static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
@@ -42,7 +51,7 @@ GstElement *src, *sink;
 GstPad *sinkpad, *srcpad;
 
 static void
-setup_shm (void)
+setup_shm_full (guint ring_size, gboolean use_memfd)
 {
   gchar *socket_path = NULL;
 
@@ -52,7 +61,8 @@ setup_shm (void)
   srcpad = gst_check_setup_src_pad (sink, &src_template);
   sinkpad = gst_check_setup_sink_pad (src, &sink_template);
 
-  g_object_set (sink, "socket-path", "shm-unit-test", NULL);
+  g_object_set (sink, "socket-path", "shm-unit-test", "ring-size", ring_size,
+      "use-memfd", use_memfd, NULL);
 
   fail_unless (gst_element_set_state (sink, GST_STATE_PLAYING) ==
       GST_STATE_CHANGE_ASYNC);
@@ -69,6 +79,27 @@ setup_shm (void)
       GST_STATE_CHANGE_SUCCESS);
 }
 
+static void
+setup_shm (void)
+{
+  setup_shm_full (0, FALSE);
+}
+
+static void
+setup_shm_ring (void)
+{
+  /* less than the buffers the tests hold on to */
+  setup_shm_full (4, FALSE);
+}
+
+#ifdef HAVE_MEMFD_CREATE
+static void
+setup_shm_memfd (void)
+{
+  setup_shm_full (4, TRUE);
+}
+#endif
+
 static void
 teardown_shm (void)
 {
@@ -169,6 +200,109 @@ GST_START_TEST (test_shm_alloc)
 
 GST_END_TEST;
 
+GST_START_TEST (test_shm_ring)
+{
+  GstSegment segment;
+  GList *l;
+  guint i;
+
+  gst_pad_push_event (srcpad, gst_event_new_stream_start ("test"));
+  gst_segment_init (&segment, GST_FORMAT_BYTES);
+  gst_pad_push_event (srcpad, gst_event_new_segment (&segment));
+
+  for (i = 0; i < 20; i++) {
+    GstBuffer *buf = gst_buffer_new_allocate (NULL, 100 + i, NULL);
+
+    gst_buffer_memset (buf, 0, i, 100 + i);
+    fail_unless (gst_pad_push (srcpad, buf) == GST_FLOW_OK);
+  }
+
+  g_mutex_lock (&check_mutex);
+  while (g_list_length (buffers) < 20)
+    g_cond_wait (&check_cond, &check_mutex);
+  g_mutex_unlock (&check_mutex);
+
+  /* the ones that did not fit in the ring came after, in order */
+  for (l = buffers, i = 0; l; l = l->next, i++) {
+    GstBuffer *buf = l->data;
+    guint8 first;
+
+    fail_unless_equals_int (gst_buffer_get_size (buf), 100 + i);
+    gst_buffer_extract (buf, 0, &first, 1);
+    fail_unless_equals_int (first, i);
+  }
+
+  /* released through the ring, which the sink needs to finish */
+  gst_check_drop_buffers ();
+  fail_unless (gst_pad_push_event (srcpad, gst_event_new_eos ()));
+
+  teardown_shm ();
+}
+
+GST_END_TEST;
+
+#ifdef HAVE_MEMFD_CREATE
+GST_START_TEST (test_shm_memfd)
+{
+  GstSegment segment;
+  GList *l;
+  guint i;
+  gint fd, seals;
+  gpointer data;
+
+  gst_pad_push_event (srcpad, gst_event_new_stream_start ("test"));
+  gst_segment_init (&segment, GST_FORMAT_BYTES);
+  gst_pad_push_event (srcpad, gst_event_new_segment (&segment));
+
+  for (i = 0; i < 8; i++) {
+    GstBuffer *buf = gst_buffer_new_allocate (NULL, 100 + i, NULL);
+
+    gst_buffer_memset (buf, 0, i, 100 + i);
+    fail_unless (gst_pad_push (srcpad, buf) == GST_FLOW_OK);
+  }
+
+  g_mutex_lock (&check_mutex);
+  while (g_list_length (buffers) < 8)
+    g_cond_wait (&check_cond, &check_mutex);
+  g_mutex_unlock (&check_mutex);
+
+  /* the memory of the sink was passed as an fd and mapped read-only */
+  for (l = buffers, i = 0; l; l = l->next, i++) {
+    GstBuffer *buf = l->data;
+    GstMemory *mem;
+    guint8 first;
+
+    fail_unless_equals_int (gst_buffer_n_memory (buf), 1);
+    mem = gst_buffer_peek_memory (buf, 0);
+    fail_unless (gst_memory_is_type (mem, "fd"));
+    fail_unless (GST_MEMORY_IS_READONLY (mem));
+
+    /* the sink can't shrink the area under us, and we can't write to it
+     * where the kernel supports it */
+    fd = gst_fd_memory_get_fd (mem);
+    seals = fcntl (fd, F_GET_SEALS);
+    fail_unless (seals >= 0);
+    fail_unless ((seals & (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)) ==
+        (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL));
+    if (seals & F_SEAL_FUTURE_WRITE) {
+      data = mmap (NULL, 1, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      fail_unless (data == MAP_FAILED);
+    }
+
+    fail_unless_equals_int (gst_buffer_get_size (buf), 100 + i);
+    gst_buffer_extract (buf, 0, &first, 1);
+    fail_unless_equals_int (first, i);
+  }
+
+  gst_check_drop_buffers ();
+  fail_unless (gst_pad_push_event (srcpad, gst_event_new_eos ()));
+
+  teardown_shm ();
+}
+
+GST_END_TEST;
+#endif
+
 static Suite *
 shm_suite (void)
 {
@@ -181,6 +315,18 @@ shm_suite (void)
   tcase_add_test (tc, test_shm_alloc);
   suite_add_tcase (s, tc);
 
+  tc = tcase_create ("shm-ring");
+  tcase_add_checked_fixture (tc, setup_shm_ring, NULL);
+  tcase_add_test (tc, test_shm_ring);
+  suite_add_tcase (s, tc);
+
+#ifdef HAVE_MEMFD_CREATE
+  tc = tcase_create ("shm-memfd");
+  tcase_add_checked_fixture (tc, setup_shm_memfd, NULL);
+  tcase_add_test (tc, test_shm_memfd);
+  suite_add_tcase (s, tc);
+#endif
+
   return s;
 }
 
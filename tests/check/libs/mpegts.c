@@ -19,6 +19,7 @@
 
 #include <gst/check/gstcheck.h>
 #include <gst/mpegts/mpegts.h>
+#include <string.h>
 
 static const guint8 pat_data_check[] = {
   0x00, 0xB0, 0x11, 0x00, 0x00, 0xc1, 0x00,
@@ -468,6 +469,56 @@ static const guint8 service_descriptor[] = {
   0x61, 0x6d, 0x65
 };
 
+GST_START_TEST (test_mpegts_parse_descriptors)
+{
+  GPtrArray *descriptors;
+  GstMpegtsDescriptor *desc, *copy;
+  guint8 *loop;
+  gsize size;
+
+  size = sizeof (registration_descriptor) + sizeof (network_name_descriptor) +
+      sizeof (service_descriptor);
+  loop = g_malloc (size);
+  memcpy (loop, registration_descriptor, sizeof (registration_descriptor));
+  memcpy (loop + sizeof (registration_descriptor), network_name_descriptor,
+      sizeof (network_name_descriptor));
+  memcpy (loop + sizeof (registration_descriptor) +
+      sizeof (network_name_descriptor), service_descriptor,
+      sizeof (service_descriptor));
+
+  descriptors = gst_mpegts_parse_descriptors (loop, size);
+  fail_if (descriptors == NULL);
+  fail_unless_equals_int (descriptors->len, 3);
+
+  /* The descriptors do not depend on the parsed data */
+  memset (loop, 0, size);
+  g_free (loop);
+
+  desc = g_ptr_array_index (descriptors, 0);
+  fail_unless_equals_int (desc->tag, 0x05);
+  fail_unless_equals_int (desc->length, 4);
+  fail_unless (memcmp (desc->data, registration_descriptor,
+          sizeof (registration_descriptor)) == 0);
+
+  desc = g_ptr_array_index (descriptors, 2);
+  fail_unless_equals_int (desc->tag, 0x48);
+  fail_unless (memcmp (desc->data, service_descriptor,
+          sizeof (service_descriptor)) == 0);
+
+  /* Descriptors can be copied and released independently */
+  desc = g_ptr_array_index (descriptors, 1);
+  copy = g_boxed_copy (GST_TYPE_MPEGTS_DESCRIPTOR, desc);
+  g_ptr_array_remove_index (descriptors, 0);
+  g_ptr_array_unref (descriptors);
+
+  fail_unless_equals_int (copy->tag, 0x40);
+  fail_unless (memcmp (copy->data, network_name_descriptor,
+          sizeof (network_name_descriptor)) == 0);
+  gst_mpegts_descriptor_free (copy);
+}
+
+GST_END_TEST;
+
 GST_START_TEST (test_mpegts_dvb_descriptors)
 {
   GstMpegtsDescriptor *desc;
@@ -576,6 +627,7 @@ mpegts_suite (void)
   tcase_add_test (tc_chain, test_mpegts_sdt);
   tcase_add_test (tc_chain, test_mpegts_atsc_stt);
   tcase_add_test (tc_chain, test_mpegts_descriptors);
+  tcase_add_test (tc_chain, test_mpegts_parse_descriptors);
   tcase_add_test (tc_chain, test_mpegts_dvb_descriptors);
 
   return s;
@@ -0,0 +1,403 @@
+/*
+ * GStreamer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * Benchmark of the compositor element.
+ *
+ * Runs the blending of every format in every mode at several sizes and
+ * positions, and whole compositions with several inputs. Every input gets a
+ * new buffer for every frame, so that nothing is reused from the previous
+ * output. Prints one CSV line per scenario with the time per output frame
+ * and the number of output pixels per second.
+ *
+ * Run it with `meson test --benchmark` or directly, see --help for the
+ * options.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+typedef enum
+{
+  LAYOUT_SINGLE,
+  LAYOUT_GRID,
+  LAYOUT_PIP,
+} Layout;
+
+typedef struct
+{
+  const gchar *name;
+  const gchar *format;
+  gint width, height;
+  Layout layout;
+  guint n_inputs;
+  gdouble alpha;
+  /* added to the positions of the inputs, to blend at unaligned offsets */
+  gint offset;
+  const gchar *background;
+} Scenario;
+
+typedef struct
+{
+  guint n_buffers;
+  GstClockTime first, last;
+} Timing;
+
+static gint n_frames = 200;
+static gint n_threads = 1;
+static gchar *filter = NULL;
+
+static GOptionEntry entries[] = {
+  {"frames", 'n', 0, G_OPTION_ARG_INT, &n_frames,
+      "Number of output frames per scenario", "N"},
+  {"threads", 't', 0, G_OPTION_ARG_INT, &n_threads,
+      "Value of the n-threads property of compositor", "N"},
+  {"filter", 'f', 0, G_OPTION_ARG_STRING, &filter,
+      "Only run the scenarios whose name contains this", "STRING"},
+  {NULL}
+};
+
+static void
+handoff_cb (GstElement * sink, GstBuffer * buffer, GstPad * pad,
+    Timing * timing)
+{
+  GstClockTime now = gst_util_get_timestamp ();
+
+  if (timing->n_buffers == 0)
+    timing->first = now;
+  timing->last = now;
+  timing->n_buffers++;
+}
+
+static void
+get_input_rect (const Scenario * scenario, guint i, GstVideoRectangle * rect)
+{
+  guint cols, rows;
+
+  switch (scenario->layout) {
+    case LAYOUT_SINGLE:
+      /* not the whole frame, the pad would be passed through otherwise */
+      rect->x = 32;
+      rect->y = 16;
+      rect->w = scenario->width - 64;
+      rect->h = scenario->height - 32;
+      break;
+    case LAYOUT_GRID:
+      for (cols = 1; cols * cols < scenario->n_inputs; cols++);
+      rows = (scenario->n_inputs + cols - 1) / cols;
+      rect->w = scenario->width / cols;
+      rect->h = scenario->height / rows;
+      rect->x = (i % cols) * rect->w;
+      rect->y = (i / cols) * rect->h;
+      break;
+    case LAYOUT_PIP:
+      /* a full frame picture and smaller ones along its bottom */
+      if (i == 0) {
+        rect->x = rect->y = 0;
+        rect->w = scenario->width;
+        rect->h = scenario->height;
+      } else {
+        rect->w = scenario->width / 4;
+        rect->h = scenario->height / 4;
+        rect->x = (i - 1) * (rect->w + 16) + 16;
+        rect->y = scenario->height - rect->h - 16;
+      }
+      break;
+  }
+
+  rect->x += scenario->offset;
+  rect->y += scenario->offset;
+}
+
+static GstBuffer *
+create_input_buffer (GstVideoInfo * info, guint seed)
+{
+  GstBuffer *buffer;
+  GstMapInfo map;
+  gsize i;
+
+  buffer = gst_buffer_new_allocate (NULL, GST_VIDEO_INFO_SIZE (info), NULL);
+  gst_buffer_map (buffer, &map, GST_MAP_WRITE);
+  /* anything but constant values, so that alpha is not always opaque */
+  for (i = 0; i < map.size; i++)
+    map.data[i] = (i * 7 + seed * 31 + (i >> 10)) & 0xff;
+  gst_buffer_unmap (buffer, &map);
+
+  return buffer;
+}
+
+/* Returns the nanoseconds per output frame, or 0 if the pipeline failed */
+static gdouble
+run_scenario (const Scenario * scenario)
+{
+  GstElement *pipeline, *compositor, *capsfilter, *sink;
+  GstVideoFormat format;
+  GstBus *bus;
+  GstMessage *msg;
+  GstCaps *caps;
+  Timing timing = { 0, };
+  gboolean ok;
+  guint i, n;
+
+  format = gst_video_format_from_string (scenario->format);
+  g_assert (format != GST_VIDEO_FORMAT_UNKNOWN);
+
+  pipeline = gst_pipeline_new (NULL);
+  compositor = gst_element_factory_make ("compositor", NULL);
+  capsfilter = gst_element_factory_make ("capsfilter", NULL);
+  sink = gst_element_factory_make ("fakesink", NULL);
+  if (!compositor || !capsfilter || !sink) {
+    g_printerr ("compositor, capsfilter or fakesink is missing\n");
+    exit (1);
+  }
+
+  gst_util_set_object_arg (G_OBJECT (compositor), "background",
+      scenario->background);
+  g_object_set (compositor, "n-threads", n_threads, NULL);
+
+  caps = gst_caps_new_simple ("video/x-raw",
+      "format", G_TYPE_STRING, scenario->format,
+      "width", G_TYPE_INT, scenario->width,
+      "height", G_TYPE_INT, scenario->height, NULL);
+  g_object_set (capsfilter, "caps", caps, NULL);
+  gst_caps_unref (caps);
+
+  g_object_set (sink, "sync", FALSE, "signal-handoffs", TRUE, NULL);
+  g_signal_connect (sink, "handoff", G_CALLBACK (handoff_cb), &timing);
+
+  gst_bin_add_many (GST_BIN (pipeline), compositor, capsfilter, sink, NULL);
+  gst_element_link_many (compositor, capsfilter, sink, NULL);
+
+  for (i = 0; i < scenario->n_inputs; i++) {
+    GstElement *src;
+    GstPad *srcpad, *sinkpad;
+    GstVideoRectangle rect;
+    GstVideoInfo info;
+    GstBuffer *buffer;
+
+    get_input_rect (scenario, i, &rect);
+    gst_video_info_set_format (&info, format, rect.w, rect.h);
+    info.fps_n = 30;
+    info.fps_d = 1;
+
+    src = gst_element_factory_make ("appsrc", NULL);
+    caps = gst_video_info_to_caps (&info);
+    g_object_set (src, "caps", caps, "format", GST_FORMAT_TIME, NULL);
+    gst_caps_unref (caps);
+    gst_bin_add (GST_BIN (pipeline), src);
+
+    srcpad = gst_element_get_static_pad (src, "src");
+    sinkpad = gst_element_get_request_pad (compositor, "sink_%u");
+    g_object_set (sinkpad, "xpos", rect.x, "ypos", rect.y,
+        "alpha", i == 0 && scenario->layout == LAYOUT_PIP ? 1.0 :
+        scenario->alpha, NULL);
+    gst_pad_link (srcpad, sinkpad);
+    gst_object_unref (sinkpad);
+    gst_object_unref (srcpad);
+
+    /* A new buffer for every frame, sharing the memory */
+    buffer = create_input_buffer (&info, i);
+    for (n = 0; n < n_frames; n++) {
+      GstBuffer *copy = gst_buffer_copy (buffer);
+      GstFlowReturn ret;
+
+      GST_BUFFER_PTS (copy) = gst_util_uint64_scale (n, GST_SECOND, 30);
+      GST_BUFFER_DURATION (copy) = gst_util_uint64_scale (1, GST_SECOND, 30);
+      g_signal_emit_by_name (src, "push-buffer", copy, &ret);
+      gst_buffer_unref (copy);
+    }
+    g_signal_emit_by_name (src, "end-of-stream", NULL);
+    gst_buffer_unref (buffer);
+  }
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  bus = gst_element_get_bus (pipeline);
+  msg = gst_bus_timed_pop_filtered (bus, GST_CLOCK_TIME_NONE,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  ok = GST_MESSAGE_TYPE (msg) == GST_MESSAGE_EOS;
+  if (!ok) {
+    GError *err = NULL;
+
+    gst_message_parse_error (msg, &err, NULL);
+    g_printerr ("%s failed: %s\n", scenario->name, err->message);
+    g_clear_error (&err);
+  }
+  gst_message_unref (msg);
+  gst_object_unref (bus);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+
+  /* the first frame includes the negotiation */
+  if (!ok || timing.n_buffers < 2)
+    return 0;
+
+  return (gdouble) (timing.last - timing.first) / (timing.n_buffers - 1);
+}
+
+static void
+print_result (const Scenario * scenario, gdouble ns)
+{
+  gchar alpha[G_ASCII_DTOSTR_BUF_SIZE], ns_str[G_ASCII_DTOSTR_BUF_SIZE];
+  gchar mpix[G_ASCII_DTOSTR_BUF_SIZE];
+
+  g_ascii_formatd (alpha, sizeof (alpha), "%.2f", scenario->alpha);
+  g_ascii_formatd (ns_str, sizeof (ns_str), "%.0f", ns);
+  g_ascii_formatd (mpix, sizeof (mpix), "%.2f", ns > 0 ?
+      scenario->width * scenario->height * 1000.0 / ns : 0.0);
+
+  g_print ("%s,%s,%d,%d,%u,%s,%d,%s,%d,%s,%s\n", scenario->name,
+      scenario->format, scenario->width, scenario->height,
+      scenario->n_inputs, alpha, scenario->offset, scenario->background,
+      n_threads, ns_str, mpix);
+}
+
+static gboolean
+run (Scenario * scenario)
+{
+  gdouble ns;
+
+  if (filter && !strstr (scenario->name, filter))
+    return TRUE;
+
+  ns = run_scenario (scenario);
+  print_result (scenario, ns);
+
+  return ns > 0;
+}
+
+int
+main (int argc, char *argv[])
+{
+  static const gchar *formats[] = {
+    "AYUV", "ARGB", "BGRA", "ABGR", "RGBA", "Y444", "Y42B", "I420", "YV12",
+    "NV12", "NV21", "Y41B", "RGB", "BGR", "xRGB", "xBGR", "RGBx", "BGRx",
+    "YUY2", "UYVY", "YVYU", "AYUV64", "ARGB64",
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+    "I420_10LE", "I422_10LE", "Y444_10LE", "P010_10LE",
+#else
+    "I420_10BE", "I422_10BE", "Y444_10BE", "P010_10BE",
+#endif
+  };
+  static const gint sizes[][2] = { {640, 360}, {1920, 1080} };
+  static const struct
+  {
+    const gchar *name;
+    gdouble alpha;
+    const gchar *background;
+    gboolean needs_alpha;
+  } modes[] = {
+    {"blend", 0.5, "black", FALSE},
+    {"opaque", 1.0, "black", FALSE},
+    {"checker", 0.5, "checker", FALSE},
+    {"overlay", 0.5, "transparent", TRUE},
+  };
+  static const struct
+  {
+    const gchar *name;
+    Layout layout;
+    guint n_inputs;
+    gdouble alpha;
+    const gchar *variant;
+  } compositions[] = {
+    {"grid", LAYOUT_GRID, 4, 1.0, "opaque"},
+    {"grid", LAYOUT_GRID, 16, 1.0, "opaque"},
+    {"grid", LAYOUT_GRID, 16, 0.8, "blend"},
+    {"pip", LAYOUT_PIP, 4, 1.0, "opaque"},
+    {"pip", LAYOUT_PIP, 4, 0.7, "blend"},
+  };
+  GOptionContext *ctx;
+  GError *err = NULL;
+  gboolean ok = TRUE;
+  guint f, s, m, o, c;
+
+  ctx = g_option_context_new ("- compositor benchmark");
+  g_option_context_add_main_entries (ctx, entries, NULL);
+  g_option_context_add_group (ctx, gst_init_get_option_group ());
+  if (!g_option_context_parse (ctx, &argc, &argv, &err)) {
+    g_printerr ("Error initializing: %s\n", err->message);
+    g_clear_error (&err);
+    g_option_context_free (ctx);
+    return 1;
+  }
+  g_option_context_free (ctx);
+
+  g_print ("scenario,format,width,height,inputs,alpha,offset,background,"
+      "threads,ns_per_frame,mpix_per_s\n");
+
+  /* every blend function on its own */
+  for (f = 0; f < G_N_ELEMENTS (formats); f++) {
+    const GstVideoFormatInfo *finfo =
+        gst_video_format_get_info (gst_video_format_from_string (formats[f]));
+
+    for (m = 0; m < G_N_ELEMENTS (modes); m++) {
+      if (modes[m].needs_alpha && !GST_VIDEO_FORMAT_INFO_HAS_ALPHA (finfo))
+        continue;
+
+      for (s = 0; s < G_N_ELEMENTS (sizes); s++) {
+        for (o = 0; o < 2; o++) {
+          Scenario scenario = { NULL, };
+          gchar *name;
+
+          name = g_strdup_printf ("blend-%s-%s-%dx%d%s", formats[f],
+              modes[m].name, sizes[s][0], sizes[s][1], o ? "-unaligned" : "");
+          scenario.name = name;
+          scenario.format = formats[f];
+          scenario.width = sizes[s][0];
+          scenario.height = sizes[s][1];
+          scenario.layout = LAYOUT_SINGLE;
+          scenario.n_inputs = 1;
+          scenario.alpha = modes[m].alpha;
+          scenario.offset = o;
+          scenario.background = modes[m].background;
+
+          ok &= run (&scenario);
+          g_free (name);
+        }
+      }
+    }
+  }
+
+  /* whole compositions */
+  for (c = 0; c < G_N_ELEMENTS (compositions); c++) {
+    Scenario scenario = { NULL, };
+    gchar *name;
+
+    name = g_strdup_printf ("composition-%s-%u-inputs-%s",
+        compositions[c].name, compositions[c].n_inputs,
+        compositions[c].variant);
+    scenario.name = name;
+    scenario.format = "I420";
+    scenario.width = 1920;
+    scenario.height = 1080;
+    scenario.layout = compositions[c].layout;
+    scenario.n_inputs = compositions[c].n_inputs;
+    scenario.alpha = compositions[c].alpha;
+    scenario.offset = 0;
+    scenario.background = "black";
+
+    ok &= run (&scenario);
+    g_free (name);
+  }
+
+  return ok ? 0 : 1;
+}
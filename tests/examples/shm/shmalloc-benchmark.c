@@ -0,0 +1,270 @@
+/*
+ * GStreamer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * Stress benchmark of the allocator of the shared memory area of shmsink.
+ *
+ * Simulates a writer sending every block to several clients, which hold on
+ * to a number of blocks each and release them in order or at random, as
+ * slow clients do. Checks that the space is whole again at the end, and
+ * prints one CSV line per scenario with the time per allocation and the
+ * fragmentation of the space.
+ *
+ * Run it with `meson test --benchmark` or directly, see --help for the
+ * options.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <glib.h>
+
+#include "shmalloc.h"
+
+typedef struct
+{
+  const gchar *name;
+  guint n_clients;
+  /* number of blocks a client holds before releasing one */
+  guint n_held;
+  /* release a random block instead of the oldest */
+  gboolean random_order;
+  /* sizes vary between half and all of block_size */
+  gboolean random_size;
+} Scenario;
+
+typedef struct
+{
+  guint64 n_allocs, n_failed;
+  guint64 ns;
+  /* sums over all samples of the stats */
+  guint64 free_blocks, largest_free, free_size;
+  guint n_samples;
+} Result;
+
+static gint n_allocs = 200000;
+static gint block_size = 4096 * 32;
+static gint space_blocks = 256;
+static gchar *filter = NULL;
+
+static GOptionEntry entries[] = {
+  {"allocs", 'n', 0, G_OPTION_ARG_INT, &n_allocs,
+      "Number of allocations per scenario", "N"},
+  {"block-size", 'b', 0, G_OPTION_ARG_INT, &block_size,
+      "Largest size of the blocks", "BYTES"},
+  {"space", 's', 0, G_OPTION_ARG_INT, &space_blocks,
+      "Size of the space, in blocks of the largest size", "N"},
+  {"filter", 'f', 0, G_OPTION_ARG_STRING, &filter,
+      "Only run the scenarios whose name contains this", "STRING"},
+  {NULL}
+};
+
+static guint64
+get_time_ns (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return (guint64) ts.tv_sec * G_GUINT64_CONSTANT (1000000000) + ts.tv_nsec;
+}
+
+/* Releases one of the blocks held by @client */
+static void
+release_one (GQueue * client, GRand * rand, gboolean random_order)
+{
+  ShmAllocBlock *block;
+
+  if (random_order)
+    block = g_queue_pop_nth (client, g_rand_int_range (rand, 0,
+            client->length));
+  else
+    block = g_queue_pop_head (client);
+
+  shm_alloc_space_block_dec (block);
+}
+
+static gboolean
+run_scenario (const Scenario * scenario, Result * result)
+{
+  ShmAllocSpace *space;
+  ShmAllocStats stats;
+  GQueue *clients;
+  GRand *rand;
+  guint64 start;
+  guint64 alloc_ns = 0;
+  gboolean ok = TRUE;
+  guint i, c;
+
+  space = shm_alloc_space_new ((gsize) block_size * space_blocks);
+  clients = g_new0 (GQueue, scenario->n_clients);
+  rand = g_rand_new_with_seed (42);
+  memset (result, 0, sizeof (Result));
+
+  for (i = 0; i < n_allocs; i++) {
+    ShmAllocBlock *block;
+    unsigned long size = block_size;
+
+    if (scenario->random_size)
+      size = g_rand_int_range (rand, block_size / 2, block_size + 1);
+
+    /* Clients release blocks until there is enough space, like shmsink
+     * waits for them */
+    for (;;) {
+      start = get_time_ns ();
+      block = shm_alloc_space_alloc_block (space, size);
+      alloc_ns += get_time_ns () - start;
+      result->n_allocs++;
+      if (block)
+        break;
+
+      result->n_failed++;
+      c = g_rand_int_range (rand, 0, scenario->n_clients);
+      for (; c < 2 * scenario->n_clients; c++) {
+        if (!g_queue_is_empty (&clients[c % scenario->n_clients])) {
+          release_one (&clients[c % scenario->n_clients], rand,
+              scenario->random_order);
+          break;
+        }
+      }
+      if (c == 2 * scenario->n_clients) {
+        g_printerr ("%s: no space for %lu bytes in an empty space\n",
+            scenario->name, size);
+        ok = FALSE;
+        goto done;
+      }
+    }
+
+    if (shm_alloc_space_block_get (space,
+            shm_alloc_space_alloc_block_get_offset (block) + size - 1) !=
+        block) {
+      g_printerr ("%s: block lookup failed\n", scenario->name);
+      ok = FALSE;
+    }
+
+    /* sent to every client, the writer drops its own ref */
+    for (c = 0; c < scenario->n_clients; c++) {
+      shm_alloc_space_block_inc (block);
+      g_queue_push_tail (&clients[c], block);
+      if (clients[c].length > scenario->n_held)
+        release_one (&clients[c], rand, scenario->random_order);
+    }
+    shm_alloc_space_block_dec (block);
+
+    if (i % 64 == 0) {
+      shm_alloc_space_get_stats (space, &stats);
+      result->free_blocks += stats.n_free_blocks;
+      result->largest_free += stats.largest_free_size;
+      result->free_size += stats.free_size;
+      result->n_samples++;
+    }
+  }
+
+done:
+  for (c = 0; c < scenario->n_clients; c++)
+    while (!g_queue_is_empty (&clients[c]))
+      release_one (&clients[c], rand, scenario->random_order);
+
+  /* everything must have been merged back into one free block */
+  shm_alloc_space_get_stats (space, &stats);
+  if (stats.n_blocks != 0 || stats.n_free_blocks != 1 ||
+      stats.free_size != (gsize) block_size * space_blocks) {
+    g_printerr ("%s: space not whole after releasing all blocks: %lu blocks "
+        "in use, %lu bytes free in %lu blocks\n", scenario->name,
+        stats.n_blocks, stats.free_size, stats.n_free_blocks);
+    ok = FALSE;
+  } else {
+    shm_alloc_space_free (space);
+  }
+
+  result->ns = alloc_ns;
+
+  g_rand_free (rand);
+  g_free (clients);
+
+  return ok;
+}
+
+static void
+print_result (const Scenario * scenario, const Result * result)
+{
+  gchar ns[G_ASCII_DTOSTR_BUF_SIZE], blocks[G_ASCII_DTOSTR_BUF_SIZE];
+  gchar frag[G_ASCII_DTOSTR_BUF_SIZE];
+  guint n = MAX (result->n_samples, 1);
+
+  g_ascii_formatd (ns, sizeof (ns), "%.1f",
+      (gdouble) result->ns / MAX (result->n_allocs, 1));
+  g_ascii_formatd (blocks, sizeof (blocks), "%.1f",
+      (gdouble) result->free_blocks / n);
+  /* share of the free space that is not in the largest free block */
+  g_ascii_formatd (frag, sizeof (frag), "%.3f", result->free_size ?
+      1.0 - (gdouble) result->largest_free / result->free_size : 0.0);
+
+  g_print ("%s,%u,%u,%s,%s,%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT
+      ",%s,%s,%s\n", scenario->name, scenario->n_clients, scenario->n_held,
+      scenario->random_order ? "random" : "in-order",
+      scenario->random_size ? "random" : "fixed", result->n_allocs,
+      result->n_failed, ns, blocks, frag);
+}
+
+int
+main (int argc, char *argv[])
+{
+  static const Scenario scenarios[] = {
+    {"ring", 1, 8, FALSE, FALSE},
+    {"ring-sizes", 1, 8, FALSE, TRUE},
+    {"clients", 8, 24, FALSE, TRUE},
+    {"slow-clients", 8, 24, TRUE, TRUE},
+    {"many-slow-clients", 32, 48, TRUE, TRUE},
+  };
+  GOptionContext *ctx;
+  GError *err = NULL;
+  gboolean ok = TRUE;
+  guint i;
+
+  ctx = g_option_context_new ("- shm allocator benchmark");
+  g_option_context_add_main_entries (ctx, entries, NULL);
+  if (!g_option_context_parse (ctx, &argc, &argv, &err)) {
+    g_printerr ("Error initializing: %s\n", err->message);
+    g_clear_error (&err);
+    g_option_context_free (ctx);
+    return 1;
+  }
+  g_option_context_free (ctx);
+
+  if (block_size < 2 || space_blocks < 1) {
+    g_printerr ("The blocks and the space must not be empty\n");
+    return 1;
+  }
+
+  g_print ("scenario,clients,held,release,sizes,allocs,failed,ns_per_alloc,"
+      "free_blocks,fragmentation\n");
+
+  for (i = 0; i < G_N_ELEMENTS (scenarios); i++) {
+    Result result;
+
+    if (filter && !strstr (scenarios[i].name, filter))
+      continue;
+
+    ok &= run_scenario (&scenarios[i], &result);
+    print_result (&scenarios[i], &result);
+  }
+
+  return ok ? 0 : 1;
+}